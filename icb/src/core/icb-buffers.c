@@ -0,0 +1,139 @@
+/*
+ icb-buffers.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "settings.h"
+
+#include "icb-servers.h"
+#include "icb-buffers.h"
+
+static int shrink_tag, shrink_time;
+
+int icb_buffer_grow(unsigned char **buf, int *size, int *high, int needed)
+{
+	int newsize;
+
+	if (needed <= *size)
+		return FALSE;
+
+	newsize = *size < ICB_BUFFER_MIN_SIZE ? ICB_BUFFER_MIN_SIZE : *size;
+	while (newsize < needed)
+		newsize *= 2;
+
+	*buf = g_realloc(*buf, newsize);
+	*size = newsize;
+	if (newsize > *high)
+		*high = newsize;
+	return TRUE;
+}
+
+/* Size a buffer should have when at most peak bytes were used of it */
+static int buffer_shrink_size(int size, int peak)
+{
+	int newsize;
+
+	newsize = ICB_BUFFER_MIN_SIZE;
+	while (newsize < peak)
+		newsize *= 2;
+
+	/* don't bother unless it at least halves the buffer */
+	return newsize*2 <= size ? newsize : size;
+}
+
+static void server_shrink_buffers(ICB_SERVER_REC *server)
+{
+	int size, unparsed;
+
+	/* outbuf is empty unless a write is still pending */
+	size = buffer_shrink_size(server->outbuf_size, server->outbuf_peak);
+	if (size != server->outbuf_size && server->outbuf_pos == 0) {
+		server->outbuf = g_realloc(server->outbuf, size);
+		server->outbuf_size = size;
+		server->reallocs++;
+	}
+
+	/* recvbuf may have the start of a packet - move it to beginning.
+	   Keep the room for the next read, or the next read would just
+	   grow it back. */
+	unparsed = server->recvbuf_pos - server->recvbuf_next_packet;
+	size = buffer_shrink_size(server->recvbuf_size,
+				  MAX(server->recvbuf_peak,
+				      unparsed + ICB_READ_SIZE));
+	if (size != server->recvbuf_size) {
+		g_memmove(server->recvbuf,
+			  server->recvbuf+server->recvbuf_next_packet,
+			  unparsed);
+		server->memmoves++;
+		server->recvbuf_pos = unparsed;
+		server->recvbuf_next_packet = 0;
+
+		server->recvbuf = g_realloc(server->recvbuf, size);
+		server->recvbuf_size = size;
+		server->reallocs++;
+	}
+
+	server->outbuf_peak = server->recvbuf_peak = 0;
+}
+
+static int sig_shrink_buffers(void)
+{
+	GSList *tmp;
+
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		ICB_SERVER_REC *server = ICB_SERVER(tmp->data);
+
+		if (server != NULL && server->recvbuf != NULL)
+			server_shrink_buffers(server);
+	}
+	return 1;
+}
+
+static void read_settings(void)
+{
+	int time;
+
+	time = settings_get_int("icb_buffer_shrink_time");
+	if (time < 1) time = 1;
+	if (time == shrink_time)
+		return;
+
+	shrink_time = time;
+	if (shrink_tag != -1)
+		g_source_remove(shrink_tag);
+	shrink_tag = g_timeout_add(shrink_time * 1000,
+				   (GSourceFunc) sig_shrink_buffers, NULL);
+}
+
+void icb_buffers_init(void)
+{
+	settings_add_int("icb", "icb_buffer_shrink_time", 300);
+
+	shrink_tag = -1; shrink_time = 0;
+	read_settings();
+
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+}
+
+void icb_buffers_deinit(void)
+{
+	g_source_remove(shrink_tag);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+}
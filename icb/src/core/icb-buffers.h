@@ -0,0 +1,19 @@
+#ifndef __ICB_BUFFERS_H
+#define __ICB_BUFFERS_H
+
+/* smallest size buffers are shrinked to */
+#define ICB_BUFFER_MIN_SIZE 256
+
+/* how much is read from socket at a time. recvbuf always has room for
+   this and a \0 after the unparsed data. */
+#define ICB_READ_SIZE 512
+
+/* Make buffer at least needed bytes large. The size is doubled, so
+   sustained growth costs only a few reallocs. high is updated to the
+   largest size the buffer has had. Returns TRUE if buffer was realloced. */
+int icb_buffer_grow(unsigned char **buf, int *size, int *high, int needed);
+
+void icb_buffers_init(void);
+void icb_buffers_deinit(void);
+
+#endif
@@ -0,0 +1,442 @@
+/*
+ icb-capture.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "misc.h"
+#include "servers-reconnect.h"
+
+#include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-protocol.h"
+#include "icb-buffers.h"
+#include "icb-capture.h"
+
+#include <fcntl.h>
+
+/* if the disk can't keep up and this much is waiting, give up */
+#define CAPTURE_BUFFER_MAX (4*1024*1024)
+
+/* no socket read is this large, larger records are corrupted */
+#define CAPTURE_RECORD_MAX (1024*1024)
+
+struct _ICB_CAPTURE_REC {
+	/* the data is buffered and written to the file from the main loop,
+	   so everything read in one wakeup goes in one write */
+	GIOChannel *handle;
+	int file;
+	int write_tag;
+
+	unsigned char *buffer;
+	int buffer_size, buffer_high;
+	int buffer_start, buffer_pos;
+};
+
+typedef struct {
+	/* server record without a socket the data is fed to, so the
+	   replay doesn't mix with the real connection or send anything */
+	ICB_SERVER_REC *server;
+	FILE *file;
+	int fast, tag;
+
+	GTimeVal start; /* when replay was started */
+	GTimeVal first; /* time of the first record */
+
+	/* the record waiting for its time to come */
+	GTimeVal next;
+	unsigned char *data;
+	int data_len, data_size;
+
+	unsigned long bytes;
+} REPLAY_REC;
+
+static GSList *replays;
+
+static void put_uint32(unsigned char *p, unsigned long value)
+{
+	p[0] = (value >> 24) & 0xff;
+	p[1] = (value >> 16) & 0xff;
+	p[2] = (value >> 8) & 0xff;
+	p[3] = value & 0xff;
+}
+
+static unsigned long get_uint32(const unsigned char *p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+		((unsigned long) p[2] << 8) | p[3];
+}
+
+static int write_all(int handle, const unsigned char *data, int len)
+{
+	int ret;
+
+	while (len > 0) {
+		ret = write(handle, data, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += ret; len -= ret;
+	}
+	return TRUE;
+}
+
+/* Write as much of the buffer to the file as it takes */
+static void capture_send(ICB_SERVER_REC *server)
+{
+	ICB_CAPTURE_REC *rec = server->capture;
+	int ret;
+
+	ret = write(rec->file, rec->buffer + rec->buffer_start,
+		    rec->buffer_pos - rec->buffer_start);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+
+		/* disk full or something, give up */
+		icb_capture_stop(server);
+		return;
+	}
+
+	rec->buffer_start += ret;
+	if (rec->buffer_start == rec->buffer_pos) {
+		rec->buffer_start = rec->buffer_pos = 0;
+		g_source_remove(rec->write_tag);
+		rec->write_tag = -1;
+	}
+}
+
+/* The capture starts from the next unparsed packet, so that a replay
+   doesn't begin in the middle of one */
+static void capture_add_unparsed(ICB_SERVER_REC *server)
+{
+	int start, len;
+
+	start = server->recvbuf_next_packet;
+	len = server->recvbuf_pos - start;
+	if (server->recvbuf == NULL || len <= 0)
+		return;
+
+	icb_capture_add(server, ICB_CAPTURE_READ,
+			server->recvbuf + start, len);
+}
+
+int icb_capture_start(ICB_SERVER_REC *server, const char *path)
+{
+	ICB_CAPTURE_REC *rec;
+	char *fname;
+	int handle;
+
+	g_return_val_if_fail(IS_ICB_SERVER(server), FALSE);
+	g_return_val_if_fail(path != NULL, FALSE);
+
+	fname = convert_home(path);
+	handle = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	g_free(fname);
+	if (handle == -1)
+		return FALSE;
+
+	icb_capture_stop(server);
+
+	rec = g_new0(ICB_CAPTURE_REC, 1);
+	rec->file = handle;
+	fcntl(rec->file, F_SETFL, O_NONBLOCK);
+	rec->handle = g_io_channel_unix_new(rec->file);
+	rec->write_tag = -1;
+
+	rec->buffer_size = rec->buffer_high = ICB_BUFFER_MIN_SIZE;
+	rec->buffer = g_malloc(rec->buffer_size);
+	memcpy(rec->buffer, ICB_CAPTURE_MAGIC, ICB_CAPTURE_MAGIC_LEN);
+	rec->buffer_pos = ICB_CAPTURE_MAGIC_LEN;
+
+	server->capture = rec;
+	capture_add_unparsed(server);
+	return TRUE;
+}
+
+void icb_capture_stop(ICB_SERVER_REC *server)
+{
+	ICB_CAPTURE_REC *rec = server->capture;
+
+	if (rec == NULL)
+		return;
+
+	server->capture = NULL;
+	if (rec->write_tag != -1)
+		g_source_remove(rec->write_tag);
+
+	if (rec->buffer_pos > rec->buffer_start) {
+		fcntl(rec->file, F_SETFL, 0);
+		write_all(rec->file, rec->buffer + rec->buffer_start,
+			  rec->buffer_pos - rec->buffer_start);
+	}
+
+	g_io_channel_unref(rec->handle);
+	close(rec->file);
+
+	g_free(rec->buffer);
+	g_free(rec);
+}
+
+void icb_capture_add(ICB_SERVER_REC *server, int direction,
+		     const unsigned char *data, int len)
+{
+	ICB_CAPTURE_REC *rec = server->capture;
+	GTimeVal now;
+	unsigned char *p;
+
+	if (rec->buffer_pos + ICB_CAPTURE_HEADER_LEN + len >
+	    CAPTURE_BUFFER_MAX) {
+		/* the disk isn't keeping up */
+		icb_capture_stop(server);
+		return;
+	}
+
+	icb_buffer_grow(&rec->buffer, &rec->buffer_size, &rec->buffer_high,
+			rec->buffer_pos + ICB_CAPTURE_HEADER_LEN + len);
+
+	g_get_current_time(&now);
+	p = rec->buffer + rec->buffer_pos;
+	p[0] = direction;
+	put_uint32(p+1, now.tv_sec);
+	put_uint32(p+5, now.tv_usec);
+	put_uint32(p+9, len);
+	memcpy(p + ICB_CAPTURE_HEADER_LEN, data, len);
+	rec->buffer_pos += ICB_CAPTURE_HEADER_LEN + len;
+
+	/* sent from main loop, so everything read in one wakeup goes in
+	   one write */
+	if (rec->write_tag == -1) {
+		rec->write_tag = g_input_add(rec->handle, G_INPUT_WRITE,
+					     (GInputFunction) capture_send,
+					     server);
+	}
+}
+
+/* Read the next socket read record. Returns FALSE at end of file or if
+   the record is corrupted. */
+static int replay_read_next(REPLAY_REC *rec)
+{
+	unsigned char header[ICB_CAPTURE_HEADER_LEN];
+	unsigned long len;
+
+	for (;;) {
+		if (fread(header, ICB_CAPTURE_HEADER_LEN, 1, rec->file) != 1)
+			return FALSE;
+
+		len = get_uint32(header+9);
+		if (len > CAPTURE_RECORD_MAX)
+			return FALSE;
+
+		rec->next.tv_sec = get_uint32(header+1);
+		rec->next.tv_usec = get_uint32(header+5);
+		rec->data_len = len;
+
+		if (rec->data_len > rec->data_size) {
+			rec->data_size = rec->data_len;
+			rec->data = g_realloc(rec->data, rec->data_size);
+		}
+		if (rec->data_len > 0 &&
+		    fread(rec->data, rec->data_len, 1, rec->file) != 1)
+			return FALSE;
+
+		/* what we wrote isn't replayed */
+		if (header[0] == ICB_CAPTURE_READ)
+			return TRUE;
+	}
+}
+
+static void replay_destroy(REPLAY_REC *rec, int disconnect)
+{
+	GTimeVal now;
+
+	replays = g_slist_remove(replays, rec);
+
+	g_get_current_time(&now);
+	signal_emit("icb replay finished", 3, rec->server,
+		    GINT_TO_POINTER(rec->bytes),
+		    GINT_TO_POINTER(get_timeval_diff(&now, &rec->start)));
+
+	if (rec->tag != -1) g_source_remove(rec->tag);
+	fclose(rec->file);
+	g_free(rec->data);
+
+	if (disconnect)
+		server_disconnect(SERVER(rec->server));
+	g_free(rec);
+}
+
+/* Create a server record like the one the capture was taken from, but
+   which has no socket. It's in the servers list like any logged in
+   server, so it can be /DISCONNECTed and is freed with the others. */
+static ICB_SERVER_REC *replay_server_create(ICB_SERVER_REC *server)
+{
+	SERVER_CONNECT_REC *conn;
+	SERVER_REC *rec;
+
+	conn = server_connect_copy_skeleton(SERVER_CONNECT(server->connrec),
+					    FALSE);
+	if (conn == NULL)
+		return NULL;
+
+	if (server->group != NULL) {
+		g_free_not_null(conn->channels);
+		conn->channels = g_strdup(server->group->name);
+	}
+
+	rec = icb_server_init_connect(conn);
+	server_connect_unref(conn);
+	if (rec == NULL)
+		return NULL;
+
+	g_free(rec->tag);
+	rec->tag = g_strconcat(server->tag, "-replay", NULL);
+
+	/* the capture may have started after login. there's no socket to
+	   read, so no "server connected". */
+	rec->connected = TRUE;
+	rec->connect_time = time(NULL);
+	servers = g_slist_append(servers, rec);
+	signal_emit("event connected", 1, rec);
+	return ICB_SERVER(rec);
+}
+
+static int replay_timeout(REPLAY_REC *rec)
+{
+	GTimeVal now;
+	long msecs;
+
+	rec->tag = -1;
+	for (;;) {
+		icb_protocol_feed(rec->server, rec->data, rec->data_len);
+		rec->bytes += rec->data_len;
+
+		if (g_slist_find(replays, rec) == NULL)
+			return 0; /* replayed data disconnected the server */
+
+		if (!replay_read_next(rec)) {
+			replay_destroy(rec, TRUE);
+			return 0;
+		}
+
+		if (rec->fast)
+			continue;
+
+		/* keep the original distance from the first record */
+		g_get_current_time(&now);
+		msecs = get_timeval_diff(&rec->next, &rec->first) -
+			get_timeval_diff(&now, &rec->start);
+		if (msecs > 0) {
+			rec->tag = g_timeout_add(msecs,
+						 (GSourceFunc) replay_timeout,
+						 rec);
+			return 0;
+		}
+	}
+}
+
+int icb_replay_start(ICB_SERVER_REC *server, const char *path, int fast)
+{
+	REPLAY_REC *rec;
+	char magic[ICB_CAPTURE_MAGIC_LEN], *fname;
+	FILE *file;
+
+	g_return_val_if_fail(IS_ICB_SERVER(server), FALSE);
+	g_return_val_if_fail(path != NULL, FALSE);
+
+	fname = convert_home(path);
+	file = fopen(fname, "rb");
+	g_free(fname);
+	if (file == NULL)
+		return FALSE;
+
+	if (fread(magic, ICB_CAPTURE_MAGIC_LEN, 1, file) != 1 ||
+	    memcmp(magic, ICB_CAPTURE_MAGIC, ICB_CAPTURE_MAGIC_LEN) != 0) {
+		fclose(file);
+		errno = EINVAL;
+		return FALSE;
+	}
+
+	rec = g_new0(REPLAY_REC, 1);
+	rec->server = replay_server_create(server);
+	if (rec->server == NULL) {
+		fclose(file);
+		g_free(rec);
+		errno = EINVAL;
+		return FALSE;
+	}
+	rec->file = file;
+	rec->fast = fast;
+	rec->tag = -1;
+	replays = g_slist_append(replays, rec);
+
+	g_get_current_time(&rec->start);
+	if (!replay_read_next(rec)) {
+		replay_destroy(rec, TRUE);
+		return TRUE;
+	}
+	rec->first = rec->next;
+
+	/* start from main loop so the command finishes first */
+	rec->tag = g_timeout_add(0, (GSourceFunc) replay_timeout, rec);
+	return TRUE;
+}
+
+static void sig_server_disconnected(ICB_SERVER_REC *server)
+{
+	GSList *tmp, *next;
+
+	if (!IS_ICB_SERVER(server))
+		return;
+
+	icb_capture_stop(server);
+
+	/* the replayed data disconnected the replay server */
+	for (tmp = replays; tmp != NULL; tmp = next) {
+		REPLAY_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->server == server)
+			replay_destroy(rec, FALSE);
+	}
+}
+
+void icb_capture_init(void)
+{
+	replays = NULL;
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+}
+
+void icb_capture_deinit(void)
+{
+	GSList *tmp;
+
+	while (replays != NULL)
+		replay_destroy(replays->data, TRUE);
+
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		ICB_SERVER_REC *server = ICB_SERVER(tmp->data);
+
+		if (server != NULL)
+			icb_capture_stop(server);
+	}
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+}
@@ -0,0 +1,33 @@
+#ifndef __ICB_CAPTURE_H
+#define __ICB_CAPTURE_H
+
+/* Capture file begins with ICB_CAPTURE_MAGIC, followed by records of
+   direction (1 byte), time in secs and usecs and data length (each 4
+   bytes, big endian) and the data as it was read from/written to socket. */
+#define ICB_CAPTURE_MAGIC "ICBCAP\001\n"
+#define ICB_CAPTURE_MAGIC_LEN 8
+#define ICB_CAPTURE_HEADER_LEN 13
+
+#define ICB_CAPTURE_READ 'r'
+#define ICB_CAPTURE_WRITE 'w'
+
+/* Start capturing server's traffic to path. The capture begins from the
+   next packet not yet handled. Returns FALSE and sets errno if the file
+   couldn't be created. */
+int icb_capture_start(ICB_SERVER_REC *server, const char *path);
+void icb_capture_stop(ICB_SERVER_REC *server);
+
+void icb_capture_add(ICB_SERVER_REC *server, int direction,
+		     const unsigned char *data, int len);
+
+/* Feed the data read from socket in capture file to a new server record
+   like server, which isn't connected anywhere. If fast is FALSE, the
+   original timing is kept. "icb replay finished" is sent with the replay
+   server when done. Returns FALSE and sets errno if path couldn't be
+   opened. */
+int icb_replay_start(ICB_SERVER_REC *server, const char *path, int fast);
+
+void icb_capture_init(void);
+void icb_capture_deinit(void);
+
+#endif
@@ -20,10 +20,15 @@
 
 #include "module.h"
 #include "signals.h"
+#include "nicklist.h"
 
+#include "icb.h"
 #include "icb-channels.h"
 #include "icb-protocol.h"
 
+/* seconds to wait for the server to confirm a /G before forgetting it */
+#define GROUP_PENDING_TIMEOUT 30
+
 /* Create new ICB channel record */
 ICB_CHANNEL_REC *icb_channel_create(ICB_SERVER_REC *server, const char *name,
 				    const char *visible_name, int automatic)
@@ -39,22 +44,144 @@ ICB_CHANNEL_REC *icb_channel_create(ICB_SERVER_REC *server, const char *name,
 	return rec;
 }
 
+static void group_pending_clear(ICB_SERVER_REC *server)
+{
+	g_free_and_null(server->group_pending);
+	if (server->group_pending_tag != -1) {
+		g_source_remove(server->group_pending_tag);
+		server->group_pending_tag = -1;
+	}
+}
+
+/* the server never answered, the /G was probably refused. errors can't
+   be told apart from the ones for our other commands. */
+static int group_pending_timeout(ICB_SERVER_REC *server)
+{
+	server->group_pending_tag = -1;
+	group_pending_clear(server);
+	return FALSE;
+}
+
 void icb_change_channel(ICB_SERVER_REC *server, const char *channel,
 			int automatic)
 {
-	if (g_strcasecmp(server->group->name, channel) == 0)
+	/* a pending /G may still be refused, so it's always sent again */
+	if (server->group_pending == NULL && server->group != NULL &&
+	    g_strcasecmp(server->group->name, channel) == 0)
 		return;
 
-	channel_destroy(CHANNEL(server->group));
-	server->group = (ICB_CHANNEL_REC *)
-		icb_channel_create(server, channel, NULL, automatic);
+	/* the group record is kept and renamed when the server tells
+	   us we're in the new group */
+	group_pending_clear(server);
+	server->group_pending = g_strdup(channel);
+	server->group_pending_tag =
+		g_timeout_add(GROUP_PENDING_TIMEOUT*1000,
+			      (GSourceFunc) group_pending_timeout, server);
 
         icb_command(server, "g", channel, NULL);
 }
 
+/* Move the group record to a new group without destroying it */
+static void group_rebind(ICB_SERVER_REC *server, const char *name)
+{
+	CHANNEL_REC *channel;
+	GSList *nicks, *tmp;
+	int automatic;
+
+	automatic = TRUE;
+	if (server->group_pending != NULL &&
+	    g_strcasecmp(server->group_pending, name) == 0) {
+		group_pending_clear(server);
+		automatic = FALSE;
+	}
+
+	/* our group, even if its window gets closed */
+	g_free_not_null(server->connrec->channels);
+	server->connrec->channels = g_strdup(name);
+
+	if (server->group == NULL) {
+		/* the group window was closed, open it again */
+		server->group = icb_channel_create(server, name, NULL,
+						   automatic);
+		return;
+	}
+
+	channel = CHANNEL(server->group);
+	if (strcmp(channel->name, name) == 0)
+		return;
+
+	/* the old group's members and topic don't apply anymore. any of
+	   the signals may disconnect the server, which destroys the
+	   channel too. */
+	nicks = nicklist_getnicks(channel);
+	for (tmp = nicks; tmp != NULL && !server->disconnected;
+	     tmp = tmp->next) {
+		if (tmp->data != channel->ownnick)
+			nicklist_remove(channel, tmp->data);
+	}
+	g_slist_free(nicks);
+	if (server->disconnected)
+		return;
+
+	if (channel->topic != NULL) {
+		g_free_and_null(channel->topic);
+		g_free_and_null(channel->topic_by);
+		signal_emit("channel topic changed", 1, channel);
+		if (server->disconnected)
+			return;
+	}
+
+	channel_change_name(channel, name);
+	if (!server->disconnected)
+		channel_change_visible_name(channel, name);
+}
+
+/* "nick changed the topic to \"topic\"" */
+static void group_set_topic(ICB_SERVER_REC *server, const char *text)
+{
+	CHANNEL_REC *channel;
+	const char *p;
+	int len;
+
+	p = strstr(text, " changed the topic to \"");
+	if (p == NULL)
+		return;
+
+	channel = CHANNEL(server->group);
+	g_free_not_null(channel->topic);
+	g_free_not_null(channel->topic_by);
+
+	channel->topic_by = g_strndup(text, (int) (p-text));
+	p += 23;
+	len = strlen(p);
+	if (len > 0 && p[len-1] == '"') len--;
+	channel->topic = g_strndup(p, len);
+	channel->topic_time = time(NULL);
+
+	signal_emit("channel topic changed", 1, channel);
+}
+
+static void event_status(ICB_SERVER_REC *server, char **args)
+{
+	char *name;
+	const char *p;
+
+	if (strcmp(args[0], "Status") == 0 &&
+	    strncmp(args[1], "You are now in group ", 21) == 0) {
+		for (p = args[1]+21; *p != '\0' && *p != ' '; p++) ;
+		name = g_strndup(args[1]+21, (int) (p-(args[1]+21)));
+		group_rebind(server, name);
+		g_free(name);
+	} else if (strcmp(args[0], "Topic") == 0 && server->group != NULL) {
+		group_set_topic(server, args[1]);
+	}
+}
+
 static void sig_connected(ICB_SERVER_REC *server)
 {
-	if (!IS_ICB_SERVER(server))
+	/* a replay server has its group already when the replayed login
+	   comes */
+	if (!IS_ICB_SERVER(server) || server->group != NULL)
 		return;
 
 	/* create the group for the channel */
@@ -63,12 +190,33 @@ static void sig_connected(ICB_SERVER_REC *server)
 				   NULL, TRUE);
 }
 
+static void sig_server_disconnected(ICB_SERVER_REC *server)
+{
+	if (IS_ICB_SERVER(server))
+		group_pending_clear(server);
+}
+
+static void sig_channel_destroyed(ICB_CHANNEL_REC *channel)
+{
+	if (!IS_ICB_CHANNEL(channel) || channel->server == NULL)
+		return;
+
+	if (channel->server->group == channel)
+		channel->server->group = NULL;
+}
+
 void icb_channels_init(void)
 {
         signal_add_first("event connected", (SIGNAL_FUNC) sig_connected);
+	signal_add("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_add("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
 }
 
 void icb_channels_deinit(void)
 {
         signal_remove("event connected", (SIGNAL_FUNC) sig_connected);
+	signal_remove("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_remove("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
 }
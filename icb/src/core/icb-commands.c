@@ -24,6 +24,7 @@
 #include "icb-servers.h"
 #include "icb-channels.h"
 #include "icb-protocol.h"
+#include "icb-pool.h"
 
 static char *icb_commands[] = {
 	"whois", "p", "delete", "cp", "rname",
@@ -85,7 +86,7 @@ static void cmd_group(const char *data, ICB_SERVER_REC *server)
 	if (*data == '\0')
 		cmd_return_error(CMDERR_NOT_ENOUGH_PARAMS);
 
-        icb_change_channel(server, data, FALSE);
+        icb_pool_join(server, data, FALSE);
 }
 
 static void cmd_beep(const char *data, ICB_SERVER_REC *server)
@@ -105,6 +106,13 @@ static void cmd_noop(const char *data, ICB_SERVER_REC *server)
        icb_noop(server);
 }
 
+static void cmd_icb(const char *data, ICB_SERVER_REC *server, void *item)
+{
+	CMD_ICB_SERVER(server);
+
+	command_runsub("icb", data, server, item);
+}
+
 void icb_commands_init(void)
 {
 	char **cmd;
@@ -121,6 +129,7 @@ void icb_commands_init(void)
         command_bind_icb("g", NULL, (SIGNAL_FUNC) cmd_group);
         command_bind_icb("beep", NULL, (SIGNAL_FUNC) cmd_beep);
         command_bind_icb("noop", NULL, (SIGNAL_FUNC) cmd_noop);
+        command_bind_icb("icb", NULL, (SIGNAL_FUNC) cmd_icb);
 
 	command_set_options("connect", "+icbnet");
 }
@@ -140,4 +149,5 @@ void icb_commands_deinit(void)
         command_unbind("g", (SIGNAL_FUNC) cmd_group);
         command_unbind("beep", (SIGNAL_FUNC) cmd_beep);
         command_unbind("noop", (SIGNAL_FUNC) cmd_noop);
+        command_unbind("icb", (SIGNAL_FUNC) cmd_icb);
 }
@@ -38,6 +38,24 @@ void icb_session_deinit(void);
 void icb_servers_reconnect_init(void);
 void icb_servers_reconnect_deinit(void);
 
+void icb_sendqueue_init(void);
+void icb_sendqueue_deinit(void);
+
+void icb_buffers_init(void);
+void icb_buffers_deinit(void);
+
+void icb_lag_init(void);
+void icb_lag_deinit(void);
+
+void icb_nicklist_init(void);
+void icb_nicklist_deinit(void);
+
+void icb_pool_init(void);
+void icb_pool_deinit(void);
+
+void icb_capture_init(void);
+void icb_capture_deinit(void);
+
 char **icb_split(const char *data, int count)
 {
         const char *start;
@@ -77,6 +95,34 @@ void icb_split_free(char **args)
         g_free(args);
 }
 
+int icb_split_inplace(char *data, char **args, int count)
+{
+	int pos, found;
+
+	args[0] = data; pos = 1;
+	while (pos < count) {
+		data = strchr(data, '\001');
+		if (data == NULL)
+			break;
+
+		*data++ = '\0';
+		args[pos++] = data;
+	}
+
+	found = pos;
+	for (; pos < count; pos++)
+		args[pos] = "";
+	return found;
+}
+
+void icb_split_restore(char **args, int found)
+{
+	int pos;
+
+	for (pos = 1; pos < found; pos++)
+		args[pos][-1] = '\001';
+}
+
 static CHATNET_REC *create_chatnet(void)
 {
         return g_malloc0(sizeof(CHATNET_REC));
@@ -94,11 +140,12 @@ static CHANNEL_SETUP_REC *create_channel_setup(void)
 
 static SERVER_CONNECT_REC *create_server_connect(void)
 {
-        return g_malloc0(sizeof(SERVER_CONNECT_REC));
+        return g_malloc0(sizeof(ICB_SERVER_CONNECT_REC));
 }
 
 static void destroy_server_connect(SERVER_CONNECT_REC *conn)
 {
+	icb_server_connect_free_saved((ICB_SERVER_CONNECT_REC *) conn);
 }
 
 static CHANNEL_REC *_channel_create(SERVER_REC *server, const char *name,
@@ -137,7 +184,13 @@ void icb_core_init(void)
 	icb_servers_init();
 	icb_servers_reconnect_init();
         icb_channels_init();
+	icb_nicklist_init();
+	icb_pool_init();
+	icb_capture_init();
 	icb_protocol_init();
+	icb_sendqueue_init();
+	icb_buffers_init();
+	icb_lag_init();
 	icb_commands_init();
         icb_session_init();
 
@@ -146,10 +199,17 @@ void icb_core_init(void)
 
 void icb_core_deinit(void)
 {
+	/* replays disconnect their servers, which needs the others */
+	icb_capture_deinit();
 	icb_servers_deinit();
 	icb_servers_reconnect_deinit();
         icb_channels_deinit();
+	icb_nicklist_deinit();
+	icb_pool_deinit();
 	icb_protocol_deinit();
+	icb_sendqueue_deinit();
+	icb_buffers_deinit();
+	icb_lag_deinit();
         icb_commands_deinit();
         icb_session_deinit();
 
@@ -0,0 +1,160 @@
+/*
+ icb-lag.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "settings.h"
+#include "misc.h"
+
+#include "icb-servers.h"
+#include "icb-protocol.h"
+
+/* pings we send have this prefix followed by the send time */
+#define LAG_PING_ID "irssi-lag "
+#define LAG_PING_ID_LEN (sizeof(LAG_PING_ID)-1)
+
+static int timeout_tag;
+
+static void lag_get(ICB_SERVER_REC *server)
+{
+	char id[64];
+
+	g_get_current_time(&server->lag_sent);
+	server->lag_last_check = time(NULL);
+
+	g_snprintf(id, sizeof(id), LAG_PING_ID"%ld.%06ld",
+		   (long) server->lag_sent.tv_sec,
+		   (long) server->lag_sent.tv_usec);
+	icb_ping(server, id);
+}
+
+/* Update the moving average and jitter histogram with a new lag */
+static void lag_add(ICB_SERVER_REC *server, int lag)
+{
+	int diff, bucket;
+
+	if (server->lag_avg == 0)
+		server->lag_avg = lag;
+	else
+		server->lag_avg += (lag - server->lag_avg) / 8;
+
+	/* jitter == distance from the average, in 2^n msec buckets */
+	diff = lag > server->lag_avg ? lag - server->lag_avg :
+		server->lag_avg - lag;
+	bucket = 0;
+	while (diff > 1 && bucket < ICB_LAG_JITTER_BUCKETS-1) {
+		diff >>= 1;
+		bucket++;
+	}
+	server->lag_jitter[bucket]++;
+}
+
+static void event_pong(ICB_SERVER_REC *server, char **args)
+{
+	const char *data = args[0];
+	GTimeVal now;
+	long sec, usec;
+
+	if (server->lag_sent.tv_sec == 0 ||
+	    strncmp(data, LAG_PING_ID, LAG_PING_ID_LEN) != 0)
+		return;
+
+	/* ignore replies to pings we've already given up on */
+	if (sscanf(data+LAG_PING_ID_LEN, "%ld.%ld", &sec, &usec) != 2 ||
+	    sec != server->lag_sent.tv_sec || usec != server->lag_sent.tv_usec)
+		return;
+
+	g_get_current_time(&now);
+	server->lag = (int) get_timeval_diff(&now, &server->lag_sent);
+	memset(&server->lag_sent, 0, sizeof(server->lag_sent));
+	server->lag_pong_seen = TRUE;
+
+	lag_add(server, server->lag);
+	signal_emit("server lag", 1, server);
+}
+
+static int sig_check_lag(void)
+{
+	GSList *tmp, *next;
+	time_t now;
+	int lag_check_time, max_lag;
+
+	lag_check_time = settings_get_int("icb_lag_check_time");
+	max_lag = settings_get_int("icb_lag_max_before_disconnect");
+
+	if (lag_check_time <= 0)
+		return 1;
+
+	now = time(NULL);
+	for (tmp = servers; tmp != NULL; tmp = next) {
+		ICB_SERVER_REC *rec = tmp->data;
+
+		next = tmp->next;
+		/* replay servers have no socket to ping */
+		if (!IS_ICB_SERVER(rec) || !rec->connected ||
+		    rec->handle == NULL)
+			continue;
+
+		if (rec->lag_sent.tv_sec != 0) {
+			/* waiting for lag reply */
+			if (max_lag <= 1 || now-rec->lag_sent.tv_sec <= max_lag)
+				continue;
+
+			if (!rec->lag_pong_seen) {
+				/* the server doesn't answer pings at all,
+				   only keep the connection alive */
+				memset(&rec->lag_sent, 0,
+				       sizeof(rec->lag_sent));
+				rec->lag_no_pongs = TRUE;
+				continue;
+			}
+
+			/* too much lag, disconnect and let the
+			   reconnect code bring us back */
+			signal_emit("server lag disconnect", 1, rec);
+			rec->connection_lost = TRUE;
+			server_disconnect((SERVER_REC *) rec);
+		} else if (rec->lag_last_check+lag_check_time < now) {
+			if (!rec->lag_no_pongs)
+				lag_get(rec);
+			else {
+				rec->lag_last_check = now;
+				icb_noop(rec);
+			}
+		}
+	}
+
+	return 1;
+}
+
+void icb_lag_init(void)
+{
+	settings_add_int("icb", "icb_lag_check_time", 60);
+	settings_add_int("icb", "icb_lag_max_before_disconnect", 300);
+
+	timeout_tag = g_timeout_add(1000, (GSourceFunc) sig_check_lag, NULL);
+	signal_add("icb fields pong", (SIGNAL_FUNC) event_pong);
+}
+
+void icb_lag_deinit(void)
+{
+	g_source_remove(timeout_tag);
+	signal_remove("icb fields pong", (SIGNAL_FUNC) event_pong);
+}
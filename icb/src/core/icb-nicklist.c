@@ -0,0 +1,187 @@
+/*
+ icb-nicklist.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "nicklist.h"
+
+#include "icb.h"
+#include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-nicklist.h"
+
+NICK_REC *icb_nicklist_insert(ICB_CHANNEL_REC *channel, const char *nick,
+			      const char *host, int op)
+{
+	NICK_REC *rec;
+
+	g_return_val_if_fail(IS_ICB_CHANNEL(channel), NULL);
+	g_return_val_if_fail(nick != NULL, NULL);
+
+	rec = g_new0(NICK_REC, 1);
+	rec->nick = g_strdup(nick);
+	rec->host = host == NULL ? NULL : g_strdup(host);
+	rec->op = op;
+
+	nicklist_insert(CHANNEL(channel), rec);
+	return rec;
+}
+
+/* Get nick and user@host from "nick (user@host) ..." status text */
+static char *status_get_nick(const char *text, char **host)
+{
+	const char *p, *end;
+
+	for (p = text; *p != '\0' && *p != ' '; p++) ;
+	*host = NULL;
+
+	if (p[0] == ' ' && p[1] == '(') {
+		end = strchr(p+2, ')');
+		if (end != NULL)
+			*host = g_strndup(p+2, (int) (end-(p+2)));
+	}
+
+	return g_strndup(text, (int) (p-text));
+}
+
+static void nick_arrive(ICB_SERVER_REC *server, const char *text)
+{
+	char *nick, *host;
+
+	nick = status_get_nick(text, &host);
+	if (*nick != '\0' &&
+	    nicklist_find(CHANNEL(server->group), nick) == NULL)
+		icb_nicklist_insert(server->group, nick, host, FALSE);
+	g_free(nick);
+	g_free(host);
+}
+
+static void nick_depart(ICB_SERVER_REC *server, const char *text)
+{
+	NICK_REC *rec;
+	char *nick, *host;
+
+	nick = status_get_nick(text, &host);
+	rec = nicklist_find(CHANNEL(server->group), nick);
+	if (rec != NULL && rec != server->group->ownnick)
+		nicklist_remove(CHANNEL(server->group), rec);
+	g_free(nick);
+	g_free(host);
+}
+
+/* "oldnick changed nickname to newnick" */
+static void nick_name(ICB_SERVER_REC *server, const char *text)
+{
+	const char *p;
+	char *oldnick;
+
+	p = strstr(text, " changed nickname to ");
+	if (p == NULL)
+		return;
+
+	oldnick = g_strndup(text, (int) (p-text));
+	p += 21;
+
+	if (g_strcasecmp(oldnick, server->nick) == 0)
+		server_change_nick(SERVER(server), p);
+	nicklist_rename(SERVER(server), oldnick, p);
+	g_free(oldnick);
+}
+
+static void event_status(ICB_SERVER_REC *server, char **args)
+{
+	if (server->group == NULL)
+		return;
+
+	if (strcmp(args[0], "Arrive") == 0 || strcmp(args[0], "Sign-on") == 0)
+		nick_arrive(server, args[1]);
+	else if (strcmp(args[0], "Depart") == 0 ||
+		 strcmp(args[0], "Sign-off") == 0)
+		nick_depart(server, args[1]);
+	else if (strcmp(args[0], "Name") == 0)
+		nick_name(server, args[1]);
+}
+
+/* /WHO output is a "Group: name ..." header line followed by one "wl"
+   line per member, so every member of our group is added with a single
+   hash lookup */
+static void sig_cmdout(ICB_SERVER_REC *server, char **args)
+{
+	const char *p;
+	int count;
+
+	if (strcmp(args[0], "co") == 0) {
+		if (args[1] == NULL || strncmp(args[1], "Group: ", 7) != 0)
+			return;
+
+		for (p = args[1]+7; *p != '\0' && *p != ' '; p++) ;
+		g_free(server->who_group);
+		server->who_group = g_strndup(args[1]+7, (int) (p-(args[1]+7)));
+		return;
+	}
+
+	if (strcmp(args[0], "wl") != 0 || server->group == NULL ||
+	    server->who_group == NULL ||
+	    g_strcasecmp(server->who_group, server->group->name) != 0)
+		return;
+
+	/* wl, moderator flag, nick, idle, resp, login time, user, host */
+	for (count = 0; args[count] != NULL; count++) ;
+	if (count < 3 || *args[2] == '\0' ||
+	    nicklist_find(CHANNEL(server->group), args[2]) != NULL)
+		return;
+
+	if (count >= 8) {
+		char *host;
+
+		host = g_strconcat(args[6], "@", args[7], NULL);
+		icb_nicklist_insert(server->group, args[2], host,
+				    *args[1] == '*' || *args[1] == 'm');
+		g_free(host);
+	} else {
+		icb_nicklist_insert(server->group, args[2], NULL,
+				    *args[1] == '*' || *args[1] == 'm');
+	}
+}
+
+static void sig_channel_created(ICB_CHANNEL_REC *channel)
+{
+	NICK_REC *rec;
+
+	if (!IS_ICB_CHANNEL(channel))
+		return;
+
+	rec = icb_nicklist_insert(channel, channel->server->nick, NULL, FALSE);
+	nicklist_set_own(CHANNEL(channel), rec);
+}
+
+void icb_nicklist_init(void)
+{
+	signal_add("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_add_first("default icb cmdout", (SIGNAL_FUNC) sig_cmdout);
+	signal_add("channel created", (SIGNAL_FUNC) sig_channel_created);
+}
+
+void icb_nicklist_deinit(void)
+{
+	signal_remove("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_remove("default icb cmdout", (SIGNAL_FUNC) sig_cmdout);
+	signal_remove("channel created", (SIGNAL_FUNC) sig_channel_created);
+}
@@ -0,0 +1,13 @@
+#ifndef __ICB_NICKLIST_H
+#define __ICB_NICKLIST_H
+
+#include "nicklist.h"
+
+/* Add new nick to group's nicklist */
+NICK_REC *icb_nicklist_insert(ICB_CHANNEL_REC *channel, const char *nick,
+			      const char *host, int op);
+
+void icb_nicklist_init(void);
+void icb_nicklist_deinit(void);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ icb-pool.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "settings.h"
+#include "servers-reconnect.h"
+
+#include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-pool.h"
+
+/* Connections belong to the same pool if they go to the same network */
+static int pool_match(ICB_SERVER_CONNECT_REC *conn1,
+		      ICB_SERVER_CONNECT_REC *conn2)
+{
+	if (conn1->chatnet != NULL || conn2->chatnet != NULL) {
+		return conn1->chatnet != NULL && conn2->chatnet != NULL &&
+			g_strcasecmp(conn1->chatnet, conn2->chatnet) == 0;
+	}
+
+	return conn1->port == conn2->port &&
+		g_strcasecmp(conn1->address, conn2->address) == 0;
+}
+
+/* Open a new pooled connection which logs straight into group */
+static void pool_connect(ICB_SERVER_REC *server, const char *group, int slot)
+{
+	SERVER_CONNECT_REC *conn;
+	SERVER_REC *newserver;
+	char *nick, suffix[MAX_INT_STRLEN];
+	int len;
+
+	conn = server_connect_copy_skeleton(SERVER_CONNECT(server->connrec),
+					    TRUE);
+	if (conn == NULL)
+		return;
+
+	/* ICB doesn't allow logging in twice with the same nick, so pooled
+	   connections use nick<slot+1> */
+	nick = g_strdup(server->connrec->nick);
+	if (server->connrec->pool_slot > 0) {
+		/* strip the slot number of the connection we're copying */
+		len = g_snprintf(suffix, sizeof(suffix), "%d",
+				 server->connrec->pool_slot+1);
+		len = strlen(nick) - len;
+		if (len > 0) nick[len] = '\0';
+	}
+	g_free(conn->nick);
+	conn->nick = g_strdup_printf("%s%d", nick, slot+1);
+	ICB_SERVER_CONNECT(conn)->pool_slot = slot;
+	/* the copy isn't reconnecting, don't make it wait for the backoff */
+	conn->reconnection = FALSE;
+	ICB_SERVER_CONNECT(conn)->reconnect_attempts = 0;
+	g_free(nick);
+	g_free_not_null(conn->channels);
+	conn->channels = g_strdup(group);
+
+	newserver = icb_server_init_connect(conn);
+	if (newserver != NULL) {
+		ICB_SERVER(newserver)->pool_last_used = time(NULL);
+		icb_server_connect(newserver);
+	}
+	server_connect_unref(conn);
+}
+
+void icb_pool_join(ICB_SERVER_REC *server, const char *group, int automatic)
+{
+	ICB_SERVER_REC *lru;
+	GSList *tmp;
+	int size, count, slot_used[ICB_POOL_MAX_SIZE];
+
+	g_return_if_fail(IS_ICB_SERVER(server));
+	g_return_if_fail(group != NULL);
+
+	size = settings_get_int("icb_pool_size");
+	if (size > ICB_POOL_MAX_SIZE) size = ICB_POOL_MAX_SIZE;
+	if (size <= 1) {
+		icb_change_channel(server, group, automatic);
+		return;
+	}
+
+	memset(slot_used, 0, sizeof(slot_used));
+	count = 0; lru = NULL;
+
+	/* connections still logging in count towards the pool size too */
+	for (tmp = lookup_servers; tmp != NULL; tmp = tmp->next) {
+		ICB_SERVER_REC *rec = ICB_SERVER(tmp->data);
+
+		if (rec == NULL || !pool_match(rec->connrec, server->connrec))
+			continue;
+
+		if (rec->connrec->channels != NULL &&
+		    g_strcasecmp(rec->connrec->channels, group) == 0) {
+			/* already logging in to the group */
+			return;
+		}
+
+		if (rec->connrec->pool_slot < ICB_POOL_MAX_SIZE)
+			slot_used[rec->connrec->pool_slot] = TRUE;
+		count++;
+	}
+
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		ICB_SERVER_REC *rec = ICB_SERVER(tmp->data);
+
+		/* replay servers have no socket */
+		if (rec == NULL || rec->handle == NULL ||
+		    !pool_match(rec->connrec, server->connrec))
+			continue;
+
+		if (rec->group_pending != NULL &&
+		    g_strcasecmp(rec->group_pending, group) == 0) {
+			/* some connection is already moving there */
+			rec->pool_last_used = time(NULL);
+			return;
+		}
+
+		if (rec->group != NULL &&
+		    g_strcasecmp(rec->group->name, group) == 0) {
+			/* some connection is already parked there */
+			rec->pool_last_used = time(NULL);
+			signal_emit("icb pool reuse", 2, rec, rec->group);
+			return;
+		}
+
+		if (rec->connrec->pool_slot < ICB_POOL_MAX_SIZE)
+			slot_used[rec->connrec->pool_slot] = TRUE;
+		count++;
+		if (rec->connected && (lru == NULL ||
+				       rec->pool_last_used < lru->pool_last_used))
+			lru = rec;
+	}
+
+	if (count < size) {
+		for (count = 0; slot_used[count]; count++) ;
+		pool_connect(server, group, count);
+	} else if (lru != NULL) {
+		/* pool is full, move the least recently used connection */
+		lru->pool_last_used = time(NULL);
+		icb_change_channel(lru, group, automatic);
+	}
+}
+
+void icb_pool_init(void)
+{
+	settings_add_int("icb", "icb_pool_size", 1);
+}
+
+void icb_pool_deinit(void)
+{
+}
@@ -0,0 +1,16 @@
+#ifndef __ICB_POOL_H
+#define __ICB_POOL_H
+
+#define ICB_POOL_MAX_SIZE 16
+
+/* Join group using the network's connection pool. A connection already
+   parked in the group is reused, a new one is opened if the pool isn't
+   full yet, otherwise the least recently used connection changes its
+   group. With icb_pool_size <= 1 this is the same as
+   icb_change_channel(). */
+void icb_pool_join(ICB_SERVER_REC *server, const char *group, int automatic);
+
+void icb_pool_init(void);
+void icb_pool_deinit(void);
+
+#endif
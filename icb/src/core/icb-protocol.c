@@ -23,89 +23,246 @@
 #include "network.h"
 #include "net-sendbuffer.h"
 #include "rawlog.h"
+#include "settings.h"
 
 #include "icb-servers.h"
-
-static char *signal_names[] = {
-	"login",
-	"open",
-	"personal",
-	"status",
-	"error",
-	"important",
-	"exit",
-	"command",
-	"cmdout",
-	"protocol",
-	"beep",
-	"ping",
-        "pong"
+#include "icb-protocol.h"
+#include "icb-sendqueue.h"
+#include "icb-buffers.h"
+#include "icb-capture.h"
+
+typedef struct {
+	const char *name;
+	int min_fields; /* packets with less ^A separated fields are malformed */
+	int max_fields; /* any further ^As are left in the last field */
+} ICB_PACKET_TYPE_REC;
+
+/* indexed by packet type - 'a' */
+static const ICB_PACKET_TYPE_REC packet_types[] = {
+	{ "login", 1, 1 },
+	{ "open", 2, 2 }, /* nick, text */
+	{ "personal", 2, 2 }, /* nick, text */
+	{ "status", 2, 2 }, /* category, text */
+	{ "error", 1, 1 },
+	{ "important", 2, 2 }, /* category, text */
+	{ "exit", 1, 1 },
+	{ "command", 1, 1 },
+	{ "cmdout", 1, ICB_MAX_FIELDS }, /* output type, ... */
+	{ "protocol", 1, 3 }, /* level, host id, server id */
+	{ "beep", 1, 1 },
+	{ "ping", 1, 1 },
+        { "pong", 1, 1 }
 };
 
-#define SIGNAL_FIRST 'a'
-#define SIGNALS_COUNT (sizeof(signal_names)/sizeof(signal_names[0]))
+#define PACKET_TYPE_FIRST 'a'
+#define PACKET_TYPES_COUNT (sizeof(packet_types)/sizeof(packet_types[0]))
 
-#ifdef BLOCKING_SOCKETS
-#  define MAX_SOCKET_READS 1
-#else
-#  define MAX_SOCKET_READS 5
-#endif
+/* "icb fields <name>" and "icb event <name>" signal ids, resolved in
+   icb_protocol_init() */
+static int fields_signal_ids[PACKET_TYPES_COUNT];
+static int event_signal_ids[PACKET_TYPES_COUNT];
 
-static void icb_send_cmd(ICB_SERVER_REC *server, int type, ...)
+static GHashTable *cmdout_signals;
+static int default_cmdout_signal;
+
+/* how long / how much to read from socket per wakeup, from /SET */
+static int read_max_time, read_max_bytes;
+static int stats_tag, stats_interval;
+
+static int icb_flush_output(ICB_SERVER_REC *server)
 {
-        const char *arg;
-	va_list va;
-        int pos, len, startpos;
+	int len;
 
-	g_return_if_fail(IS_ICB_SERVER(server));
+	server->outbuf_tag = -1;
+	if (server->outbuf_pos == 0)
+		return 0;
 
-	server->sendbuf[1] = type;
-	pos = 2;
+	len = server->outbuf_pos;
+	server->outbuf_pos = 0;
 
-	va_start(va, type);
-	for (;;) {
-		arg = va_arg(va, const char *);
-		if (arg == NULL)
-			break;
+	/* replay servers aren't connected anywhere, what they'd send
+	   is dropped */
+	if (server->handle == NULL)
+		return 0;
 
-		len = strlen(arg);
-                /* +2 == ^A + \0 at end of buffer */
-		if (pos+len+2 > server->sendbuf_size) {
-                        server->sendbuf_size += len + 128;
-			server->sendbuf = g_realloc(server->sendbuf,
-						    server->sendbuf_size);
-		}
+	if (server->capture != NULL)
+		icb_capture_add(server, ICB_CAPTURE_WRITE, server->outbuf, len);
 
-		if (pos != 2) {
-			/* separate fields with ^A */
-                        server->sendbuf[pos++] = '\001';
-		}
+	server->send_writes++;
+	if (net_sendbuffer_send(server->handle, server->outbuf, len) == -1) {
+		/* something bad happened */
+		server->connection_lost = TRUE;
+		server_disconnect(SERVER(server));
+	}
+	return 0;
+}
+
+static void icb_outbuf_reserve(ICB_SERVER_REC *server, int len)
+{
+	if (icb_buffer_grow(&server->outbuf, &server->outbuf_size,
+			    &server->outbuf_high, server->outbuf_pos + len))
+		server->reallocs++;
+	if (server->outbuf_pos + len > server->outbuf_peak)
+		server->outbuf_peak = server->outbuf_pos + len;
+}
 
-		memcpy(server->sendbuf+pos, arg, len);
-		pos += len;
+static void icb_outbuf_commit(ICB_SERVER_REC *server, int len)
+{
+	server->outbuf_pos += len;
+
+	/* everything sent during this main loop run goes out with one
+	   write */
+	if (server->outbuf_tag == -1) {
+		server->outbuf_tag =
+			g_timeout_add(0, (GSourceFunc) icb_flush_output,
+				      server);
 	}
-	va_end(va);
+}
 
-        server->sendbuf[pos++] = '\0';
-	rawlog_output(server->rawlog, (char *) server->sendbuf+1);
+void icb_send_raw(ICB_SERVER_REC *server, const unsigned char *data, int len)
+{
+	icb_outbuf_reserve(server, len);
+	memcpy(server->outbuf + server->outbuf_pos, data, len);
+	icb_outbuf_commit(server, len);
+}
 
-	startpos = 0;
-	while (startpos < pos) {
-		len = pos-startpos-1;
-		if (len > 255) len = 255;
+/* Which send queue lane the packet belongs to. For 'h' packets the
+   first piece must be the command. */
+static int icb_packet_lane(int type, const struct iovec *iov, int count)
+{
+	switch (type) {
+	case 'b':
+		/* open message */
+		return ICB_SENDQ_BULK;
+	case 'h':
+		/* private messages are bulk, other commands interactive */
+		if (count > 0 && iov[0].iov_len == 1 &&
+		    *((const char *) iov[0].iov_base) == 'm')
+			return ICB_SENDQ_BULK;
+		return ICB_SENDQ_INTERACTIVE;
+	default:
+		/* login, pings, pongs, etc. */
+		return ICB_SENDQ_PRIORITY;
+	}
+}
 
-		server->sendbuf[startpos] = len > 255 ? 0 : len;
+/* Write data to frames starting at out. A new frame's length byte is
+   written whenever the previous frame is full. left is the number of
+   payload bytes not yet written. */
+static unsigned char *frame_put(unsigned char *out, int *frame_left,
+				int *left, const void *data, int len)
+{
+	const unsigned char *p = data;
+	int size;
+
+	while (len > 0) {
+		if (*frame_left == 0) {
+			/* full frames have 0 as length byte and 255 bytes
+			   of data, the last one has its real length */
+			*frame_left = *left > 255 ? 255 : *left;
+			*out++ = *left > 255 ? 0 : *left;
+		}
 
-		if (net_sendbuffer_send(server->handle,
-					server->sendbuf+startpos, len+1) == -1) {
-			/* something bad happened */
-			server->connection_lost = TRUE;
-			server_disconnect(SERVER(server));
+		size = len < *frame_left ? len : *frame_left;
+		memcpy(out, p, size);
+		out += size; p += size; len -= size;
+		*frame_left -= size; *left -= size;
+	}
+	return out;
+}
+
+/* Log each frame's payload to rawlog */
+static void icb_rawlog_frames(ICB_SERVER_REC *server, unsigned char *out,
+			      int len)
+{
+	unsigned char *end, saved;
+	int size;
+
+	end = out + len;
+	while (out < end) {
+		size = *out == 0 ? 255 : *out;
+		out++;
+		if (out + size == end) {
+			/* the last frame ends with the packet's \0 */
+			rawlog_output(server->rawlog, (char *) out);
 			break;
 		}
 
-                startpos += 256;
+		saved = out[size];
+		out[size] = '\0';
+		rawlog_output(server->rawlog, (char *) out);
+		out[size] = saved;
+		out += size;
+	}
+}
+
+void icb_send_iov(ICB_SERVER_REC *server, int type,
+		  const struct iovec *iov, int count)
+{
+	unsigned char *start, *out;
+	char typechr;
+	int i, size, left, frame_left, frames, len, lane;
+
+	g_return_if_fail(IS_ICB_SERVER(server));
+
+	/* payload is the type, the pieces and \0 */
+	size = 2;
+	for (i = 0; i < count; i++)
+		size += iov[i].iov_len;
+	frames = size/255 + (size%255 != 0);
+	icb_outbuf_reserve(server, size + frames);
+
+	/* encode straight into the output buffer */
+	start = out = server->outbuf + server->outbuf_pos;
+	left = size; frame_left = 0;
+
+	typechr = type;
+	out = frame_put(out, &frame_left, &left, &typechr, 1);
+	for (i = 0; i < count; i++) {
+		out = frame_put(out, &frame_left, &left,
+				iov[i].iov_base, iov[i].iov_len);
+	}
+	out = frame_put(out, &frame_left, &left, "", 1);
+	len = out - start;
+
+	icb_rawlog_frames(server, start, len);
+
+	server->send_packets++;
+	server->send_frames += frames;
+	i = (unsigned int) (type - PACKET_TYPE_FIRST) < PACKET_TYPES_COUNT ?
+		type - PACKET_TYPE_FIRST : ICB_STATS_TYPES-1;
+	server->type_packets[ICB_STATS_OUT][i]++;
+	server->type_bytes[ICB_STATS_OUT][i] += size-1;
+
+	lane = icb_packet_lane(type, iov, count);
+	if (icb_sendqueue_can_send(server, lane))
+		icb_outbuf_commit(server, len);
+	else
+		icb_sendqueue_add(server, lane, start, len);
+}
+
+static void icb_send_cmd(ICB_SERVER_REC *server, int type, ...)
+{
+	struct iovec iov[ICB_MAX_FIELDS*2];
+        const char *arg;
+	va_list va;
+        int count;
+
+	count = 0;
+	va_start(va, type);
+	while (count < ICB_MAX_FIELDS*2-1 &&
+	       (arg = va_arg(va, const char *)) != NULL) {
+		if (count > 0) {
+			/* separate fields with ^A */
+			iov[count].iov_base = "\001";
+			iov[count++].iov_len = 1;
+		}
+		iov[count].iov_base = (char *) arg;
+		iov[count++].iov_len = strlen(arg);
 	}
+	va_end(va);
+
+	icb_send_iov(server, type, iov, count);
 }
 
 static void icb_login(ICB_SERVER_REC *server)
@@ -151,57 +308,120 @@ void icb_noop(ICB_SERVER_REC *server)
 	icb_send_cmd(server, 'n', NULL);
 }
 
-static void icb_server_event(ICB_SERVER_REC *server, const char *data)
+/* Split the packet to the fields its type has and emit "icb fields <type>"
+   with them as a NULL terminated array. The fields point inside data,
+   which is put back together afterwards for "icb event <type>", which
+   gets the packet's data as a string like it always has. The caller must
+   hold a reference to server. */
+static void icb_server_event(ICB_SERVER_REC *server, char *data, int len)
 {
-	char name[100];
-
-	if (*data < SIGNAL_FIRST || *data >= SIGNAL_FIRST + SIGNALS_COUNT)
+	/* on stack, the handlers may cause another packet to be handled
+	   before they return. +1 for NULL. */
+	char *args[ICB_MAX_FIELDS+1];
+	unsigned int type;
+	int found;
+
+	server->recv_packets++;
+
+	/* anything below 'a' wraps around to a large number */
+	type = (unsigned char) *data - PACKET_TYPE_FIRST;
+	if (type >= PACKET_TYPES_COUNT) {
+		server->type_packets[ICB_STATS_IN][ICB_STATS_TYPES-1]++;
+		server->type_bytes[ICB_STATS_IN][ICB_STATS_TYPES-1] += len;
+		server->recv_malformed++;
 		return; /* unknown packet type */
+	}
+	server->type_packets[ICB_STATS_IN][type]++;
+	server->type_bytes[ICB_STATS_IN][type] += len;
+
+	/* look for only as many separators as the type has fields */
+	found = icb_split_inplace(data+1, args, packet_types[type].max_fields);
+	if (found < packet_types[type].min_fields) {
+		icb_split_restore(args, found);
+		server->recv_malformed++;
+		return;
+	}
+	args[found] = NULL;
+
+        signal_emit_id(fields_signal_ids[type], 2, server, args);
 
-	strcpy(name, "icb event ");
-        strcat(name, signal_names[*data - SIGNAL_FIRST]);
-        signal_emit(name, 2, server, data+1);
+	/* recvbuf is freed if the server got disconnected */
+	if (server->disconnected)
+		return;
+
+	icb_split_restore(args, found);
+	signal_emit_id(event_signal_ids[type], 2, server, data+1);
 }
 
-/* Read one ICB packet. Returns 1 if got it, 0 if not or -1 if disconnected */
-static int icb_read_packet(ICB_SERVER_REC *server, int read_socket)
+/* Make sure there's room for at least ICB_READ_SIZE bytes at the end of
+   recvbuf. The already parsed packets are dropped only when we run out of
+   space, so the unparsed tail is moved at most once per buffer fill instead
+   of after every packet. */
+static void icb_recvbuf_reserve(ICB_SERVER_REC *server)
 {
-	char tmpbuf[512];
-	int ret, pos, wpos, size;
+	int unparsed;
+
+	if (server->recvbuf_size - server->recvbuf_pos >= ICB_READ_SIZE)
+		return;
 
 	if (server->recvbuf_next_packet > 0) {
-                /* remove the last packet from buffer */
+		server->memmoves++;
+		unparsed = server->recvbuf_pos - server->recvbuf_next_packet;
 		g_memmove(server->recvbuf,
 			  server->recvbuf+server->recvbuf_next_packet,
-			  server->recvbuf_pos - server->recvbuf_next_packet);
-                server->recvbuf_pos -= server->recvbuf_next_packet;
-                server->recvbuf_next_packet = 0;
+			  unparsed);
+		server->recvbuf_pos = unparsed;
+		server->recvbuf_next_packet = 0;
 	}
 
-	ret = !read_socket ? 0 :
-		net_receive(net_sendbuffer_handle(server->handle),
-			    tmpbuf, sizeof(tmpbuf));
-	if (ret > 0) {
-		if (server->recvbuf_pos + ret > server->recvbuf_size) {
-			server->recvbuf_size += ret + 256;
-			server->recvbuf = g_realloc(server->recvbuf,
-						    server->recvbuf_size);
+	if (icb_buffer_grow(&server->recvbuf, &server->recvbuf_size,
+			    &server->recvbuf_high,
+			    server->recvbuf_pos + ICB_READ_SIZE))
+		server->reallocs++;
+}
+
+/* Read one ICB packet. Returns 1 if got it, 0 if not or -1 if disconnected.
+   The returned packet points inside recvbuf and is valid until the next
+   call. The number of bytes read from socket is added to read_bytes. */
+static int icb_read_packet(ICB_SERVER_REC *server, int read_socket,
+			   char **packet, int *packet_len, int *read_bytes)
+{
+	unsigned char *buf;
+	int ret, start, pos, wpos, size, complete;
+
+	ret = 0;
+	if (read_socket) {
+		icb_recvbuf_reserve(server);
+		ret = net_receive(net_sendbuffer_handle(server->handle),
+				  (char *) server->recvbuf+server->recvbuf_pos,
+				  server->recvbuf_size-server->recvbuf_pos);
+		if (ret > 0) {
+			if (server->capture != NULL) {
+				icb_capture_add(server, ICB_CAPTURE_READ,
+						server->recvbuf +
+						server->recvbuf_pos, ret);
+			}
+			server->recvbuf_pos += ret;
+			*read_bytes += ret;
+			if (server->recvbuf_pos > server->recvbuf_peak)
+				server->recvbuf_peak = server->recvbuf_pos;
 		}
-		memcpy(server->recvbuf+server->recvbuf_pos, tmpbuf, ret);
-                server->recvbuf_pos += ret;
 	}
 
 	/* check that we have a full packet */
-	pos = 0;
+	buf = server->recvbuf;
+	start = pos = server->recvbuf_next_packet;
+	complete = FALSE;
 	while (pos < server->recvbuf_pos) {
-		if (server->recvbuf[pos] != 0) {
-			pos += server->recvbuf[pos];
+		if (buf[pos] != 0) {
+			pos += buf[pos]+1;
+			complete = pos <= server->recvbuf_pos;
 			break;
 		}
 		pos += 256;
 	}
 
-	if (pos >= server->recvbuf_pos) {
+	if (!complete) {
 		/* nope */
 		if (ret == -1) {
 			/* connection lost */
@@ -212,42 +432,144 @@ static int icb_read_packet(ICB_SERVER_REC *server, int read_socket)
 		return 0;
 	}
 
-	/* we have at least one full packet - combine the 256B blocks
-	   into one big nul-terminated block */
-        pos = wpos = 0;
-	while (pos < server->recvbuf_pos) {
-		if (server->recvbuf[pos] != 0) {
-                        size = server->recvbuf[pos];
-			g_memmove(server->recvbuf+wpos,
-				  server->recvbuf+pos+1, size);
-                        pos += size+1;
+	server->recvbuf_next_packet = pos;
+	if (buf[start] != 0) {
+		/* a single block - return it where it is. Servers end the
+		   packets with \0, the ones that don't are moved over the
+		   length byte to make room for it. */
+		if (buf[pos-1] == '\0') {
+			*packet = (char *) buf+start+1;
+			*packet_len = buf[start]-1;
+		} else {
+			server->memmoves++;
+			g_memmove(buf+start, buf+start+1, buf[start]);
+			buf[pos-1] = '\0';
+			*packet = (char *) buf+start;
+			*packet_len = pos-1-start;
+		}
+		return 1;
+	}
+
+	/* combine the 256B blocks into one big nul-terminated block */
+	server->memmoves++;
+	pos = wpos = start;
+	for (;;) {
+		if (buf[pos] != 0) {
+			size = buf[pos];
+			g_memmove(buf+wpos, buf+pos+1, size);
 			wpos += size;
-                        break;
+			break;
 		}
 
-		g_memmove(server->recvbuf+wpos, server->recvbuf+pos+1, 255);
-                pos += 256;
-                wpos += 255;
+		g_memmove(buf+wpos, buf+pos+1, 255);
+		pos += 256;
+		wpos += 255;
 	}
 
-	server->recvbuf[wpos] = '\0';
-	server->recvbuf_next_packet = pos;
-        return 1;
+	buf[wpos] = '\0';
+	*packet = (char *) buf+start;
+	*packet_len = wpos-start-1; /* the last block had the \0 */
+	return 1;
+}
+
+/* Add value to a histogram where bucket n counts values < 2^(n+1) */
+static void icb_histogram_add(unsigned long *buckets, int count, int value)
+{
+	int bucket;
+
+	bucket = 0;
+	while (value > 1 && bucket < count-1) {
+		value >>= 1;
+		bucket++;
+	}
+	buckets[bucket]++;
 }
 
 static void icb_parse_incoming(ICB_SERVER_REC *server)
 {
-	int count;
+	GTimeVal start, now;
+	char *packet;
+	int ret, read_socket, bytes, prev_bytes, len, usecs;
+
+	g_get_current_time(&start);
+
+	/* keep the server alive even if a handler disconnects it */
+	server_ref(SERVER(server));
+
+	server->wakeups++;
+	bytes = 0; read_socket = TRUE;
+	for (;;) {
+		prev_bytes = bytes;
+		ret = icb_read_packet(server, read_socket, &packet, &len,
+				      &bytes);
+		if (ret <= 0)
+			break;
 
-        count = 0;
-	while (icb_read_packet(server, count < MAX_SOCKET_READS) > 0) {
-		rawlog_input(server->rawlog, (char *) server->recvbuf);
-                icb_server_event(server, (char *) server->recvbuf);
+		/* latency from the socket becoming readable to the packet
+		   being handled */
+		g_get_current_time(&now);
+		usecs = (now.tv_sec - start.tv_sec) * 1000000 +
+			(now.tv_usec - start.tv_usec);
+		icb_histogram_add(server->read_latency,
+				  ICB_LATENCY_BUCKETS, usecs);
 
-		count++;
-		if (g_slist_find(servers, server) == NULL)
-			break; /* disconnected */
+		rawlog_input(server->rawlog, packet);
+                icb_server_event(server, packet, len);
+
+		if (server->disconnected)
+			break;
+
+#ifdef BLOCKING_SOCKETS
+		read_socket = FALSE;
+#else
+		/* keep reading until the socket is drained or we've used
+		   our time/size budget, the rest is handled at next wakeup */
+		if (bytes == prev_bytes || bytes >= read_max_bytes ||
+		    usecs >= read_max_time)
+			read_socket = FALSE;
+#endif
+	}
+
+	if (!server->disconnected) {
+		/* time used for the whole wakeup */
+		g_get_current_time(&now);
+		icb_histogram_add(server->parse_time, ICB_LATENCY_BUCKETS,
+				  (now.tv_sec - start.tv_sec) * 1000000 +
+				  (now.tv_usec - start.tv_usec));
 	}
+	server_unref(SERVER(server));
+}
+
+void icb_protocol_feed(ICB_SERVER_REC *server, const unsigned char *data,
+		       int len)
+{
+	char *packet;
+	int size, packet_len, bytes;
+
+	g_return_if_fail(IS_ICB_SERVER(server));
+
+	server_ref(SERVER(server));
+
+	bytes = 0;
+	while (len > 0 && !server->disconnected) {
+		size = len < ICB_READ_SIZE ? len : ICB_READ_SIZE;
+
+		icb_recvbuf_reserve(server);
+		memcpy(server->recvbuf+server->recvbuf_pos, data, size);
+		server->recvbuf_pos += size;
+		data += size; len -= size;
+
+		while (icb_read_packet(server, FALSE, &packet,
+				       &packet_len, &bytes) > 0) {
+			rawlog_input(server->rawlog, packet);
+			icb_server_event(server, packet, packet_len);
+
+			if (server->disconnected)
+				break;
+		}
+	}
+
+	server_unref(SERVER(server));
 }
 
 static void sig_server_connected(ICB_SERVER_REC *server)
@@ -261,52 +583,141 @@ static void sig_server_connected(ICB_SERVER_REC *server)
 			    (GInputFunction) icb_parse_incoming, server);
 }
 
-static void event_protocol(ICB_SERVER_REC *server, const char *data)
+static void event_protocol(ICB_SERVER_REC *server, char **args)
 {
 	/* ignore parameters - just send the login packet */
         icb_login(server);
 }
 
-static void event_login(ICB_SERVER_REC *server, const char *data)
+static void event_login(ICB_SERVER_REC *server, char **args)
 {
 	/* Login OK */
         server->connected = TRUE;
 	signal_emit("event connected", 1, server);
 }
 
-static void event_ping(ICB_SERVER_REC *server, const char *data)
+static void event_ping(ICB_SERVER_REC *server, char **args)
+{
+        icb_pong(server, args[0]);
+}
+
+/* "icb cmdout <subtype>" signal id, cached per subtype */
+static int cmdout_signal_id(const char *subtype)
+{
+	gpointer key, value;
+	char *name;
+	int id;
+
+	if (g_hash_table_lookup_extended(cmdout_signals, subtype,
+					 &key, &value))
+		return GPOINTER_TO_INT(value);
+
+	name = g_strconcat("icb cmdout ", subtype, NULL);
+	id = signal_get_uniq_id(name);
+	g_free(name);
+
+	g_hash_table_insert(cmdout_signals, g_strdup(subtype),
+			    GINT_TO_POINTER(id));
+	return id;
+}
+
+static void event_cmdout(ICB_SERVER_REC *server, char **args)
+{
+	if (*args[0] == '\0')
+		return;
+
+	if (!signal_emit_id(cmdout_signal_id(args[0]), 2,
+			    server, args+1))
+		signal_emit_id(default_cmdout_signal, 2, server, args);
+}
+
+static int cmdout_signal_free(char *key, void *value, void *user_data)
 {
-        icb_pong(server, data);
+	g_free(key);
+	return TRUE;
 }
 
-static void event_cmdout(ICB_SERVER_REC *server, const char *data)
+/* Let statusbar items and scripts know the statistics may have changed */
+static int sig_stats_timeout(void)
 {
-	char **args, *event;
+	GSList *tmp;
 
-	args = g_strsplit(data, "\001", -1);
-	if (args[0] != NULL) {
-		event = g_strdup_printf("icb cmdout %s", args[0]);
-		if (!signal_emit(event, 2, server, args+1))
-                        signal_emit("default icb cmdout", 2, server, args);
-                g_free(event);
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		ICB_SERVER_REC *server = ICB_SERVER(tmp->data);
+
+		if (server != NULL)
+			signal_emit("icb stats", 1, server);
+	}
+	return 1;
+}
+
+static void read_settings(void)
+{
+	int interval;
+
+	read_max_time = settings_get_int("icb_read_max_time");
+	read_max_bytes = settings_get_int("icb_read_max_bytes");
+
+	interval = settings_get_int("icb_stats_interval");
+	if (interval != stats_interval) {
+		stats_interval = interval;
+		if (stats_tag != -1) {
+			g_source_remove(stats_tag);
+			stats_tag = -1;
+		}
+		if (interval > 0) {
+			stats_tag = g_timeout_add(interval * 1000,
+						  (GSourceFunc) sig_stats_timeout,
+						  NULL);
+		}
 	}
-        g_strfreev(args);
 }
 
 void icb_protocol_init(void)
 {
+	char *name;
+	int i;
+
+	for (i = 0; i < PACKET_TYPES_COUNT; i++) {
+		name = g_strconcat("icb fields ", packet_types[i].name, NULL);
+		fields_signal_ids[i] = signal_get_uniq_id(name);
+		g_free(name);
+
+		name = g_strconcat("icb event ", packet_types[i].name, NULL);
+		event_signal_ids[i] = signal_get_uniq_id(name);
+		g_free(name);
+	}
+
+	cmdout_signals = g_hash_table_new((GHashFunc) g_str_hash,
+					  (GCompareFunc) g_str_equal);
+	default_cmdout_signal = signal_get_uniq_id("default icb cmdout");
+
+	settings_add_int("icb", "icb_read_max_time", 20000);
+	settings_add_int("icb", "icb_read_max_bytes", 16384);
+	settings_add_int("icb", "icb_stats_interval", 10);
+	stats_tag = -1; stats_interval = 0;
+	read_settings();
+
         signal_add("server connected", (SIGNAL_FUNC) sig_server_connected);
-        signal_add("icb event protocol", (SIGNAL_FUNC) event_protocol);
-        signal_add("icb event login", (SIGNAL_FUNC) event_login);
-        signal_add("icb event ping", (SIGNAL_FUNC) event_ping);
-        signal_add("icb event cmdout", (SIGNAL_FUNC) event_cmdout);
+        signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+        signal_add("icb fields protocol", (SIGNAL_FUNC) event_protocol);
+        signal_add("icb fields login", (SIGNAL_FUNC) event_login);
+        signal_add("icb fields ping", (SIGNAL_FUNC) event_ping);
+        signal_add("icb fields cmdout", (SIGNAL_FUNC) event_cmdout);
 }
 
 void icb_protocol_deinit(void)
 {
+	g_hash_table_foreach_remove(cmdout_signals,
+				    (GHRFunc) cmdout_signal_free, NULL);
+	g_hash_table_destroy(cmdout_signals);
+
+	if (stats_tag != -1) g_source_remove(stats_tag);
+
         signal_remove("server connected", (SIGNAL_FUNC) sig_server_connected);
-        signal_remove("icb event protocol", (SIGNAL_FUNC) event_protocol);
-        signal_remove("icb event login", (SIGNAL_FUNC) event_login);
-        signal_remove("icb event ping", (SIGNAL_FUNC) event_ping);
-        signal_remove("icb event cmdout", (SIGNAL_FUNC) event_cmdout);
+        signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+        signal_remove("icb fields protocol", (SIGNAL_FUNC) event_protocol);
+        signal_remove("icb fields login", (SIGNAL_FUNC) event_login);
+        signal_remove("icb fields ping", (SIGNAL_FUNC) event_ping);
+        signal_remove("icb fields cmdout", (SIGNAL_FUNC) event_cmdout);
 }
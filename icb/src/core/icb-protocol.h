@@ -1,8 +1,13 @@
 #ifndef __ICB_PROTOCOL_H
 #define __ICB_PROTOCOL_H
 
+#include <sys/uio.h>
+
 #define ICB_PROTOCOL_LEVEL 1
 
+/* most fields a packet can have, /who's "wl" lines have 9 */
+#define ICB_MAX_FIELDS 16
+
 void icb_send_open_msg(ICB_SERVER_REC *server, const char *text);
 void icb_command(ICB_SERVER_REC *server, const char *cmd,
 		 const char *args, const char *id);
@@ -12,6 +17,19 @@ void icb_ping(ICB_SERVER_REC *server, const char *id);
 void icb_pong(ICB_SERVER_REC *server, const char *id);
 void icb_noop(ICB_SERVER_REC *server);
 
+/* Send packet of given type with the iovec pieces as its data. Fields
+   must be separated with explicit "\001" pieces. The pieces are encoded
+   directly into frames without building the whole packet first. */
+void icb_send_iov(ICB_SERVER_REC *server, int type,
+		  const struct iovec *iov, int count);
+
+/* Send already framed packet data */
+void icb_send_raw(ICB_SERVER_REC *server, const unsigned char *data, int len);
+
+/* Handle data as if it had been read from server's socket */
+void icb_protocol_feed(ICB_SERVER_REC *server, const unsigned char *data,
+		       int len);
+
 void icb_protocol_init(void);
 void icb_protocol_deinit(void);
 
@@ -0,0 +1,317 @@
+/*
+ icb-sendqueue.c : irssi
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "signals.h"
+#include "settings.h"
+#include "expandos.h"
+#include "misc.h"
+
+#include "icb-servers.h"
+#include "icb-protocol.h"
+#include "icb-sendqueue.h"
+
+typedef struct {
+	int lane;
+	int len;
+	unsigned char *data;
+} SENDQUEUE_REC;
+
+static int queue_speed, max_at_once, typed_first;
+
+static void sendqueue_refill(ICB_SERVER_REC *server)
+{
+	GTimeVal now;
+	long msecs, tokens;
+
+	g_get_current_time(&now);
+	msecs = get_timeval_diff(&now, &server->sendq_refill);
+	if (server->sendq_tokens >= max_at_once || msecs < 0) {
+		server->sendq_tokens = max_at_once;
+		server->sendq_refill = now;
+		return;
+	}
+
+	tokens = msecs / queue_speed;
+	if (tokens == 0)
+		return;
+
+	if (server->sendq_tokens + tokens >= max_at_once) {
+		server->sendq_tokens = max_at_once;
+		server->sendq_refill = now;
+	} else {
+		server->sendq_tokens += tokens;
+		msecs = tokens * queue_speed;
+		server->sendq_refill.tv_sec += msecs / 1000;
+		server->sendq_refill.tv_usec += (msecs % 1000) * 1000;
+		if (server->sendq_refill.tv_usec >= 1000000) {
+			server->sendq_refill.tv_usec -= 1000000;
+			server->sendq_refill.tv_sec++;
+		}
+	}
+}
+
+static void sendqueue_update_rate(ICB_SERVER_REC *server, int sent)
+{
+	GTimeVal now;
+	long msecs;
+
+	server->sendq_rate_count += sent;
+
+	g_get_current_time(&now);
+	msecs = get_timeval_diff(&now, &server->sendq_rate_start);
+	if (msecs >= 1000 || msecs < 0) {
+		/* packets per minute during the last second or longer */
+		server->sendq_rate = msecs <= 0 ? 0 :
+			server->sendq_rate_count * 60000 / msecs;
+		server->sendq_rate_count = 0;
+		server->sendq_rate_start = now;
+	}
+}
+
+int icb_sendqueue_can_send(ICB_SERVER_REC *server, int lane)
+{
+	if (lane == ICB_SENDQ_PRIORITY)
+		return TRUE;
+
+	if (server->sendq_depth > 0)
+		return FALSE;
+
+	sendqueue_refill(server);
+	if (server->sendq_tokens <= 0)
+		return FALSE;
+
+	server->sendq_tokens--;
+	return TRUE;
+}
+
+static int sendqueue_drain(ICB_SERVER_REC *server)
+{
+	SENDQUEUE_REC *rec;
+	GSList *link;
+	int lane, sent;
+
+	sendqueue_refill(server);
+
+	sent = 0;
+	for (lane = 0; lane < ICB_SENDQ_LANES; lane++) {
+		while (server->sendq[lane] != NULL &&
+		       server->sendq_tokens > 0) {
+			link = server->sendq[lane];
+			server->sendq[lane] = link->next;
+			if (server->sendq[lane] == NULL)
+				server->sendq_tail[lane] = NULL;
+
+			rec = link->data;
+			g_slist_free_1(link);
+
+			server->sendq_tokens--;
+			server->sendq_depth--;
+			sent++;
+
+			icb_send_raw(server, rec->data, rec->len);
+			g_free(rec->data);
+			g_free(rec);
+		}
+	}
+
+	sendqueue_update_rate(server, sent);
+	if (sent > 0)
+		signal_emit("icb sendqueue changed", 1, server);
+
+	if (server->sendq_depth == 0) {
+		server->sendq_tag = -1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void sendqueue_append(ICB_SERVER_REC *server, SENDQUEUE_REC *rec)
+{
+	GSList *link;
+
+	link = g_slist_append(NULL, rec);
+	if (server->sendq_tail[rec->lane] == NULL)
+		server->sendq[rec->lane] = link;
+	else
+		server->sendq_tail[rec->lane]->next = link;
+	server->sendq_tail[rec->lane] = link;
+
+	if (server->sendq_depth++ == 0) {
+		server->sendq_rate_count = 0;
+		g_get_current_time(&server->sendq_rate_start);
+	}
+
+	if (server->sendq_tag == -1) {
+		server->sendq_tag =
+			g_timeout_add(queue_speed,
+				      (GSourceFunc) sendqueue_drain, server);
+	}
+}
+
+void icb_sendqueue_add(ICB_SERVER_REC *server, int lane,
+		       const unsigned char *data, int len)
+{
+	SENDQUEUE_REC *rec;
+
+	g_return_if_fail(IS_ICB_SERVER(server));
+	g_return_if_fail(lane >= 0 && lane < ICB_SENDQ_LANES);
+
+	/* irssi doesn't tell us if a message was typed or pasted, so we
+	   guess: a paste fills the bulk lane faster than anyone types, so
+	   a message queued while no other one is waiting in the
+	   interactive lane is probably typed and may go ahead of the bulk.
+	   This can reorder a paste, so it can be disabled with
+	   icb_sendq_typed_first. */
+	if (typed_first && lane == ICB_SENDQ_BULK &&
+	    server->sendq[ICB_SENDQ_INTERACTIVE] == NULL)
+		lane = ICB_SENDQ_INTERACTIVE;
+
+	rec = g_new(SENDQUEUE_REC, 1);
+	rec->lane = lane;
+	rec->len = len;
+	rec->data = g_malloc(len);
+	memcpy(rec->data, data, len);
+
+	sendqueue_append(server, rec);
+	signal_emit("icb sendqueue changed", 1, server);
+}
+
+GSList *icb_sendqueue_save(ICB_SERVER_REC *server)
+{
+	GSList *saved;
+	int lane;
+
+	g_return_val_if_fail(IS_ICB_SERVER(server), NULL);
+
+	if (server->sendq_tag != -1) {
+		g_source_remove(server->sendq_tag);
+		server->sendq_tag = -1;
+	}
+
+	saved = NULL;
+	for (lane = 0; lane < ICB_SENDQ_LANES; lane++) {
+		saved = g_slist_concat(saved, server->sendq[lane]);
+		server->sendq[lane] = server->sendq_tail[lane] = NULL;
+	}
+	server->sendq_depth = 0;
+	return saved;
+}
+
+void icb_sendqueue_restore(ICB_SERVER_REC *server, GSList *saved)
+{
+	GSList *tmp;
+
+	g_return_if_fail(IS_ICB_SERVER(server));
+
+	if (saved == NULL)
+		return;
+
+	for (tmp = saved; tmp != NULL; tmp = tmp->next)
+		sendqueue_append(server, tmp->data);
+	g_slist_free(saved);
+
+	signal_emit("icb sendqueue changed", 1, server);
+}
+
+void icb_sendqueue_free_saved(GSList *saved)
+{
+	GSList *tmp;
+	SENDQUEUE_REC *rec;
+
+	for (tmp = saved; tmp != NULL; tmp = tmp->next) {
+		rec = tmp->data;
+		g_free(rec->data);
+		g_free(rec);
+	}
+	g_slist_free(saved);
+}
+
+static void sig_server_disconnected(ICB_SERVER_REC *server)
+{
+	if (!IS_ICB_SERVER(server))
+		return;
+
+	icb_sendqueue_free_saved(icb_sendqueue_save(server));
+}
+
+/* queued packets */
+static char *expando_sendq(SERVER_REC *server, void *item, int *free_ret)
+{
+	ICB_SERVER_REC *icbserver;
+
+	icbserver = ICB_SERVER(server);
+	if (icbserver == NULL || icbserver->sendq_depth == 0)
+		return "";
+
+	*free_ret = TRUE;
+	return g_strdup_printf("%d", icbserver->sendq_depth);
+}
+
+/* queued packets sent per minute */
+static char *expando_sendq_rate(SERVER_REC *server, void *item, int *free_ret)
+{
+	ICB_SERVER_REC *icbserver;
+
+	icbserver = ICB_SERVER(server);
+	if (icbserver == NULL || icbserver->sendq_depth == 0)
+		return "";
+
+	*free_ret = TRUE;
+	return g_strdup_printf("%d", icbserver->sendq_rate);
+}
+
+static void read_settings(void)
+{
+	queue_speed = settings_get_int("icb_cmd_queue_speed");
+	if (queue_speed < 1) queue_speed = 1;
+	max_at_once = settings_get_int("icb_cmds_max_at_once");
+	if (max_at_once < 1) max_at_once = 1;
+	typed_first = settings_get_bool("icb_sendq_typed_first");
+}
+
+void icb_sendqueue_init(void)
+{
+	settings_add_int("flood", "icb_cmd_queue_speed", 1000);
+	settings_add_int("flood", "icb_cmds_max_at_once", 5);
+	settings_add_bool("flood", "icb_sendq_typed_first", TRUE);
+	read_settings();
+
+	expando_create("icb_sendq", expando_sendq,
+		       "window changed", EXPANDO_ARG_NONE,
+		       "window server changed", EXPANDO_ARG_WINDOW,
+		       "icb sendqueue changed", EXPANDO_ARG_SERVER, NULL);
+	expando_create("icb_sendq_rate", expando_sendq_rate,
+		       "window changed", EXPANDO_ARG_NONE,
+		       "window server changed", EXPANDO_ARG_WINDOW,
+		       "icb sendqueue changed", EXPANDO_ARG_SERVER, NULL);
+
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+}
+
+void icb_sendqueue_deinit(void)
+{
+	expando_destroy("icb_sendq", expando_sendq);
+	expando_destroy("icb_sendq_rate", expando_sendq_rate);
+
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+}
@@ -0,0 +1,22 @@
+#ifndef __ICB_SENDQUEUE_H
+#define __ICB_SENDQUEUE_H
+
+/* Returns TRUE if a packet for lane may be sent right away. It's FALSE
+   when older packets are still queued or the flood limit is reached. */
+int icb_sendqueue_can_send(ICB_SERVER_REC *server, int lane);
+
+/* Queue framed packet to be sent later at the flood limited rate */
+void icb_sendqueue_add(ICB_SERVER_REC *server, int lane,
+		       const unsigned char *data, int len);
+
+/* Take all queued packets out of the queue, eg. to keep them over a
+   reconnect. The list is given back with icb_sendqueue_restore(), which
+   queues the packets again in their original lanes and frees the list. */
+GSList *icb_sendqueue_save(ICB_SERVER_REC *server);
+void icb_sendqueue_restore(ICB_SERVER_REC *server, GSList *saved);
+void icb_sendqueue_free_saved(GSList *saved);
+
+void icb_sendqueue_init(void);
+void icb_sendqueue_deinit(void);
+
+#endif
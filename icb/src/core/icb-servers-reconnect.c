@@ -20,8 +20,94 @@
 
 #include "module.h"
 #include "signals.h"
+#include "settings.h"
+#include "servers-reconnect.h"
 
+#include "icb.h"
 #include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-nicklist.h"
+#include "icb-sendqueue.h"
+
+static int backoff_min, backoff_max;
+
+/* After the first reconnect attempt wait a random time below
+   icb_reconnect_backoff seconds, so clients that lost their connection
+   at the same time don't all come back at once. Every failed attempt
+   doubles the delay up to icb_reconnect_backoff_max, of which the last
+   half is again random. Queued reconnects get this delay in place of
+   server_reconnect_time, immediate ones wait for it in lookup_servers. */
+int icb_server_reconnect_delay(ICB_SERVER_CONNECT_REC *conn)
+{
+	int attempt, secs, msecs;
+
+	g_return_val_if_fail(IS_ICB_SERVER_CONNECT(conn), 0);
+
+	if (!conn->reconnection && conn->reconnect_attempts == 0)
+		return 0;
+	if (backoff_min <= 0)
+		return 0;
+
+	attempt = conn->reconnect_attempts++;
+	if (attempt == 0)
+		return rand() % (backoff_min*1000);
+
+	secs = backoff_min;
+	while (attempt-- > 0 && secs < backoff_max)
+		secs *= 2;
+	if (secs > backoff_max)
+		secs = backoff_max;
+
+	msecs = secs*1000;
+	return msecs/2 + rand() % (msecs/2 + 1);
+}
+
+void icb_server_connect_free_saved(ICB_SERVER_CONNECT_REC *conn)
+{
+	GSList *tmp;
+
+	g_return_if_fail(IS_ICB_SERVER_CONNECT(conn));
+
+	for (tmp = conn->saved_nicks; tmp != NULL; tmp = tmp->next) {
+		NICK_REC *rec = tmp->data;
+
+		g_free(rec->nick);
+		g_free_not_null(rec->host);
+		g_free(rec);
+	}
+	g_slist_free(conn->saved_nicks);
+	conn->saved_nicks = NULL;
+
+	g_free_and_null(conn->saved_topic);
+	g_free_and_null(conn->saved_topic_by);
+
+	icb_sendqueue_free_saved(conn->saved_sendq);
+	conn->saved_sendq = NULL;
+}
+
+/* Core has just queued the reconnect of server with its own
+   server_reconnect_time, wait for our backoff delay instead */
+static void sig_reconnect_queued(SERVER_REC *server)
+{
+	GSList *tmp;
+	int delay;
+
+	if (!IS_ICB_SERVER(server))
+		return;
+
+	for (tmp = reconnects; tmp != NULL; tmp = tmp->next) {
+		RECONNECT_REC *rec = tmp->data;
+		ICB_SERVER_CONNECT_REC *conn = ICB_SERVER_CONNECT(rec->conn);
+
+		if (conn == NULL || conn->reconnect_delayed)
+			continue;
+
+		conn->reconnect_delayed = TRUE;
+		delay = icb_server_reconnect_delay(conn);
+		if (delay > 0)
+			rec->next_connect = time(NULL) + (delay+999)/1000;
+	}
+}
 
 static void sig_server_connect_copy(SERVER_CONNECT_REC **dest,
 				    ICB_SERVER_CONNECT_REC *src)
@@ -34,15 +120,117 @@ static void sig_server_connect_copy(SERVER_CONNECT_REC **dest,
 
 	rec = g_new0(ICB_SERVER_CONNECT_REC, 1);
 	rec->chat_type = ICB_PROTOCOL;
+	rec->pool_slot = src->pool_slot;
+	rec->reconnect_attempts = src->reconnect_attempts;
 	*dest = (SERVER_CONNECT_REC *) rec;
 }
 
+/* Core has already saved our group to conn->channels, keep its members,
+   topic and the queued packets too */
+static void sig_save_status(ICB_SERVER_CONNECT_REC *conn,
+			    ICB_SERVER_REC *server)
+{
+	CHANNEL_REC *channel;
+	GSList *nicks, *tmp;
+
+	if (!IS_ICB_SERVER_CONNECT(conn) || !IS_ICB_SERVER(server))
+		return;
+
+	icb_server_connect_free_saved(conn);
+	conn->saved_sendq = icb_sendqueue_save(server);
+
+	channel = CHANNEL(server->group);
+	if (channel == NULL)
+		return;
+
+	conn->saved_topic = g_strdup(channel->topic);
+	conn->saved_topic_by = g_strdup(channel->topic_by);
+	conn->saved_topic_time = channel->topic_time;
+
+	nicks = nicklist_getnicks(channel);
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next) {
+		NICK_REC *nick = tmp->data;
+		NICK_REC *rec;
+
+		if (nick == channel->ownnick)
+			continue;
+
+		rec = g_new0(NICK_REC, 1);
+		rec->nick = g_strdup(nick->nick);
+		rec->host = nick->host == NULL ? NULL : g_strdup(nick->host);
+		rec->op = nick->op;
+		conn->saved_nicks = g_slist_prepend(conn->saved_nicks, rec);
+	}
+	g_slist_free(nicks);
+}
+
+/* Logged in - put the saved state back without waiting for the server */
+static void sig_connected(ICB_SERVER_REC *server)
+{
+	ICB_SERVER_CONNECT_REC *conn;
+	CHANNEL_REC *channel;
+	GSList *tmp;
+
+	if (!IS_ICB_SERVER(server))
+		return;
+
+	conn = server->connrec;
+	conn->reconnect_attempts = 0;
+
+	channel = CHANNEL(server->group);
+	if (channel != NULL) {
+		for (tmp = conn->saved_nicks; tmp != NULL; tmp = tmp->next) {
+			NICK_REC *rec = tmp->data;
+
+			if (nicklist_find(channel, rec->nick) == NULL) {
+				icb_nicklist_insert(server->group, rec->nick,
+						    rec->host, rec->op);
+			}
+		}
+
+		if (conn->saved_topic != NULL && channel->topic == NULL) {
+			channel->topic = conn->saved_topic;
+			channel->topic_by = conn->saved_topic_by;
+			channel->topic_time = conn->saved_topic_time;
+			conn->saved_topic = conn->saved_topic_by = NULL;
+			signal_emit("channel topic changed", 1, channel);
+		}
+	}
+
+	icb_sendqueue_restore(server, conn->saved_sendq);
+	conn->saved_sendq = NULL;
+
+	icb_server_connect_free_saved(conn);
+}
+
+static void read_settings(void)
+{
+	backoff_min = settings_get_int("icb_reconnect_backoff");
+	backoff_max = settings_get_int("icb_reconnect_backoff_max");
+	if (backoff_max > 86400) backoff_max = 86400;
+	if (backoff_max < backoff_min) backoff_max = backoff_min;
+}
+
 void icb_servers_reconnect_init(void)
 {
+	settings_add_int("server", "icb_reconnect_backoff", 5);
+	settings_add_int("server", "icb_reconnect_backoff_max", 600);
+	read_settings();
+
+	signal_add_last("server disconnected", (SIGNAL_FUNC) sig_reconnect_queued);
+	signal_add_last("server connect failed", (SIGNAL_FUNC) sig_reconnect_queued);
 	signal_add("server connect copy", (SIGNAL_FUNC) sig_server_connect_copy);
+	signal_add("server reconnect save status", (SIGNAL_FUNC) sig_save_status);
+	signal_add_last("event connected", (SIGNAL_FUNC) sig_connected);
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 }
 
 void icb_servers_reconnect_deinit(void)
 {
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_reconnect_queued);
+	signal_remove("server connect failed", (SIGNAL_FUNC) sig_reconnect_queued);
 	signal_remove("server connect copy", (SIGNAL_FUNC) sig_server_connect_copy);
+	signal_remove("server reconnect save status", (SIGNAL_FUNC) sig_save_status);
+	signal_remove("event connected", (SIGNAL_FUNC) sig_connected);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 }
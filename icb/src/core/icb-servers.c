@@ -27,6 +27,8 @@
 #include "icb-servers.h"
 #include "icb-channels.h"
 #include "icb-protocol.h"
+#include "icb-buffers.h"
+#include "icb-pool.h"
 
 SERVER_REC *icb_server_init_connect(SERVER_CONNECT_REC *conn)
 {
@@ -39,11 +41,14 @@ SERVER_REC *icb_server_init_connect(SERVER_CONNECT_REC *conn)
 	server = g_new0(ICB_SERVER_REC, 1);
 	server->chat_type = ICB_PROTOCOL;
 
-        server->recvbuf_size = 256;
+        server->recvbuf_size = server->recvbuf_high = ICB_BUFFER_MIN_SIZE;
 	server->recvbuf = g_malloc(server->recvbuf_size);
 
-        server->sendbuf_size = 256;
-	server->sendbuf = g_malloc(server->sendbuf_size);
+        server->outbuf_size = server->outbuf_high = ICB_BUFFER_MIN_SIZE;
+	server->outbuf = g_malloc(server->outbuf_size);
+        server->outbuf_tag = -1;
+        server->sendq_tag = -1;
+        server->group_pending_tag = -1;
 
 	server->connrec = (ICB_SERVER_CONNECT_REC *) conn;
         server_connect_ref(SERVER_CONNECT(conn));
@@ -55,7 +60,7 @@ SERVER_REC *icb_server_init_connect(SERVER_CONNECT_REC *conn)
 	return (SERVER_REC *) server;
 }
 
-void icb_server_connect(SERVER_REC *server)
+static void server_start(SERVER_REC *server)
 {
 	if (!server_start_connect(server)) {
                 server_connect_unref(server->connrec);
@@ -63,11 +68,54 @@ void icb_server_connect(SERVER_REC *server)
 	}
 }
 
+static int server_delayed_start(SERVER_REC *server)
+{
+	lookup_servers = g_slist_remove(lookup_servers, server);
+	server->connect_tag = -1;
+
+	server_start(server);
+	return FALSE;
+}
+
+void icb_server_connect(SERVER_REC *server)
+{
+	ICB_SERVER_CONNECT_REC *conn;
+	int delay;
+
+	conn = ICB_SERVER(server)->connrec;
+	delay = conn->reconnect_delayed ? 0 :
+		icb_server_reconnect_delay(conn);
+	if (delay > 0) {
+		/* wait in lookup_servers, so /DISCONNECT can cancel us
+		   like any other connect in progress */
+		server->connect_tag =
+			g_timeout_add(delay, (GSourceFunc) server_delayed_start,
+				      server);
+		lookup_servers = g_slist_append(lookup_servers, server);
+		return;
+	}
+
+	server_start(server);
+}
+
+static void server_free_buffers(ICB_SERVER_REC *server)
+{
+	g_free_and_null(server->recvbuf);
+	g_free_and_null(server->outbuf);
+	g_free_and_null(server->group_pending);
+	g_free_and_null(server->who_group);
+}
+
 static void sig_server_disconnected(ICB_SERVER_REC *server)
 {
 	if (!IS_ICB_SERVER(server))
 		return;
 
+	if (server->outbuf_tag != -1) {
+		g_source_remove(server->outbuf_tag);
+		server->outbuf_tag = -1;
+	}
+
 	if (server->handle != NULL) {
 		/* disconnect it here, so the core won't try to leave it
 		   later - ICB has no quit messages so it doesn't really
@@ -76,21 +124,28 @@ static void sig_server_disconnected(ICB_SERVER_REC *server)
 		server->handle = NULL;
 	}
 
-        g_free(server->recvbuf);
-        g_free(server->sendbuf);
+	server_free_buffers(server);
+}
+
+static void sig_server_connect_failed(ICB_SERVER_REC *server)
+{
+	if (IS_ICB_SERVER(server))
+		server_free_buffers(server);
 }
 
 char *icb_server_get_channels(ICB_SERVER_REC *server)
 {
 	g_return_val_if_fail(IS_ICB_SERVER(server), FALSE);
 
-	return g_strdup(server->group->name);
+	/* the group window may have been closed, we're still in the group */
+	return g_strdup(server->group != NULL ? server->group->name :
+			server->connrec->channels);
 }
 
 static void channels_join(SERVER_REC *server, const char *channel,
 			  int automatic)
 {
-	icb_change_channel(ICB_SERVER(server), channel, automatic);
+	icb_pool_join(ICB_SERVER(server), channel, automatic);
 }
 
 static int isnickflag_func(char flag)
@@ -100,7 +155,10 @@ static int isnickflag_func(char flag)
 
 static int ischannel_func(SERVER_REC *server, const char *data)
 {
-        return g_strcasecmp(ICB_SERVER(server)->group->name, data) == 0;
+	ICB_SERVER_REC *icbserver = ICB_SERVER(server);
+
+	return icbserver->group != NULL &&
+		g_strcasecmp(icbserver->group->name, data) == 0;
 }
 
 static const char *get_nick_flags(void)
@@ -113,7 +171,7 @@ static void send_message(SERVER_REC *server, const char *target,
 			 const char *msg, int target_type)
 {
 	ICB_SERVER_REC *icbserver;
-        char *str;
+	struct iovec iov[5];
 
         icbserver = ICB_SERVER(server);
 	g_return_if_fail(server != NULL);
@@ -122,12 +180,17 @@ static void send_message(SERVER_REC *server, const char *target,
 
 	if (target_type == SEND_TARGET_CHANNEL) {
 		/* channel message */
+		icbserver->pool_last_used = time(NULL);
                 icb_send_open_msg(icbserver, msg);
 	} else {
-		/* private message */
-                str = g_strconcat(target, " ", msg, NULL);
-		icb_command(icbserver, "m", str, NULL);
-                g_free(str);
+		/* private message: "m" ^A "<target> <msg>" */
+		iov[0].iov_base = "m"; iov[0].iov_len = 1;
+		iov[1].iov_base = "\001"; iov[1].iov_len = 1;
+		iov[2].iov_base = (char *) target;
+		iov[2].iov_len = strlen(target);
+		iov[3].iov_base = " "; iov[3].iov_len = 1;
+		iov[4].iov_base = (char *) msg; iov[4].iov_len = strlen(msg);
+		icb_send_iov(icbserver, 'h', iov, 5);
 	}
 }
 
@@ -141,6 +204,7 @@ static void sig_connected(ICB_SERVER_REC *server)
 	server->ischannel = ischannel_func;
 	server->get_nick_flags = get_nick_flags;
 	server->send_message = send_message;
+	server->pool_last_used = time(NULL);
 }
 
 static void sig_setup_fill_connect(ICB_SERVER_CONNECT_REC *conn)
@@ -175,12 +239,37 @@ void icb_servers_init(void)
 {
 	signal_add_first("server connected", (SIGNAL_FUNC) sig_connected);
         signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_add("server connect failed", (SIGNAL_FUNC) sig_server_connect_failed);
 	signal_add("server setup fill connect", (SIGNAL_FUNC) sig_setup_fill_connect);
 }
 
 void icb_servers_deinit(void)
 {
+	GSList *tmp, *next;
+
+	/* cancel the connects still in progress (or waiting for their
+	   reconnect delay) and disconnect the servers while our handlers
+	   can free them and remove their timeouts. "chat protocol deinit"
+	   comes only after all the handlers are gone. */
+	for (tmp = lookup_servers; tmp != NULL; tmp = next) {
+		SERVER_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (IS_ICB_SERVER(rec))
+			server_disconnect(rec);
+	}
+
+	for (tmp = servers; tmp != NULL; tmp = next) {
+		SERVER_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (IS_ICB_SERVER(rec))
+			server_disconnect(rec);
+	}
+
 	signal_remove("server connected", (SIGNAL_FUNC) sig_connected);
         signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
+	signal_remove("server connect failed", (SIGNAL_FUNC) sig_server_connect_failed);
 	signal_remove("server setup fill connect", (SIGNAL_FUNC) sig_setup_fill_connect);
+
 }
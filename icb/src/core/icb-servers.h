@@ -18,8 +18,42 @@
 #define IS_ICB_SERVER_CONNECT(conn) \
 	(ICB_SERVER_CONNECT(conn) ? TRUE : FALSE)
 
+/* read latency histogram: bucket n counts packets handled within
+   2^(n+1) usecs of their wakeup, the last one everything slower */
+#define ICB_LATENCY_BUCKETS 16
+
+/* per packet type statistics for types 'a'..'m', the last one counts
+   unknown types */
+#define ICB_STATS_TYPES 14
+#define ICB_STATS_IN 0
+#define ICB_STATS_OUT 1
+
+/* lag jitter histogram: bucket n counts lag replies within 2^(n+1) msecs
+   of the average lag */
+#define ICB_LAG_JITTER_BUCKETS 12
+
+/* outgoing queue lanes, see icb-sendqueue.c */
+enum {
+	ICB_SENDQ_PRIORITY, /* pings, pongs, login - never queued */
+	ICB_SENDQ_INTERACTIVE, /* commands and typed messages */
+	ICB_SENDQ_BULK, /* pasted messages */
+
+	ICB_SENDQ_LANES
+};
+
 struct _ICB_SERVER_CONNECT_REC {
 #include "server-connect-rec.h"
+
+	int pool_slot; /* 0 = main connection, see icb-pool.c */
+
+	/* group state kept over a reconnect, see icb-servers-reconnect.c */
+	GSList *saved_nicks; /* NICK_RECs */
+	char *saved_topic, *saved_topic_by;
+	time_t saved_topic_time;
+	GSList *saved_sendq;
+	int reconnect_attempts; /* failed reconnects since the last login */
+	/* the backoff delay was already applied to the core's reconnect */
+	unsigned int reconnect_delayed:1;
 };
 
 #define STRUCT_SERVER_CONNECT_REC ICB_SERVER_CONNECT_REC
@@ -27,13 +61,50 @@ struct _ICB_SERVER_REC {
 #include "server-rec.h"
 
         ICB_CHANNEL_REC *group; /* ICB server can have only one channel active - and it's called group. */
+	char *group_pending; /* /G sent but not yet confirmed by server */
+	int group_pending_tag; /* forgets group_pending if never confirmed */
+	char *who_group; /* group of the /WHO lines being received */
+	time_t pool_last_used;
+
+	/* framed packets waiting to be written at the end of this main
+	   loop run */
+	unsigned char *outbuf;
+	int outbuf_size, outbuf_pos;
+	int outbuf_tag;
 
-	unsigned char *sendbuf;
-	int sendbuf_size;
+	/* flood limited outgoing queue */
+	GSList *sendq[ICB_SENDQ_LANES], *sendq_tail[ICB_SENDQ_LANES];
+	int sendq_depth, sendq_tag;
+	int sendq_tokens;
+	GTimeVal sendq_refill;
+	int sendq_rate, sendq_rate_count; /* packets/min */
+	GTimeVal sendq_rate_start;
 
 	unsigned char *recvbuf;
 	int recvbuf_size, recvbuf_pos;
         int recvbuf_next_packet;
+
+	ICB_CAPTURE_REC *capture; /* binary traffic capture, see icb-capture.c */
+
+	/* statistics */
+	unsigned long recv_packets, recv_malformed;
+	unsigned long send_packets, send_frames, send_writes;
+	unsigned long type_packets[2][ICB_STATS_TYPES];
+	unsigned long type_bytes[2][ICB_STATS_TYPES];
+	unsigned long reallocs, memmoves, wakeups;
+	unsigned long read_latency[ICB_LATENCY_BUCKETS];
+	/* usecs used for handling each wakeup */
+	unsigned long parse_time[ICB_LATENCY_BUCKETS];
+	int lag_avg; /* moving average of lag, msecs */
+	/* lag_pong_seen: server has answered a ping, so lag is enforced.
+	   lag_no_pongs: server didn't answer, send noops instead */
+	unsigned int lag_pong_seen:1;
+	unsigned int lag_no_pongs:1;
+	unsigned long lag_jitter[ICB_LAG_JITTER_BUCKETS];
+	/* largest buffer sizes ever reached */
+	int outbuf_high, recvbuf_high;
+	/* most of each buffer used since the last shrink check */
+	int outbuf_peak, recvbuf_peak;
 };
 
 SERVER_REC *icb_server_init_connect(SERVER_CONNECT_REC *conn);
@@ -41,6 +112,11 @@ void icb_server_connect(SERVER_REC *server);
 
 char *icb_server_get_channels(ICB_SERVER_REC *server);
 
+/* Returns how many msecs to wait before connecting, 0 if it isn't a
+   reconnect */
+int icb_server_reconnect_delay(ICB_SERVER_CONNECT_REC *conn);
+void icb_server_connect_free_saved(ICB_SERVER_CONNECT_REC *conn);
+
 void icb_servers_init(void);
 void icb_servers_deinit(void);
 
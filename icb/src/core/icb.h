@@ -6,10 +6,19 @@
 typedef struct _ICB_SERVER_CONNECT_REC ICB_SERVER_CONNECT_REC;
 typedef struct _ICB_SERVER_REC ICB_SERVER_REC;
 typedef struct _ICB_CHANNEL_REC ICB_CHANNEL_REC;
+typedef struct _ICB_CAPTURE_REC ICB_CAPTURE_REC;
 
 #define ICB_PROTOCOL (chat_protocol_lookup("ICB"))
 
 char **icb_split(const char *data, int count);
 void icb_split_free(char **args);
 
+/* Split data to count fields in place without allocating any memory:
+   the ^A separators are replaced with \0 and args[] point inside data.
+   Missing fields are set to "". Returns the number of fields found, which
+   must be given to icb_split_restore() to put the separators back before
+   data is used again. */
+int icb_split_inplace(char *data, char **args, int count);
+void icb_split_restore(char **args, int found);
+
 #endif
@@ -28,60 +28,73 @@
 #include "icb.h"
 #include "icb-servers.h"
 #include "icb-channels.h"
+#include "icb-commands.h"
 #include "icb-protocol.h"
+#include "icb-capture.h"
 
 #include "printtext.h"
 #include "themes.h"
+#include "fe-windows.h"
+#include "window-items.h"
 
-static void event_status(ICB_SERVER_REC *server, const char *data)
+/* The fields point to recvbuf, which is freed if an earlier handler
+   disconnected us */
+
+/* The group window may have been closed, its messages go to the server
+   window then */
+static const char *group_target(ICB_SERVER_REC *server)
+{
+	return server->group == NULL ? NULL : server->group->name;
+}
+
+static void event_status(ICB_SERVER_REC *server, char **args)
 {
-	char **args;
+	if (server->disconnected)
+		return;
 
-	/* FIXME: status messages should probably divided into their own
-	   signals so irssi could track joins, parts, etc. */
-	args = icb_split(data, 2);
-	printformat(server, server->group->name, MSGLEVEL_CRAP,
+	/* joins, parts and nick changes are tracked in icb-nicklist.c */
+	printformat(server, group_target(server), MSGLEVEL_CRAP,
 		    ICBTXT_STATUS, args[0], args[1]);
-        icb_split_free(args);
 }
 
-static void event_error(ICB_SERVER_REC *server, const char *data)
+static void event_error(ICB_SERVER_REC *server, char **args)
 {
-	printformat(server, NULL, MSGLEVEL_CRAP, ICBTXT_ERROR, data);
+	if (!server->disconnected)
+		printformat(server, NULL, MSGLEVEL_CRAP, ICBTXT_ERROR, args[0]);
 }
 
-static void event_important(ICB_SERVER_REC *server, const char *data)
+static void event_important(ICB_SERVER_REC *server, char **args)
 {
-	char **args;
+	if (server->disconnected)
+		return;
 
-	args = icb_split(data, 2);
 	printformat(server, NULL, MSGLEVEL_CRAP, ICBTXT_IMPORTANT,
 		    args[0], args[1]);
-        icb_split_free(args);
 }
 
-static void event_beep(ICB_SERVER_REC *server, const char *data)
+static void event_beep(ICB_SERVER_REC *server, char **args)
 {
-	printformat(server, data, MSGLEVEL_CRAP, ICBTXT_BEEP, data);
+	if (!server->disconnected) {
+		printformat(server, args[0], MSGLEVEL_CRAP,
+			    ICBTXT_BEEP, args[0]);
+	}
 }
 
-static void event_open(ICB_SERVER_REC *server, const char *data)
+static void event_open(ICB_SERVER_REC *server, char **args)
 {
-	char **args;
+	if (server->disconnected)
+		return;
 
-	args = icb_split(data, 2);
+	/* with the group window closed this goes to the server window */
 	signal_emit("message public", 5, server, args[1], args[0], "",
-		    server->group->name);
-        icb_split_free(args);
+		    server->group != NULL ? server->group->name :
+		    server->connrec->channels);
 }
 
-static void event_personal(ICB_SERVER_REC *server, const char *data)
+static void event_personal(ICB_SERVER_REC *server, char **args)
 {
-	char **args;
-
-	args = icb_split(data, 2);
-	signal_emit("message private", 4, server, args[1], args[0], "");
-        icb_split_free(args);
+	if (!server->disconnected)
+		signal_emit("message private", 4, server, args[1], args[0], "");
 }
 
 static void cmdout_default(ICB_SERVER_REC *server, char **args)
@@ -89,10 +102,154 @@ static void cmdout_default(ICB_SERVER_REC *server, char **args)
 	char *data;
 
 	data = g_strjoinv(" ", args+1);
-	printtext(server, server->group->name, MSGLEVEL_CRAP, "%s", data);
+	printtext(server, group_target(server), MSGLEVEL_CRAP, "%s", data);
         g_free(data);
 }
 
+/* Append non-empty buckets of a 2^(n+1) histogram to str */
+static void histogram_append(GString *str, unsigned long *buckets,
+			     int count, const char *unit)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (buckets[i] == 0)
+			continue;
+
+		if (i == count-1) {
+			g_string_sprintfa(str, "%s>=%d%s:%lu",
+					  str->len == 0 ? "" : " ", 1 << i,
+					  unit, buckets[i]);
+		} else {
+			g_string_sprintfa(str, "%s<%d%s:%lu",
+					  str->len == 0 ? "" : " ", 2 << i,
+					  unit, buckets[i]);
+		}
+	}
+}
+
+/* SYNTAX: ICB STATS */
+static void cmd_icb_stats(const char *data, ICB_SERVER_REC *server)
+{
+	GString *str;
+	char type[2];
+	int i;
+
+	CMD_ICB_SERVER(server);
+
+	type[1] = '\0';
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_SEND,
+		    server->tag, server->send_packets, server->send_frames,
+		    server->send_writes,
+		    server->send_frames - server->send_writes);
+
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_RECV,
+		    server->tag, server->recv_packets, server->recv_malformed);
+
+	str = g_string_new(NULL);
+	histogram_append(str, server->read_latency, ICB_LATENCY_BUCKETS, "us");
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_LATENCY,
+		    server->tag, str->str);
+
+	g_string_truncate(str, 0);
+	histogram_append(str, server->parse_time, ICB_LATENCY_BUCKETS, "us");
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_PARSE,
+		    server->tag, server->wakeups, server->reallocs,
+		    server->memmoves, str->str);
+
+	for (i = 0; i < ICB_STATS_TYPES; i++) {
+		if (server->type_packets[ICB_STATS_IN][i] == 0 &&
+		    server->type_packets[ICB_STATS_OUT][i] == 0)
+			continue;
+
+		type[0] = i == ICB_STATS_TYPES-1 ? '?' : 'a'+i;
+		printformat(server, NULL, MSGLEVEL_CLIENTCRAP,
+			    ICBTXT_STATS_TYPE, server->tag, type,
+			    server->type_packets[ICB_STATS_IN][i],
+			    server->type_bytes[ICB_STATS_IN][i],
+			    server->type_packets[ICB_STATS_OUT][i],
+			    server->type_bytes[ICB_STATS_OUT][i]);
+	}
+
+	g_string_truncate(str, 0);
+	histogram_append(str, server->lag_jitter, ICB_LAG_JITTER_BUCKETS, "ms");
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_LAG,
+		    server->tag, server->lag, server->lag_avg, str->str);
+
+	printformat(server, NULL, MSGLEVEL_CLIENTCRAP, ICBTXT_STATS_BUFFERS,
+		    server->tag, server->outbuf_size, server->outbuf_high,
+		    server->recvbuf_size, server->recvbuf_high);
+	g_string_free(str, TRUE);
+}
+
+/* SYNTAX: ICB CAPTURE [<file>] */
+static void cmd_icb_capture(const char *data, ICB_SERVER_REC *server)
+{
+	CMD_ICB_SERVER(server);
+
+	if (*data == '\0') {
+		if (server->capture != NULL) {
+			icb_capture_stop(server);
+			printformat(server, NULL, MSGLEVEL_CLIENTNOTICE,
+				    ICBTXT_CAPTURE_STOPPED, server->tag);
+		}
+		return;
+	}
+
+	if (!icb_capture_start(server, data)) {
+		printformat(server, NULL, MSGLEVEL_CLIENTERROR,
+			    ICBTXT_CAPTURE_ERROR, data, g_strerror(errno));
+		return;
+	}
+	printformat(server, NULL, MSGLEVEL_CLIENTNOTICE,
+		    ICBTXT_CAPTURE_STARTED, server->tag, data);
+}
+
+/* SYNTAX: ICB REPLAY [-fast] <file> */
+static void cmd_icb_replay(const char *data, ICB_SERVER_REC *server)
+{
+	GHashTable *optlist;
+	char *path;
+	void *free_arg;
+
+	CMD_ICB_SERVER(server);
+
+	if (!cmd_get_params(data, &free_arg, 1 | PARAM_FLAG_OPTIONS,
+			    "icb replay", &optlist, &path))
+		return;
+	if (*path == '\0') cmd_param_error(CMDERR_NOT_ENOUGH_PARAMS);
+
+	if (!icb_replay_start(server, path,
+			      g_hash_table_lookup(optlist, "fast") != NULL)) {
+		printformat(server, NULL, MSGLEVEL_CLIENTERROR,
+			    ICBTXT_CAPTURE_ERROR, path, g_strerror(errno));
+	}
+	cmd_params_free(free_arg);
+}
+
+static void sig_replay_finished(ICB_SERVER_REC *server, void *bytes,
+				void *msecs)
+{
+	printformat(server, NULL, MSGLEVEL_CLIENTNOTICE,
+		    ICBTXT_REPLAY_FINISHED, server->tag,
+		    GPOINTER_TO_INT(bytes), GPOINTER_TO_INT(msecs));
+}
+
+/* group was revisited using a pooled connection - show it */
+static void sig_pool_reuse(ICB_SERVER_REC *server, ICB_CHANNEL_REC *group)
+{
+	WINDOW_REC *window;
+
+	if (group == NULL)
+		return;
+
+	window = window_item_window((WI_ITEM_REC *) group);
+	if (window != NULL) {
+		window_set_active(window);
+		window_item_set_active(window, (WI_ITEM_REC *) group);
+	}
+}
+
 static void sig_server_add_fill(SERVER_SETUP_REC *rec,
 				GHashTable *optlist)
 {
@@ -109,14 +266,21 @@ void fe_icb_init(void)
 {
 	theme_register(fecommon_icb_formats);
 
-	signal_add("icb event status", (SIGNAL_FUNC) event_status);
-        signal_add("icb event error", (SIGNAL_FUNC) event_error);
-        signal_add("icb event important", (SIGNAL_FUNC) event_important);
-        signal_add("icb event beep", (SIGNAL_FUNC) event_beep);
-        signal_add("icb event open", (SIGNAL_FUNC) event_open);
-        signal_add("icb event personal", (SIGNAL_FUNC) event_personal);
+	signal_add("icb fields status", (SIGNAL_FUNC) event_status);
+        signal_add("icb fields error", (SIGNAL_FUNC) event_error);
+        signal_add("icb fields important", (SIGNAL_FUNC) event_important);
+        signal_add("icb fields beep", (SIGNAL_FUNC) event_beep);
+        signal_add("icb fields open", (SIGNAL_FUNC) event_open);
+        signal_add("icb fields personal", (SIGNAL_FUNC) event_personal);
         signal_add("default icb cmdout", (SIGNAL_FUNC) cmdout_default);
 
+	command_bind_icb("icb stats", NULL, (SIGNAL_FUNC) cmd_icb_stats);
+	command_bind_icb("icb capture", NULL, (SIGNAL_FUNC) cmd_icb_capture);
+	command_bind_icb("icb replay", NULL, (SIGNAL_FUNC) cmd_icb_replay);
+	command_set_options("icb replay", "fast");
+
+	signal_add("icb replay finished", (SIGNAL_FUNC) sig_replay_finished);
+	signal_add("icb pool reuse", (SIGNAL_FUNC) sig_pool_reuse);
 	signal_add("server add fill", (SIGNAL_FUNC) sig_server_add_fill);
 	command_set_options("server add", "-icbnet");
 
@@ -125,13 +289,19 @@ void fe_icb_init(void)
 
 void fe_icb_deinit(void)
 {
-        signal_remove("icb event status", (SIGNAL_FUNC) event_status);
-        signal_remove("icb event error", (SIGNAL_FUNC) event_error);
-        signal_remove("icb event important", (SIGNAL_FUNC) event_important);
-        signal_remove("icb event beep", (SIGNAL_FUNC) event_beep);
-        signal_remove("icb event open", (SIGNAL_FUNC) event_open);
-        signal_remove("icb event personal", (SIGNAL_FUNC) event_personal);
+        signal_remove("icb fields status", (SIGNAL_FUNC) event_status);
+        signal_remove("icb fields error", (SIGNAL_FUNC) event_error);
+        signal_remove("icb fields important", (SIGNAL_FUNC) event_important);
+        signal_remove("icb fields beep", (SIGNAL_FUNC) event_beep);
+        signal_remove("icb fields open", (SIGNAL_FUNC) event_open);
+        signal_remove("icb fields personal", (SIGNAL_FUNC) event_personal);
         signal_remove("default icb cmdout", (SIGNAL_FUNC) cmdout_default);
 
+	command_unbind("icb stats", (SIGNAL_FUNC) cmd_icb_stats);
+	command_unbind("icb capture", (SIGNAL_FUNC) cmd_icb_capture);
+	command_unbind("icb replay", (SIGNAL_FUNC) cmd_icb_replay);
+
+	signal_remove("icb replay finished", (SIGNAL_FUNC) sig_replay_finished);
+	signal_remove("icb pool reuse", (SIGNAL_FUNC) sig_pool_reuse);
 	signal_remove("server add fill", (SIGNAL_FUNC) sig_server_add_fill);
 }
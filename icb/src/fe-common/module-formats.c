@@ -32,5 +32,20 @@ FORMAT_REC fecommon_icb_formats[] = {
 	{ "status", "{error [Error]} $0", 1, { 0 } },
 	{ "beep", "[beep] $0 beeps you", 1, { 0 } },
 
+	/* ---- */
+	{ NULL, "Statistics", 0 },
+
+	{ "stats_send", "$0: sent $1 packets in $2 frames with $3 writes ($4 writes saved)", 5, { 0, 2, 2, 2, 2 } },
+	{ "stats_recv", "$0: received $1 packets, $2 unknown or malformed", 3, { 0, 2, 2 } },
+	{ "stats_latency", "$0: read latency $1", 2, { 0, 0 } },
+	{ "stats_parse", "$0: $1 wakeups, $2 reallocs, $3 memmoves, time per wakeup $4", 5, { 0, 2, 2, 2, 0 } },
+	{ "stats_type", "$0: type $1 in $2 packets/$3 bytes, out $4 packets/$5 bytes", 6, { 0, 0, 2, 2, 2, 2 } },
+	{ "stats_lag", "$0: lag $1 msecs (average $2), jitter $3", 4, { 0, 1, 1, 0 } },
+	{ "capture_started", "$0: capturing traffic to $1", 2, { 0, 0 } },
+	{ "capture_stopped", "$0: traffic capture stopped", 1, { 0 } },
+	{ "capture_error", "{error Can't open $0: $1}", 2, { 0, 0 } },
+	{ "replay_finished", "$0: replayed $1 bytes in $2 msecs", 3, { 0, 1, 1 } },
+	{ "stats_buffers", "$0: buffers out $1 (max $2), recv $3 (max $4) bytes", 5, { 0, 1, 1, 1, 1 } },
+
 	{ NULL, NULL, 0 }
 };
@@ -8,7 +8,21 @@ enum {
 	ICBTXT_STATUS,
 	ICBTXT_IMPORTANT,
 	ICBTXT_ERROR,
-	ICBTXT_BEEP
+	ICBTXT_BEEP,
+
+	ICBTXT_FILL_2,
+
+	ICBTXT_STATS_SEND,
+	ICBTXT_STATS_RECV,
+	ICBTXT_STATS_LATENCY,
+	ICBTXT_STATS_PARSE,
+	ICBTXT_STATS_TYPE,
+	ICBTXT_STATS_LAG,
+	ICBTXT_CAPTURE_STARTED,
+	ICBTXT_CAPTURE_STOPPED,
+	ICBTXT_CAPTURE_ERROR,
+	ICBTXT_REPLAY_FINISHED,
+	ICBTXT_STATS_BUFFERS
 };
 
 extern FORMAT_REC fecommon_icb_formats[];
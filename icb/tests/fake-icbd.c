@@ -0,0 +1,479 @@
+/*
+ fake-icbd.c : scripted stand-in for an ICB server, used by the tests
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Listens at 127.0.0.1 in a random port, prints the port number and then
+   runs the script given in the command line against the first client
+   that connects:
+
+     login <group>     wait for the client's login packet, accept it and
+                       put the client to group
+     open <n> [<len>]  send n open messages, each with len bytes of text
+     personal <n>      send n personal messages
+     who <n>           send /who listing of a group with n users
+     members           send joins, parts and a nick change, see do_members()
+     recv <n>          wait until the client has sent n open messages
+     echo <n>          send the client's next n open messages back to it
+     ping <id>         ping the client
+     fuzz <n> <seed>   send n frames of random garbage
+     serve <msecs>     only answer the client for msecs
+     accept            close the connection and wait for the next client
+     close             close the connection and exit
+
+   Each step that sends something ends with a status packet
+   "Done" ^A <step>, so the client knows when the step is finished. While
+   waiting for the client, pings are answered and /g group changes are
+   accepted, except to groups beginning with "deny". After the script the
+   client is served until it disconnects. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_PACKET 65536
+
+static int listen_fd, fd = -1;
+static int client_opens; /* open messages received from client */
+static int echo_left; /* open messages to be echoed back */
+static char group[256] = "1";
+
+static void fatal(const char *msg)
+{
+	fprintf(stderr, "fake-icbd: %s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void send_all(const unsigned char *data, int len)
+{
+	int ret;
+
+	while (len > 0) {
+		ret = write(fd, data, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			/* client went away, the rest of the script can't
+			   be run */
+			exit(0);
+		}
+		data += ret; len -= ret;
+	}
+}
+
+/* Send a packet of given type, fields separated with ^A in data */
+static void send_packet(int type, const char *data)
+{
+	static unsigned char buf[MAX_PACKET*2 + MAX_PACKET*2/255 + 16];
+	unsigned char *out;
+	int len, size, pos;
+
+	/* payload is type, data and \0 */
+	len = strlen(data) + 2;
+	out = buf; pos = 0;
+	while (len - pos > 255) {
+		*out++ = 0;
+		for (size = 0; size < 255; size++, pos++)
+			*out++ = pos == 0 ? type : data[pos-1];
+	}
+	*out++ = len - pos;
+	for (; pos < len; pos++)
+		*out++ = pos == 0 ? type : pos == len-1 ? '\0' : data[pos-1];
+	send_all(buf, out - buf);
+}
+
+static void send_fields(int type, const char *f1, const char *f2)
+{
+	static char buf[MAX_PACKET*2];
+	int len;
+
+	len = strlen(f1);
+	memcpy(buf, f1, len);
+	if (f2 != NULL) {
+		buf[len++] = '\001';
+		strcpy(buf+len, f2);
+	} else {
+		buf[len] = '\0';
+	}
+	send_packet(type, buf);
+}
+
+static void send_done(const char *step)
+{
+	send_fields('d', "Done", step);
+}
+
+static int read_all(unsigned char *buf, int len)
+{
+	int ret;
+
+	while (len > 0) {
+		ret = read(fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return 0;
+		buf += ret; len -= ret;
+	}
+	return 1;
+}
+
+/* Read one packet, returns its length or -1 if the client disconnected.
+   The packet is \0 terminated and begins with the type. */
+static int read_packet(unsigned char *buf)
+{
+	unsigned char lenbyte;
+	int len, size;
+
+	len = 0;
+	for (;;) {
+		if (!read_all(&lenbyte, 1))
+			return -1;
+		size = lenbyte == 0 ? 255 : lenbyte;
+		if (len + size >= MAX_PACKET) {
+			errno = EMSGSIZE;
+			fatal("too large packet from client");
+		}
+		if (!read_all(buf+len, size))
+			return -1;
+		len += size;
+		if (lenbyte != 0)
+			break;
+	}
+
+	buf[len] = '\0';
+	return len;
+}
+
+static void send_group_status(void)
+{
+	static char buf[512];
+
+	snprintf(buf, sizeof(buf), "Status\001You are now in group %s",
+		 group);
+	send_packet('d', buf);
+}
+
+/* Handle one packet from client, returns -1 if it disconnected */
+static int handle_client(void)
+{
+	static unsigned char buf[MAX_PACKET];
+	char *data, *p;
+
+	if (read_packet(buf) < 0)
+		return -1;
+
+	data = (char *) buf+1;
+	switch (buf[0]) {
+	case 'b':
+		client_opens++;
+		if (echo_left > 0) {
+			echo_left--;
+			send_fields('b', "echo", data);
+		}
+		break;
+	case 'h':
+		if (strncmp(data, "g\001", 2) == 0) {
+			p = data+2;
+			if (strncmp(p, "deny", 4) == 0) {
+				send_fields('e', "Permission denied", NULL);
+				break;
+			}
+			snprintf(group, sizeof(group), "%.*s",
+				 (int) sizeof(group)-1, p);
+			send_group_status();
+		}
+		break;
+	case 'l':
+		send_packet('m', data);
+		break;
+	}
+	return 0;
+}
+
+/* Handle client packets until cond is true or msecs has passed.
+   msecs -1 waits forever. Returns -1 if client disconnected. */
+static int serve(int msecs, int (*cond)(int), int arg)
+{
+	struct timeval end, now, tv;
+	fd_set set;
+	int ret;
+
+	gettimeofday(&end, NULL);
+	end.tv_sec += msecs / 1000;
+	end.tv_usec += (msecs % 1000) * 1000;
+	if (end.tv_usec >= 1000000) {
+		end.tv_sec++;
+		end.tv_usec -= 1000000;
+	}
+
+	while (cond == NULL || !cond(arg)) {
+		if (msecs >= 0) {
+			gettimeofday(&now, NULL);
+			tv.tv_sec = end.tv_sec - now.tv_sec;
+			tv.tv_usec = end.tv_usec - now.tv_usec;
+			if (tv.tv_usec < 0) {
+				tv.tv_sec--;
+				tv.tv_usec += 1000000;
+			}
+			if (tv.tv_sec < 0)
+				break;
+		}
+
+		FD_ZERO(&set);
+		FD_SET(fd, &set);
+		ret = select(fd+1, &set, NULL, NULL, msecs < 0 ? NULL : &tv);
+		if (ret < 0 && errno != EINTR)
+			fatal("select()");
+		if (ret > 0 && handle_client() < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int opens_received(int count)
+{
+	return client_opens >= count;
+}
+
+static int echo_finished(int dummy)
+{
+	return echo_left == 0;
+}
+
+static void accept_client(void)
+{
+	if (fd != -1)
+		close(fd);
+
+	do {
+		fd = accept(listen_fd, NULL, NULL);
+	} while (fd < 0 && errno == EINTR);
+	if (fd < 0)
+		fatal("accept()");
+}
+
+static void do_login(const char *groupname)
+{
+	static unsigned char buf[MAX_PACKET];
+
+	snprintf(group, sizeof(group), "%s", groupname);
+
+	send_packet('j', "1\001localhost\001fake-icbd");
+	do {
+		if (read_packet(buf) < 0)
+			exit(0);
+	} while (buf[0] != 'a');
+
+	send_packet('a', "");
+	send_group_status();
+}
+
+static void do_open(int count, int len)
+{
+	char *text;
+	int i;
+
+	text = malloc(len+1);
+	memset(text, 'x', len);
+	text[len] = '\0';
+	for (i = 0; i < count; i++) {
+		/* make each line different */
+		if (len >= 8)
+			sprintf(text, "%07d", i), text[7] = ' ';
+		send_fields('b', "nick", text);
+	}
+	free(text);
+	send_done("open");
+}
+
+static void do_personal(int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		send_fields('c', "nick", "personal message");
+	send_done("personal");
+}
+
+static void do_who(int count)
+{
+	static char buf[512];
+	int i;
+
+	snprintf(buf, sizeof(buf), "co\001Group: %s  (rvl) Mod: nobody", group);
+	send_packet('i', buf);
+	send_packet('i', "co\001Topic: (None)");
+	for (i = 0; i < count; i++) {
+		snprintf(buf, sizeof(buf), "wl\001 \001user%d\0010\0010"
+			 "\001900000000\001login%d\001host%d.example.org"
+			 "\001(nr)", i, i, i);
+		send_packet('i', buf);
+	}
+	snprintf(buf, sizeof(buf), "co\001Total: %d users in 1 group", count);
+	send_packet('i', buf);
+	send_done("who");
+}
+
+/* alice and bob join, alice becomes carol and bob leaves. dave and erin
+   were never in the group. /who lists mod1 as moderator, short without
+   the user and host fields, and stranger in another group. */
+static void do_members(void)
+{
+	static char buf[512];
+
+	send_fields('d', "Arrive", "alice (alice@a.example.org) entered group");
+	send_fields('d', "Sign-on", "bob (bob@b.example.org) entered group");
+	send_fields('d', "Name", "alice changed nickname to carol");
+	send_fields('d', "Depart", "bob (bob@b.example.org) just left");
+	send_fields('d', "Sign-off", "dave (dave@d.example.org) has signed off.");
+	send_fields('d', "Depart", "erin (erin@e.example.org) just left");
+
+	snprintf(buf, sizeof(buf), "co\001Group: %s  (rvl) Mod: mod1", group);
+	send_packet('i', buf);
+	send_packet('i', "wl\001*\001mod1\0010\0010\001900000000"
+		    "\001login\001m.example.org\001(nr)");
+	send_packet('i', "wl\001 \001short");
+	send_packet('i', "co\001Group: other  (rvl) Mod: nobody");
+	send_packet('i', "wl\001 \001stranger\0010\0010\001900000000"
+		    "\001login\001s.example.org\001(nr)");
+	send_done("members");
+}
+
+static void do_fuzz(int count, unsigned int seed)
+{
+	unsigned char buf[256];
+	int i, j, len;
+
+	srand(seed);
+	for (i = 0; i < count; i++) {
+		/* mostly valid looking packet types with random fields,
+		   sometimes continued frames */
+		len = rand() % 256;
+		buf[0] = len;
+		for (j = 1; j <= (len == 0 ? 255 : len); j++) {
+			switch (rand() % 8) {
+			case 0:
+				buf[j] = 1;
+				break;
+			case 1:
+				buf[j] = 0;
+				break;
+			default:
+				buf[j] = rand() % 256;
+				break;
+			}
+		}
+		if (len != 0 && rand() % 2 == 0)
+			buf[1] = 'a' + rand() % 14;
+		send_all(buf, (len == 0 ? 255 : len) + 1);
+	}
+
+	/* finish a possibly continued packet */
+	buf[0] = 1; buf[1] = 'n';
+	send_all(buf, 2);
+	send_done("fuzz");
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	int i;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		fatal("socket()");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(listen_fd, 5) < 0)
+		fatal("bind()");
+
+	addrlen = sizeof(addr);
+	if (getsockname(listen_fd, (struct sockaddr *) &addr, &addrlen) < 0)
+		fatal("getsockname()");
+	printf("%d\n", ntohs(addr.sin_port));
+	fflush(stdout);
+
+	accept_client();
+	for (i = 1; i < argc; i++) {
+		const char *cmd = argv[i];
+		const char *arg = i+1 < argc ? argv[i+1] : "0";
+		const char *arg2 = i+2 < argc ? argv[i+2] : "0";
+
+		if (strcmp(cmd, "login") == 0) {
+			do_login(arg); i++;
+		} else if (strcmp(cmd, "open") == 0) {
+			/* optional length */
+			if (i+2 < argc && atoi(arg2) > 0) {
+				do_open(atoi(arg), atoi(arg2)); i += 2;
+			} else {
+				do_open(atoi(arg), 40); i++;
+			}
+		} else if (strcmp(cmd, "personal") == 0) {
+			do_personal(atoi(arg)); i++;
+		} else if (strcmp(cmd, "who") == 0) {
+			do_who(atoi(arg)); i++;
+		} else if (strcmp(cmd, "members") == 0) {
+			do_members();
+		} else if (strcmp(cmd, "recv") == 0) {
+			client_opens = 0;
+			if (serve(-1, opens_received, atoi(arg)) < 0)
+				return 0;
+			send_done("recv"); i++;
+		} else if (strcmp(cmd, "echo") == 0) {
+			echo_left = atoi(arg);
+			if (serve(-1, echo_finished, 0) < 0)
+				return 0;
+			send_done("echo"); i++;
+		} else if (strcmp(cmd, "ping") == 0) {
+			send_fields('l', arg, NULL);
+			i++;
+		} else if (strcmp(cmd, "fuzz") == 0) {
+			do_fuzz(atoi(arg), atoi(arg2)); i += 2;
+		} else if (strcmp(cmd, "serve") == 0) {
+			if (serve(atoi(arg), NULL, 0) < 0)
+				return 0;
+			i++;
+		} else if (strcmp(cmd, "accept") == 0) {
+			accept_client();
+		} else if (strcmp(cmd, "close") == 0) {
+			close(fd);
+			return 0;
+		} else {
+			fprintf(stderr, "fake-icbd: unknown step: %s\n", cmd);
+			return 1;
+		}
+	}
+
+	serve(-1, NULL, 0);
+	return 0;
+}
@@ -0,0 +1,1444 @@
+/*
+ fake-irssi.c : just enough of irssi's core for running the ICB module
+                in the tests
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Signals, settings, servers, channels and nicklists behave like in irssi
+   as far as the module can tell. Connecting is done with a blocking
+   connect() from the main loop, and the core's reconnect queue is
+   emulated too. Nothing that the hot paths of the module call allocates
+   memory, so the tests can count allocations. */
+
+#define MODULE_NAME "core"
+
+#include "common.h"
+#include "signals.h"
+#include "settings.h"
+#include "misc.h"
+#include "network.h"
+#include "net-sendbuffer.h"
+#include "rawlog.h"
+#include "chat-protocols.h"
+#include "chatnets.h"
+#include "servers-setup.h"
+#include "channels-setup.h"
+#include "servers.h"
+#include "servers-reconnect.h"
+#include "channels.h"
+#include "queries.h"
+#include "nicklist.h"
+#include "commands.h"
+#include "expandos.h"
+#include "formats.h"
+#include "themes.h"
+#include "printtext.h"
+#include "window-items.h"
+
+#include "fake-irssi.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+GSList *servers, *lookup_servers, *reconnects;
+GSList *channels, *setupchannels;
+GSList *windows;
+WINDOW_REC *active_win;
+char *current_command;
+unsigned long printtext_lines;
+
+/* ---- unique ids ---- */
+
+static GHashTable *uniq_modules; /* module name -> GHashTable of ids */
+static int uniq_next;
+
+int module_get_uniq_id_str(const char *module, const char *id)
+{
+	GHashTable *ids;
+	int ret;
+
+	ids = g_hash_table_lookup(uniq_modules, module);
+	if (ids == NULL) {
+		ids = g_hash_table_new((GHashFunc) g_str_hash,
+				       (GCompareFunc) g_str_equal);
+		g_hash_table_insert(uniq_modules, g_strdup(module), ids);
+	}
+
+	ret = GPOINTER_TO_INT(g_hash_table_lookup(ids, id));
+	if (ret == 0) {
+		ret = ++uniq_next;
+		g_hash_table_insert(ids, g_strdup(id), GINT_TO_POINTER(ret));
+	}
+	return ret;
+}
+
+int module_get_uniq_id(const char *module, int id)
+{
+	return module_get_uniq_id_str("modules", module);
+}
+
+void *module_check_cast(void *object, int type_pos, const char *id)
+{
+	if (object == NULL)
+		return NULL;
+
+	return *((int *) ((char *) object + type_pos)) ==
+		module_get_uniq_id(id, 0) ? object : NULL;
+}
+
+void module_register(const char *name, const char *submodule)
+{
+}
+
+/* ---- signals ---- */
+
+typedef struct {
+	int pos;
+	SIGNAL_FUNC func;
+	int removed;
+} SIGNAL_HOOK_REC;
+
+typedef struct {
+	GSList *hooks;
+	int emitting, stop;
+} SIGNAL_REC;
+
+static GHashTable *signals;
+static GSList *emitting; /* SIGNAL_RECs being emitted, innermost first */
+
+void signal_add_to(const char *module, int pos,
+		   const char *signal, SIGNAL_FUNC func)
+{
+	SIGNAL_REC *rec;
+	SIGNAL_HOOK_REC *hook;
+	GSList *tmp, *prev;
+	int id;
+
+	id = signal_get_uniq_id(signal);
+	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(id));
+	if (rec == NULL) {
+		rec = g_new0(SIGNAL_REC, 1);
+		g_hash_table_insert(signals, GINT_TO_POINTER(id), rec);
+	}
+
+	hook = g_new0(SIGNAL_HOOK_REC, 1);
+	hook->pos = pos;
+	hook->func = func;
+
+	/* after the hooks with the same or smaller position */
+	prev = NULL;
+	for (tmp = rec->hooks; tmp != NULL; tmp = tmp->next) {
+		SIGNAL_HOOK_REC *old = tmp->data;
+
+		if (old->pos > pos)
+			break;
+		prev = tmp;
+	}
+
+	if (prev == NULL)
+		rec->hooks = g_slist_prepend(rec->hooks, hook);
+	else {
+		tmp = g_slist_prepend(prev->next, hook);
+		prev->next = tmp;
+	}
+}
+
+static void signal_cleanup(SIGNAL_REC *rec)
+{
+	GSList *tmp, *next;
+
+	for (tmp = rec->hooks; tmp != NULL; tmp = next) {
+		SIGNAL_HOOK_REC *hook = tmp->data;
+
+		next = tmp->next;
+		if (hook->removed) {
+			rec->hooks = g_slist_remove(rec->hooks, hook);
+			g_free(hook);
+		}
+	}
+}
+
+void signal_remove(const char *signal, SIGNAL_FUNC func)
+{
+	SIGNAL_REC *rec;
+	GSList *tmp;
+
+	rec = g_hash_table_lookup(signals,
+				  GINT_TO_POINTER(signal_get_uniq_id(signal)));
+	if (rec == NULL)
+		return;
+
+	for (tmp = rec->hooks; tmp != NULL; tmp = tmp->next) {
+		SIGNAL_HOOK_REC *hook = tmp->data;
+
+		if (hook->func == func && !hook->removed) {
+			hook->removed = TRUE;
+			break;
+		}
+	}
+
+	if (rec->emitting == 0)
+		signal_cleanup(rec);
+}
+
+static int signal_emit_real(int signal_id, int params, va_list va)
+{
+	SIGNAL_REC *rec;
+	GSList *tmp, link;
+	gconstpointer arg[7];
+	int i, found, prev_stop;
+
+	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	if (rec == NULL)
+		return FALSE;
+
+	for (i = 0; i < 7; i++)
+		arg[i] = i < params ? va_arg(va, gconstpointer) : NULL;
+
+	/* the emitting list is kept in a stack allocated link, so that
+	   emitting doesn't allocate memory */
+	link.data = rec;
+	link.next = emitting;
+	emitting = &link;
+
+	prev_stop = rec->stop;
+	rec->stop = FALSE;
+	rec->emitting++;
+
+	found = FALSE;
+	for (tmp = rec->hooks; tmp != NULL; tmp = tmp->next) {
+		SIGNAL_HOOK_REC *hook = tmp->data;
+
+		if (hook->removed)
+			continue;
+
+		found = TRUE;
+		hook->func(arg[0], arg[1], arg[2], arg[3],
+			   arg[4], arg[5], arg[6]);
+		if (rec->stop)
+			break;
+	}
+
+	emitting = link.next;
+	rec->stop = prev_stop;
+	if (--rec->emitting == 0)
+		signal_cleanup(rec);
+	return found;
+}
+
+int signal_emit(const char *signal, int params, ...)
+{
+	va_list va;
+	int ret;
+
+	va_start(va, params);
+	ret = signal_emit_real(signal_get_uniq_id(signal), params, va);
+	va_end(va);
+	return ret;
+}
+
+int signal_emit_id(int signal_id, int params, ...)
+{
+	va_list va;
+	int ret;
+
+	va_start(va, params);
+	ret = signal_emit_real(signal_id, params, va);
+	va_end(va);
+	return ret;
+}
+
+void signal_stop(void)
+{
+	if (emitting != NULL)
+		((SIGNAL_REC *) emitting->data)->stop = TRUE;
+}
+
+/* ---- settings ---- */
+
+static GHashTable *settings;
+
+void settings_add_int(const char *section, const char *key, int def)
+{
+	if (g_hash_table_lookup_extended(settings, key, NULL, NULL))
+		return;
+	g_hash_table_insert(settings, g_strdup(key), GINT_TO_POINTER(def));
+}
+
+void settings_add_bool(const char *section, const char *key, int def)
+{
+	settings_add_int(section, key, def);
+}
+
+int settings_get_int(const char *key)
+{
+	return GPOINTER_TO_INT(g_hash_table_lookup(settings, key));
+}
+
+int settings_get_bool(const char *key)
+{
+	return settings_get_int(key);
+}
+
+void settings_set_int(const char *key, int value)
+{
+	gpointer oldkey, oldvalue;
+
+	if (g_hash_table_lookup_extended(settings, key, &oldkey, &oldvalue))
+		g_hash_table_insert(settings, oldkey, GINT_TO_POINTER(value));
+	else
+		g_hash_table_insert(settings, g_strdup(key),
+				    GINT_TO_POINTER(value));
+}
+
+/* ---- misc ---- */
+
+char *convert_home(const char *path)
+{
+	const char *home;
+
+	if (*path == '~' && (path[1] == '/' || path[1] == '\0')) {
+		home = getenv("HOME");
+		return g_strconcat(home == NULL ? "" : home, path+1, NULL);
+	}
+	return g_strdup(path);
+}
+
+long get_timeval_diff(const GTimeVal *tv1, const GTimeVal *tv2)
+{
+	long secs, usecs;
+
+	secs = tv1->tv_sec - tv2->tv_sec;
+	usecs = tv1->tv_usec - tv2->tv_usec;
+	if (usecs < 0) {
+		usecs += 1000000;
+		secs--;
+	}
+	return secs * 1000 + usecs/1000;
+}
+
+int g_istr_equal(gconstpointer v, gconstpointer v2)
+{
+	return g_strcasecmp((const char *) v, (const char *) v2) == 0;
+}
+
+unsigned int g_istr_hash(gconstpointer v)
+{
+	const char *s = v;
+	unsigned int h = 0;
+
+	for (; *s != '\0'; s++)
+		h = (h << 5) - h + tolower((unsigned char) *s);
+	return h;
+}
+
+void pidwait_add(int pid)
+{
+	/* irssi reaps children in its main loop - here it's enough to
+	   wait right away */
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) ;
+}
+
+/* ---- main loop inputs ---- */
+
+typedef struct {
+	GInputFunction function;
+	void *data;
+	int condition;
+} INPUT_REC;
+
+static int input_invoke(GIOChannel *source, GIOCondition condition,
+			void *data)
+{
+	INPUT_REC *rec = data;
+	int icond;
+
+	icond = 0;
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		/* error, we have to call the function.. */
+		icond = rec->condition;
+	} else {
+		if (condition & (G_IO_IN | G_IO_PRI))
+			icond |= G_INPUT_READ;
+		if (condition & G_IO_OUT)
+			icond |= G_INPUT_WRITE;
+	}
+
+	if (rec->condition & icond)
+		rec->function(rec->data, source, icond);
+	return TRUE;
+}
+
+int g_input_add(GIOChannel *source, int condition,
+		GInputFunction function, void *data)
+{
+	INPUT_REC *rec;
+	int cond;
+
+	rec = g_new(INPUT_REC, 1);
+	rec->function = function;
+	rec->data = data;
+	rec->condition = condition;
+
+	cond = G_IO_ERR | G_IO_HUP | G_IO_NVAL;
+	if (condition & G_INPUT_READ)
+		cond |= G_IO_IN | G_IO_PRI;
+	if (condition & G_INPUT_WRITE)
+		cond |= G_IO_OUT;
+
+	return g_io_add_watch_full(source, G_PRIORITY_DEFAULT, cond,
+				   (GIOFunc) input_invoke, rec,
+				   (GDestroyNotify) g_free);
+}
+
+/* ---- network ---- */
+
+struct _NET_SENDBUF_REC {
+	GIOChannel *handle;
+};
+
+int net_receive(GIOChannel *handle, char *buf, int len)
+{
+	int ret;
+
+	ret = read(g_io_channel_unix_get_fd(handle), buf, len);
+	if (ret == 0)
+		return -1; /* disconnected */
+
+	if (ret == -1 && (errno == EWOULDBLOCK || errno == EAGAIN ||
+			  errno == EINTR))
+		return 0; /* no bytes received */
+
+	return ret;
+}
+
+NET_SENDBUF_REC *net_sendbuffer_create(GIOChannel *handle, int bufsize)
+{
+	NET_SENDBUF_REC *rec;
+
+	rec = g_new0(NET_SENDBUF_REC, 1);
+	rec->handle = handle;
+	return rec;
+}
+
+void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close_handle)
+{
+	if (close_handle) {
+		close(g_io_channel_unix_get_fd(rec->handle));
+		g_io_channel_unref(rec->handle);
+	}
+	g_free(rec);
+}
+
+int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size)
+{
+	const char *p = data;
+	fd_set set;
+	int fd, ret;
+
+	/* the socket is non-blocking, wait until the peer has read
+	   enough instead of buffering */
+	fd = g_io_channel_unix_get_fd(rec->handle);
+	while (size > 0) {
+		ret = write(fd, p, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+
+			FD_ZERO(&set);
+			FD_SET(fd, &set);
+			select(fd+1, NULL, &set, NULL, NULL);
+			continue;
+		}
+		p += ret; size -= ret;
+	}
+	return 0;
+}
+
+GIOChannel *net_sendbuffer_handle(NET_SENDBUF_REC *rec)
+{
+	return rec->handle;
+}
+
+void rawlog_input(RAWLOG_REC *rawlog, const char *str)
+{
+}
+
+void rawlog_output(RAWLOG_REC *rawlog, const char *str)
+{
+}
+
+/* ---- chat protocols ---- */
+
+static GSList *chat_protocols;
+
+CHAT_PROTOCOL_REC *chat_protocol_find(const char *name)
+{
+	GSList *tmp;
+
+	for (tmp = chat_protocols; tmp != NULL; tmp = tmp->next) {
+		CHAT_PROTOCOL_REC *rec = tmp->data;
+
+		if (g_strcasecmp(rec->name, name) == 0)
+			return rec;
+	}
+	return NULL;
+}
+
+CHAT_PROTOCOL_REC *chat_protocol_find_id(int id)
+{
+	GSList *tmp;
+
+	for (tmp = chat_protocols; tmp != NULL; tmp = tmp->next) {
+		CHAT_PROTOCOL_REC *rec = tmp->data;
+
+		if (rec->id == id)
+			return rec;
+	}
+	return NULL;
+}
+
+CHAT_PROTOCOL_REC *chat_protocol_get_default(void)
+{
+	return chat_protocols == NULL ? NULL : chat_protocols->data;
+}
+
+int chat_protocol_lookup(const char *name)
+{
+	CHAT_PROTOCOL_REC *rec;
+
+	rec = chat_protocol_find(name);
+	return rec == NULL ? -1 : rec->id;
+}
+
+void *chat_protocol_check_cast(void *object, int type_pos, const char *id)
+{
+	if (object == NULL)
+		return NULL;
+
+	return *((int *) ((char *) object + type_pos)) ==
+		chat_protocol_lookup(id) ? object : NULL;
+}
+
+CHAT_PROTOCOL_REC *chat_protocol_register(CHAT_PROTOCOL_REC *rec)
+{
+	/* like irssi, keep our own copy */
+	rec = g_memdup(rec, sizeof(CHAT_PROTOCOL_REC));
+	rec->id = module_get_uniq_id_str("PROTOCOL", rec->name);
+	chat_protocols = g_slist_append(chat_protocols, rec);
+	signal_emit("chat protocol created", 1, rec);
+	return rec;
+}
+
+void chat_protocol_unregister(const char *name)
+{
+	CHAT_PROTOCOL_REC *rec;
+
+	rec = chat_protocol_find(name);
+	if (rec == NULL)
+		return;
+
+	chat_protocols = g_slist_remove(chat_protocols, rec);
+	signal_emit("chat protocol destroyed", 1, rec);
+	g_free(rec);
+}
+
+int channel_chatnet_match(const char *rec_chatnet, const char *chatnet)
+{
+	return rec_chatnet == NULL || *rec_chatnet == '\0' ||
+		(chatnet != NULL && g_strcasecmp(rec_chatnet, chatnet) == 0);
+}
+
+/* ---- servers ---- */
+
+static int tag_counter, connect_fd = -1;
+
+void server_connect_ref(SERVER_CONNECT_REC *conn)
+{
+	conn->refcount++;
+}
+
+void server_connect_unref(SERVER_CONNECT_REC *conn)
+{
+	if (--conn->refcount > 0)
+		return;
+
+	CHAT_PROTOCOL(conn)->destroy_server_connect(conn);
+
+	g_free(conn->address);
+	g_free(conn->chatnet);
+	g_free(conn->password);
+	g_free(conn->nick);
+	g_free(conn->username);
+	g_free(conn->realname);
+	g_free(conn->channels);
+	g_free(conn->away_reason);
+	g_free(conn);
+}
+
+void server_connect_init(SERVER_REC *server)
+{
+	server->type = module_get_uniq_id("SERVER", 0);
+	server_ref(server);
+
+	server->nick = g_strdup(server->connrec->nick);
+	if (server->connrec->username == NULL ||
+	    *server->connrec->username == '\0') {
+		g_free_not_null(server->connrec->username);
+		server->connrec->username = g_strdup(server->nick);
+	}
+	server->tag = g_strdup_printf("icb%d", ++tag_counter);
+	server->connect_tag = -1;
+	server->readtag = -1;
+}
+
+void server_ref(SERVER_REC *server)
+{
+	server->refcount++;
+}
+
+int server_unref(SERVER_REC *server)
+{
+	if (--server->refcount > 0)
+		return TRUE;
+
+	if (g_slist_find(servers, server) != NULL) {
+		g_warning("Non-referenced server wasn't disconnected");
+		server_disconnect(server);
+		return TRUE;
+	}
+
+	server_connect_unref(server->connrec);
+	g_free(server->nick);
+	g_free(server->tag);
+	server->type = 0;
+	g_free(server);
+	return FALSE;
+}
+
+static void server_connect_failed(SERVER_REC *server, const char *msg)
+{
+	lookup_servers = g_slist_remove(lookup_servers, server);
+	signal_emit("server connect failed", 2, server, msg);
+
+	if (server->connect_tag != -1) {
+		g_source_remove(server->connect_tag);
+		server->connect_tag = -1;
+	}
+	if (server->handle != NULL) {
+		net_sendbuffer_destroy(server->handle, TRUE);
+		server->handle = NULL;
+	}
+	server_unref(server);
+}
+
+static int server_connect_finish(SERVER_REC *server)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	server->connect_tag = -1;
+
+	fd = connect_fd;
+	connect_fd = -1;
+	if (fd == -1) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(server->connrec->port);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd == -1 ||
+		    inet_aton(server->connrec->address, &addr.sin_addr) == 0 ||
+		    connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			if (fd != -1) close(fd);
+			server->connection_lost = TRUE;
+			server_connect_failed(server, g_strerror(errno));
+			return FALSE;
+		}
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	server->handle = net_sendbuffer_create(g_io_channel_unix_new(fd), 0);
+	server->connect_time = time(NULL);
+
+	lookup_servers = g_slist_remove(lookup_servers, server);
+	servers = g_slist_append(servers, server);
+	signal_emit("server connected", 1, server);
+	return FALSE;
+}
+
+int server_start_connect(SERVER_REC *server)
+{
+	if (server->connrec->port <= 0)
+		return FALSE;
+
+	lookup_servers = g_slist_append(lookup_servers, server);
+	signal_emit("server looking", 1, server);
+
+	server->connect_tag =
+		g_timeout_add(0, (GSourceFunc) server_connect_finish, server);
+	return TRUE;
+}
+
+void server_disconnect(SERVER_REC *server)
+{
+	if (g_slist_find(lookup_servers, server) != NULL ||
+	    server->connect_tag != -1) {
+		/* still connecting to server.. */
+		server_connect_failed(server, NULL);
+		return;
+	}
+
+	servers = g_slist_remove(servers, server);
+	signal_emit("server disconnected", 1, server);
+
+	/* close all channels */
+	while (server->channels != NULL)
+		channel_destroy(server->channels->data);
+
+	if (server->handle != NULL) {
+		net_sendbuffer_destroy(server->handle, TRUE);
+		server->handle = NULL;
+	}
+
+	if (server->readtag > 0) {
+		g_source_remove(server->readtag);
+		server->readtag = -1;
+	}
+
+	server->disconnected = TRUE;
+	server_unref(server);
+}
+
+SERVER_REC *server_find_tag(const char *tag)
+{
+	GSList *tmp;
+
+	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
+		SERVER_REC *server = tmp->data;
+
+		if (g_strcasecmp(server->tag, tag) == 0)
+			return server;
+	}
+
+	for (tmp = lookup_servers; tmp != NULL; tmp = tmp->next) {
+		SERVER_REC *server = tmp->data;
+
+		if (g_strcasecmp(server->tag, tag) == 0)
+			return server;
+	}
+	return NULL;
+}
+
+void server_change_nick(SERVER_REC *server, const char *nick)
+{
+	g_free(server->nick);
+	server->nick = g_strdup(nick);
+	signal_emit("server nick changed", 1, server);
+}
+
+/* ---- reconnects ---- */
+
+static int reconnect_tag, last_reconnect_tag;
+
+SERVER_CONNECT_REC *
+server_connect_copy_skeleton(SERVER_CONNECT_REC *src, int connect_info)
+{
+	SERVER_CONNECT_REC *dest;
+
+	dest = NULL;
+	signal_emit("server connect copy", 2, &dest, src);
+	g_return_val_if_fail(dest != NULL, NULL);
+
+	server_connect_ref(dest);
+	dest->type = module_get_uniq_id("SERVER CONNECT", 0);
+	dest->reconnection = src->reconnection;
+
+	dest->address = g_strdup(src->address);
+	dest->port = src->port;
+	dest->password = g_strdup(src->password);
+	dest->chatnet = g_strdup(src->chatnet);
+	dest->nick = g_strdup(src->nick);
+	dest->username = g_strdup(src->username);
+	dest->realname = g_strdup(src->realname);
+
+	dest->channels = g_strdup(src->channels);
+	dest->away_reason = g_strdup(src->away_reason);
+	return dest;
+}
+
+void reconnect_save_status(SERVER_CONNECT_REC *conn, SERVER_REC *server)
+{
+	g_free_not_null(conn->channels);
+	conn->channels = server->channels == NULL ? NULL :
+		g_strdup(((CHANNEL_REC *) server->channels->data)->name);
+
+	signal_emit("server reconnect save status", 2, conn, server);
+}
+
+void server_reconnect_destroy(RECONNECT_REC *rec)
+{
+	reconnects = g_slist_remove(reconnects, rec);
+
+	signal_emit("server reconnect remove", 1, rec);
+	rec->conn->reconnecting = FALSE;
+	server_connect_unref(rec->conn);
+	g_free(rec);
+}
+
+static void server_connect_now(SERVER_CONNECT_REC *conn)
+{
+	SERVER_REC *server;
+
+	server = CHAT_PROTOCOL(conn)->server_init_connect(conn);
+	if (server != NULL)
+		CHAT_PROTOCOL(conn)->server_connect(server);
+}
+
+static int server_reconnect_timeout(void)
+{
+	GSList *tmp, *next;
+	time_t now;
+
+	now = time(NULL);
+	for (tmp = reconnects; tmp != NULL; tmp = next) {
+		RECONNECT_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->next_connect <= now) {
+			SERVER_CONNECT_REC *conn = rec->conn;
+
+			server_connect_ref(conn);
+			server_reconnect_destroy(rec);
+			server_connect_now(conn);
+			server_connect_unref(conn);
+		}
+	}
+	return 1;
+}
+
+static void sig_reconnect(SERVER_REC *server)
+{
+	SERVER_CONNECT_REC *conn;
+	RECONNECT_REC *rec;
+	int reconnect_time;
+	time_t now;
+
+	reconnect_time = settings_get_int("server_reconnect_time");
+	if (reconnect_time == -1 || !server->connection_lost)
+		return;
+
+	conn = server_connect_copy_skeleton(server->connrec, FALSE);
+	g_return_if_fail(conn != NULL);
+
+	/* save the server status */
+	if (server->connected) {
+		conn->reconnection = TRUE;
+		reconnect_save_status(conn, server);
+	}
+
+	now = time(NULL);
+	if (server->connect_time != 0 &&
+	    now-server->connect_time > reconnect_time) {
+		/* there's been enough time since last connection,
+		   reconnect immediately */
+		server_connect_now(conn);
+		server_connect_unref(conn);
+		return;
+	}
+
+	rec = g_new(RECONNECT_REC, 1);
+	rec->tag = ++last_reconnect_tag;
+	rec->next_connect = (server->connect_time == 0 ? now :
+			     server->connect_time) + reconnect_time;
+	rec->conn = conn;
+	conn->reconnecting = TRUE;
+	reconnects = g_slist_append(reconnects, rec);
+}
+
+/* ---- channels and queries ---- */
+
+void channel_init(CHANNEL_REC *channel, SERVER_REC *server, const char *name,
+		  const char *visible_name, int automatic)
+{
+	channel->type = module_get_uniq_id("CHANNEL", 0);
+	channel->chat_type = server != NULL ? server->chat_type :
+		chat_protocol_get_default()->id;
+	channel->server = server;
+	channel->name = g_strdup(name);
+	channel->visible_name = g_strdup(visible_name != NULL ?
+					 visible_name : name);
+	channel->nicks = g_hash_table_new((GHashFunc) g_istr_hash,
+					  (GCompareFunc) g_istr_equal);
+
+	channels = g_slist_append(channels, channel);
+	if (server != NULL)
+		server->channels = g_slist_append(server->channels, channel);
+
+	signal_emit("channel created", 2, channel, GINT_TO_POINTER(automatic));
+}
+
+static void nicklist_free_nick(void *key, NICK_REC *nick, void *data)
+{
+	g_free(nick->nick);
+	g_free_not_null(nick->host);
+	g_free_not_null(nick->realname);
+	g_free(nick);
+}
+
+void channel_destroy(CHANNEL_REC *channel)
+{
+	if (channel->destroying) return;
+	channel->destroying = TRUE;
+
+	channels = g_slist_remove(channels, channel);
+	if (channel->server != NULL) {
+		channel->server->channels =
+			g_slist_remove(channel->server->channels, channel);
+	}
+	signal_emit("channel destroyed", 1, channel);
+
+	g_hash_table_foreach(channel->nicks, (GHFunc) nicklist_free_nick,
+			     NULL);
+	g_hash_table_destroy(channel->nicks);
+
+	g_free_not_null(channel->topic);
+	g_free_not_null(channel->topic_by);
+	g_free(channel->name);
+	g_free(channel->visible_name);
+	g_free(channel);
+}
+
+void channel_change_name(CHANNEL_REC *channel, const char *name)
+{
+	g_free(channel->name);
+	channel->name = g_strdup(name);
+	signal_emit("channel name changed", 1, channel);
+}
+
+void channel_change_visible_name(CHANNEL_REC *channel, const char *name)
+{
+	g_free(channel->visible_name);
+	channel->visible_name = g_strdup(name);
+	signal_emit("window item name changed", 1, channel);
+}
+
+CHANNEL_REC *channel_find(SERVER_REC *server, const char *name)
+{
+	GSList *tmp;
+
+	for (tmp = server != NULL ? server->channels : channels;
+	     tmp != NULL; tmp = tmp->next) {
+		CHANNEL_REC *rec = tmp->data;
+
+		if (g_strcasecmp(rec->name, name) == 0)
+			return rec;
+	}
+	return NULL;
+}
+
+void query_init(QUERY_REC *query, int automatic)
+{
+	query->type = module_get_uniq_id("QUERY", 0);
+	signal_emit("query created", 2, query, GINT_TO_POINTER(automatic));
+}
+
+void query_destroy(QUERY_REC *query)
+{
+	signal_emit("query destroyed", 1, query);
+	g_free(query->name);
+	g_free_not_null(query->server_tag);
+	g_free(query);
+}
+
+QUERY_REC *query_find(SERVER_REC *server, const char *nick)
+{
+	return NULL;
+}
+
+/* ---- nicklist ---- */
+
+void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick)
+{
+	nick->type = module_get_uniq_id("NICK", 0);
+	nick->chat_type = channel->chat_type;
+
+	g_hash_table_insert(channel->nicks, nick->nick, nick);
+	signal_emit("nicklist new", 2, channel, nick);
+}
+
+void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick,
+		       const char *host)
+{
+	g_free_not_null(nick->host);
+	nick->host = g_strdup(host);
+}
+
+void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick)
+{
+	signal_emit("nicklist remove", 2, channel, nick);
+
+	g_hash_table_remove(channel->nicks, nick->nick);
+	if (channel->ownnick == nick)
+		channel->ownnick = NULL;
+	nicklist_free_nick(NULL, nick, NULL);
+}
+
+void nicklist_rename(SERVER_REC *server, const char *old_nick,
+		     const char *new_nick)
+{
+	GSList *tmp;
+	char *old;
+
+	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
+		CHANNEL_REC *channel = tmp->data;
+		NICK_REC *nick;
+
+		nick = nicklist_find(channel, old_nick);
+		if (nick == NULL)
+			continue;
+
+		g_hash_table_remove(channel->nicks, nick->nick);
+		old = nick->nick;
+		nick->nick = g_strdup(new_nick);
+		g_hash_table_insert(channel->nicks, nick->nick, nick);
+
+		signal_emit("nicklist changed", 3, channel, nick, old);
+		g_free(old);
+	}
+}
+
+NICK_REC *nicklist_find(CHANNEL_REC *channel, const char *nick)
+{
+	return g_hash_table_lookup(channel->nicks, nick);
+}
+
+static void get_nicks_hash(void *key, NICK_REC *rec, GSList **list)
+{
+	*list = g_slist_append(*list, rec);
+}
+
+GSList *nicklist_getnicks(CHANNEL_REC *channel)
+{
+	GSList *list;
+
+	list = NULL;
+	g_hash_table_foreach(channel->nicks, (GHFunc) get_nicks_hash, &list);
+	return list;
+}
+
+void nicklist_set_own(CHANNEL_REC *channel, NICK_REC *nick)
+{
+	channel->ownnick = nick;
+	signal_emit("nicklist own changed", 2, channel, nick);
+}
+
+/* ---- commands ---- */
+
+typedef struct {
+	int protocol;
+	SIGNAL_FUNC func;
+} COMMAND_REC;
+
+static GHashTable *commands; /* name -> GSList of COMMAND_RECs */
+
+void command_bind_proto(const char *cmd, int protocol, const char *section,
+			SIGNAL_FUNC func)
+{
+	COMMAND_REC *rec;
+	gpointer key, list;
+
+	rec = g_new(COMMAND_REC, 1);
+	rec->protocol = protocol;
+	rec->func = func;
+
+	if (g_hash_table_lookup_extended(commands, cmd, &key, &list)) {
+		g_hash_table_insert(commands, key,
+				    g_slist_append(list, rec));
+	} else {
+		g_hash_table_insert(commands, g_strdup(cmd),
+				    g_slist_append(NULL, rec));
+	}
+}
+
+void command_unbind(const char *cmd, SIGNAL_FUNC func)
+{
+	GSList *list, *tmp;
+	gpointer key;
+
+	if (!g_hash_table_lookup_extended(commands, cmd, &key,
+					  (gpointer *) &list))
+		return;
+
+	for (tmp = list; tmp != NULL; tmp = tmp->next) {
+		COMMAND_REC *rec = tmp->data;
+
+		if (rec->func == func) {
+			list = g_slist_remove(list, rec);
+			g_free(rec);
+			break;
+		}
+	}
+
+	if (list != NULL)
+		g_hash_table_insert(commands, key, list);
+	else {
+		g_hash_table_remove(commands, key);
+		g_free(key);
+	}
+}
+
+void command_set_options(const char *cmd, const char *options)
+{
+}
+
+int command_run(const char *cmd, const char *data, void *server, void *item)
+{
+	GSList *tmp;
+	char *prev;
+	int found;
+
+	prev = current_command;
+	current_command = (char *) cmd;
+
+	found = FALSE;
+	for (tmp = g_hash_table_lookup(commands, cmd); tmp != NULL;
+	     tmp = tmp->next) {
+		COMMAND_REC *rec = tmp->data;
+
+		found = TRUE;
+		rec->func(data, server, item, NULL, NULL, NULL, NULL);
+	}
+
+	current_command = prev;
+	return found;
+}
+
+void command_runsub(const char *cmd, const char *data,
+		    void *server, void *item)
+{
+	const char *p;
+	char *subcmd;
+
+	while (*data == ' ') data++;
+	for (p = data; *p != '\0' && *p != ' '; p++) ;
+
+	subcmd = g_strdup_printf("%s %.*s", cmd, (int) (p-data), data);
+	g_strdown(subcmd);
+	while (*p == ' ') p++;
+
+	if (!command_run(subcmd, p, server, item))
+		signal_emit("error command", 1,
+			    GINT_TO_POINTER(CMDERR_UNKNOWN));
+	g_free(subcmd);
+}
+
+typedef struct {
+	char *data;
+	GHashTable *options;
+} PARAMS_REC;
+
+static char *params_next_word(char **data)
+{
+	char *word;
+
+	while (**data == ' ') (*data)++;
+	word = *data;
+	while (**data != '\0' && **data != ' ') (*data)++;
+	if (**data == ' ')
+		*(*data)++ = '\0';
+	return word;
+}
+
+int cmd_get_params(const char *data, gpointer *free_me, int count, ...)
+{
+	PARAMS_REC *rec;
+	va_list va;
+	GHashTable **optlist;
+	char **arg, *p;
+	int i;
+
+	rec = g_new0(PARAMS_REC, 1);
+	rec->data = g_strdup(data);
+	p = rec->data;
+
+	va_start(va, count);
+	if (count & PARAM_FLAG_OPTIONS) {
+		(void) va_arg(va, const char *);
+		optlist = va_arg(va, GHashTable **);
+
+		rec->options = g_hash_table_new((GHashFunc) g_str_hash,
+						(GCompareFunc) g_str_equal);
+		while (*p == ' ') p++;
+		while (*p == '-') {
+			char *word = params_next_word(&p);
+
+			g_hash_table_insert(rec->options, word+1, "");
+			while (*p == ' ') p++;
+		}
+		*optlist = rec->options;
+	}
+
+	count = PARAM_WITHOUT_FLAGS(count);
+	for (i = 0; i < count; i++) {
+		arg = va_arg(va, char **);
+		if (i == count-1 && (count == 1 ||
+				     (count & PARAM_FLAG_GETREST))) {
+			while (*p == ' ') p++;
+			*arg = p;
+		} else {
+			*arg = params_next_word(&p);
+		}
+	}
+	va_end(va);
+
+	*free_me = rec;
+	return TRUE;
+}
+
+void cmd_params_free(void *free_me)
+{
+	PARAMS_REC *rec = free_me;
+
+	if (rec->options != NULL)
+		g_hash_table_destroy(rec->options);
+	g_free(rec->data);
+	g_free(rec);
+}
+
+/* ---- expandos and fe ---- */
+
+void expando_create(const char *key, EXPANDO_FUNC func, ...)
+{
+}
+
+void expando_destroy(const char *key, EXPANDO_FUNC func)
+{
+}
+
+void theme_register_module(const char *module, FORMAT_REC *formats)
+{
+}
+
+void printformat_module(const char *module, void *server, const char *target,
+			int level, int formatnum, ...)
+{
+	printtext_lines++;
+}
+
+void printtext(void *server, const char *target, int level,
+	       const char *text, ...)
+{
+	printtext_lines++;
+}
+
+void window_set_active(WINDOW_REC *window)
+{
+	active_win = window;
+}
+
+WINDOW_REC *window_item_window(WI_ITEM_REC *item)
+{
+	return NULL;
+}
+
+void window_item_set_active(WINDOW_REC *window, WI_ITEM_REC *item)
+{
+	window->active = item;
+}
+
+static void sig_chat_protocol_deinit(CHAT_PROTOCOL_REC *proto)
+{
+	GSList *tmp, *next;
+
+	for (tmp = lookup_servers; tmp != NULL; tmp = next) {
+		SERVER_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->chat_type == proto->id)
+			server_disconnect(rec);
+	}
+
+	for (tmp = servers; tmp != NULL; tmp = next) {
+		SERVER_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->chat_type == proto->id)
+			server_disconnect(rec);
+	}
+}
+
+/* ---- test helpers ---- */
+
+void fake_irssi_init(void)
+{
+	uniq_modules = g_hash_table_new((GHashFunc) g_str_hash,
+					(GCompareFunc) g_str_equal);
+	signals = g_hash_table_new((GHashFunc) g_direct_hash,
+				   (GCompareFunc) g_direct_equal);
+	settings = g_hash_table_new((GHashFunc) g_str_hash,
+				    (GCompareFunc) g_str_equal);
+	commands = g_hash_table_new((GHashFunc) g_str_hash,
+				    (GCompareFunc) g_str_equal);
+
+	/* a dead fake server must not kill us */
+	signal(SIGPIPE, SIG_IGN);
+
+	settings_add_int("server", "server_reconnect_time", 300);
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_reconnect);
+	signal_add("server connect failed", (SIGNAL_FUNC) sig_reconnect);
+	signal_add("chat protocol deinit",
+		   (SIGNAL_FUNC) sig_chat_protocol_deinit);
+	reconnect_tag = g_timeout_add(1000, (GSourceFunc)
+				      server_reconnect_timeout, NULL);
+}
+
+void fake_irssi_deinit(void)
+{
+	while (servers != NULL)
+		server_disconnect(servers->data);
+	while (reconnects != NULL)
+		server_reconnect_destroy(reconnects->data);
+
+	g_source_remove(reconnect_tag);
+	signal_remove("chat protocol deinit",
+		      (SIGNAL_FUNC) sig_chat_protocol_deinit);
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_reconnect);
+	signal_remove("server connect failed", (SIGNAL_FUNC) sig_reconnect);
+}
+
+SERVER_CONNECT_REC *fake_connect_rec(const char *protocol,
+				     const char *address, int port,
+				     const char *nick, const char *channels)
+{
+	CHAT_PROTOCOL_REC *proto;
+	SERVER_CONNECT_REC *conn;
+
+	proto = chat_protocol_find(protocol);
+	g_return_val_if_fail(proto != NULL, NULL);
+
+	conn = proto->create_server_connect();
+	conn->type = module_get_uniq_id("SERVER CONNECT", 0);
+	conn->chat_type = proto->id;
+	conn->address = g_strdup(address);
+	conn->port = port;
+	conn->nick = g_strdup(nick);
+	conn->channels = channels == NULL ? NULL : g_strdup(channels);
+	server_connect_ref(conn);
+
+	signal_emit("server setup fill connect", 1, conn);
+	return conn;
+}
+
+SERVER_REC *fake_server_connect(SERVER_CONNECT_REC *conn)
+{
+	SERVER_REC *server;
+
+	server = CHAT_PROTOCOL(conn)->server_init_connect(conn);
+	if (server != NULL)
+		CHAT_PROTOCOL(conn)->server_connect(server);
+	return server;
+}
+
+void fake_connect_use_fd(int fd)
+{
+	connect_fd = fd;
+}
+
+static int run_timeout(int *expired)
+{
+	*expired = TRUE;
+	return FALSE;
+}
+
+int fake_run_until(volatile int *flag, int msecs)
+{
+	int expired, tag;
+
+	expired = FALSE;
+	tag = g_timeout_add(msecs, (GSourceFunc) run_timeout, &expired);
+	while (!*flag && !expired)
+		g_main_iteration(TRUE);
+	if (!expired)
+		g_source_remove(tag);
+	return *flag;
+}
+
+void fake_run_for(int msecs)
+{
+	int never = FALSE;
+
+	fake_run_until(&never, msecs);
+}
+
+char *fake_spawn(char *const argv[], int *pid)
+{
+	char line[256];
+	int fds[2], len, ret;
+
+	if (pipe(fds) < 0)
+		return NULL;
+
+	*pid = fork();
+	if (*pid < 0)
+		return NULL;
+	if (*pid == 0) {
+		close(fds[0]);
+		dup2(fds[1], 1);
+		execv(argv[0], argv);
+		fprintf(stderr, "exec(%s) failed: %s\n",
+			argv[0], g_strerror(errno));
+		_exit(1);
+	}
+	close(fds[1]);
+
+	/* the first line, byte at a time so nothing else is consumed */
+	len = 0;
+	while (len < (int) sizeof(line)-1) {
+		ret = read(fds[0], line+len, 1);
+		if (ret <= 0 || line[len] == '\n')
+			break;
+		len++;
+	}
+	line[len] = '\0';
+	close(fds[0]);
+	return len == 0 ? NULL : g_strdup(line);
+}
+
+double fake_time_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+long fake_peak_rss(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		return -1;
+	return usage.ru_maxrss;
+}
@@ -0,0 +1,38 @@
+#ifndef __FAKE_IRSSI_H
+#define __FAKE_IRSSI_H
+
+/* Test helpers of the fake irssi core, see fake-irssi.c */
+
+void fake_irssi_init(void);
+void fake_irssi_deinit(void);
+
+/* Create a connect record for chat protocol, ready to be given to
+   server_init_connect() */
+SERVER_CONNECT_REC *fake_connect_rec(const char *protocol,
+				     const char *address, int port,
+				     const char *nick, const char *channels);
+
+/* Create a server for conn and start connecting it, like /CONNECT */
+SERVER_REC *fake_server_connect(SERVER_CONNECT_REC *conn);
+
+/* The next started connect uses the already connected fd instead of
+   connecting to the address, eg. one end of a socketpair() */
+void fake_connect_use_fd(int fd);
+
+/* Run main loop until *flag is non-zero or msecs have passed.
+   Returns *flag. */
+int fake_run_until(volatile int *flag, int msecs);
+/* Run main loop for msecs */
+void fake_run_for(int msecs);
+
+/* Start a program and read the first line it prints to stdout, which is
+   returned. The program's pid is stored to pid. */
+char *fake_spawn(char *const argv[], int *pid);
+
+/* usecs since some fixed time */
+double fake_time_usecs(void);
+
+/* peak resident set size of this process in kB */
+long fake_peak_rss(void);
+
+#endif
@@ -0,0 +1,23 @@
+/* CHANNEL_REC definition, used for inheritance */
+
+int type; /* module_get_uniq_id("CHANNEL", 0) */
+int chat_type; /* chat_protocol_lookup(xx) */
+
+STRUCT_SERVER_REC *server;
+char *name;
+char *visible_name;
+
+char *topic;
+char *topic_by;
+time_t topic_time;
+
+GHashTable *nicks; /* list of nicks */
+NICK_REC *ownnick; /* our own nick */
+
+unsigned int synced:1; /* channel is fully synchronized */
+unsigned int joined:1; /* JOIN event has been received */
+unsigned int left:1; /* You just left the channel */
+unsigned int kicked:1; /* You just got kicked */
+unsigned int destroying:1;
+
+#undef STRUCT_SERVER_REC
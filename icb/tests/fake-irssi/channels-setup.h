@@ -0,0 +1,21 @@
+#ifndef __CHANNELS_SETUP_H
+#define __CHANNELS_SETUP_H
+
+struct _CHANNEL_SETUP_REC {
+	int type;
+	int chat_type;
+
+	char *name;
+	char *chatnet;
+	char *password;
+	char *botmasks;
+	char *autosendcmd;
+	unsigned int autojoin:1;
+};
+
+extern GSList *setupchannels;
+
+/* Returns TRUE if channel's chatnet matches the given chatnet */
+int channel_chatnet_match(const char *rec_chatnet, const char *chatnet);
+
+#endif
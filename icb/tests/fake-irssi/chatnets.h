@@ -0,0 +1,14 @@
+#ifndef __CHATNETS_H
+#define __CHATNETS_H
+
+struct _CHATNET_REC {
+	int type;
+	int chat_type;
+
+	char *name;
+	char *nick, *username, *realname;
+	char *own_host;
+	char *autosendcmd;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef __COMMANDS_H
+#define __COMMANDS_H
+
+#include "signals.h"
+
+enum {
+        CMDERR_OPTION_UNKNOWN = -3, /* unknown -option */
+        CMDERR_OPTION_AMBIGUOUS = -2, /* ambiguous -option */
+        CMDERR_OPTION_ARG_MISSING = -1, /* argument missing for -option */
+
+        CMDERR_UNKNOWN, /* unknown command */
+        CMDERR_AMBIGUOUS, /* ambiguous command */
+
+        CMDERR_ERRNO, /* get the error from errno */
+        CMDERR_NOT_ENOUGH_PARAMS, /* not enough parameters given */
+        CMDERR_NOT_CONNECTED, /* not connected to IRC server */
+        CMDERR_NOT_JOINED, /* not joined to any channels in this window */
+        CMDERR_CHAN_NOT_FOUND, /* channel not found */
+        CMDERR_CHAN_NOT_SYNCED, /* channel not fully synchronized yet */
+        CMDERR_NOT_GOOD_IDEA /* not good idea to do, -yes overrides this */
+};
+
+/* Return the full command for `alias' */
+#define cmd_return_error(a) \
+	G_STMT_START { \
+	  signal_emit("error command", 1, GINT_TO_POINTER(a)); \
+	  signal_stop(); \
+	  return; \
+	} G_STMT_END
+
+#define cmd_param_error(a) \
+	G_STMT_START { \
+	  cmd_params_free(free_arg); \
+	  cmd_return_error(a); \
+	} G_STMT_END
+
+extern char *current_command; /* the command we're right now running */
+
+void command_bind_proto(const char *cmd, int protocol, const char *section,
+			SIGNAL_FUNC func);
+#define command_bind_proto_first command_bind_proto
+#define command_bind_proto_last command_bind_proto
+void command_unbind(const char *cmd, SIGNAL_FUNC func);
+
+/* Run subcommand, `cmd' contains the base command, `data' contains the
+   subcommand and it's parameters. */
+void command_runsub(const char *cmd, const char *data,
+		    void *server, void *item);
+
+/* Set options for command, "-a -b +c" */
+void command_set_options(const char *cmd, const char *options);
+
+/* tests only: run a command bound with command_bind_proto() */
+int command_run(const char *cmd, const char *data,
+		void *server, void *item);
+
+#define PARAM_WITHOUT_FLAGS(a) ((a) & 0x00000fff)
+/* don't check for quotes - "arg1 arg2" is NOT treated as one argument */
+#define PARAM_FLAG_NOQUOTES 0x00001000
+/* final argument gets all the rest of the arguments */
+#define PARAM_FLAG_GETREST 0x00002000
+/* command contains options - first you need to specify them with
+   command_set_options() function. Example:
+
+     -cmd requiredarg -noargcmd -cmd2 "another arg" -optnumarg rest of text
+
+   You would call this with:
+
+   // only once in init
+   command_set_options("mycmd", "+cmd noargcmd -cmd2 +optnumarg");
+
+   GHashTable *optlist;
+
+   cmd_get_params(data, &free_me, 1 | PARAM_FLAG_OPTIONS |
+                  PARAM_FLAG_GETREST, "mycmd", &optlist, &rest);
+
+   The optlist hash table is filled:
+
+   "cmd" = "requiredarg"
+   "noargcmd" = ""
+   "cmd2" = "another arg"
+   "optnumarg" = "" - this is because "rest" isn't a numeric value
+*/
+#define PARAM_FLAG_OPTIONS 0x00004000
+/* don't complain about unknown options */
+#define PARAM_FLAG_UNKNOWN_OPTIONS 0x00008000
+
+int cmd_get_params(const char *data, gpointer *free_me, int count, ...);
+void cmd_params_free(void *free_me);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __COMMON_H
+#define __COMMON_H
+
+/* The parts of irssi's headers the ICB module uses, so the tests can be
+   built and run without an irssi source tree. Everything declared here
+   is implemented by ../fake-irssi.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <glib.h>
+
+#define MAX_INT_STRLEN ((sizeof(int) * CHAR_BIT + 2) / 3 + 1)
+
+#define g_free_not_null(a) \
+	G_STMT_START { if (a) g_free(a); } G_STMT_END
+
+#define g_free_and_null(a) \
+	G_STMT_START { if (a) { g_free(a); (a) = NULL; } } G_STMT_END
+
+#define G_INPUT_READ (1 << 0)
+#define G_INPUT_WRITE (1 << 1)
+#define G_INPUT_EXCEPTION (1 << 2)
+
+typedef void (*GInputFunction) (void *data, GIOChannel *source,
+				int condition);
+
+int g_input_add(GIOChannel *source, int condition,
+		GInputFunction function, void *data);
+
+typedef struct _MODULE_REC MODULE_REC;
+typedef struct _IPADDR IPADDR;
+typedef struct _RAWLOG_REC RAWLOG_REC;
+typedef struct _NET_SENDBUF_REC NET_SENDBUF_REC;
+
+typedef struct _CHAT_PROTOCOL_REC CHAT_PROTOCOL_REC;
+typedef struct _CHATNET_REC CHATNET_REC;
+typedef struct _SERVER_REC SERVER_REC;
+typedef struct _SERVER_CONNECT_REC SERVER_CONNECT_REC;
+typedef struct _SERVER_SETUP_REC SERVER_SETUP_REC;
+typedef struct _CHANNEL_REC CHANNEL_REC;
+typedef struct _CHANNEL_SETUP_REC CHANNEL_SETUP_REC;
+typedef struct _QUERY_REC QUERY_REC;
+typedef struct _NICK_REC NICK_REC;
+
+#include "modules.h"
+
+#endif
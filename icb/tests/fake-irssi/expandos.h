@@ -0,0 +1,24 @@
+#ifndef __EXPANDOS_H
+#define __EXPANDOS_H
+
+/* first argument of signal must match to active .. */
+typedef enum {
+        EXPANDO_ARG_NONE = 1,
+        EXPANDO_ARG_SERVER,
+        EXPANDO_ARG_WINDOW,
+	EXPANDO_ARG_WINDOW_ITEM,
+
+	EXPANDO_NEVER /* special: expando never changes */
+} ExpandoArg;
+
+typedef char* (*EXPANDO_FUNC)
+	(SERVER_REC *server, void *item, int *free_ret);
+
+/* Create expando - overrides any existing ones.
+   ... = signal, type, ..., NULL - list of signals that might change the
+   value of this expando */
+void expando_create(const char *key, EXPANDO_FUNC func, ...);
+/* Destroy expando */
+void expando_destroy(const char *key, EXPANDO_FUNC func);
+
+#endif
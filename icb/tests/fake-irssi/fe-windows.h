@@ -0,0 +1,19 @@
+#ifndef __WINDOWS_H
+#define __WINDOWS_H
+
+typedef struct _WI_ITEM_REC WI_ITEM_REC;
+
+typedef struct {
+	int refnum;
+	char *name;
+
+	GSList *items;
+	WI_ITEM_REC *active;
+} WINDOW_REC;
+
+extern GSList *windows;
+extern WINDOW_REC *active_win;
+
+void window_set_active(WINDOW_REC *window);
+
+#endif
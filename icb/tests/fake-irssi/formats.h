@@ -0,0 +1,14 @@
+#ifndef __FORMATS_H
+#define __FORMATS_H
+
+#define MAX_FORMAT_PARAMS 10
+
+typedef struct {
+	char *tag;
+	char *def;
+
+	int params;
+	int paramtypes[MAX_FORMAT_PARAMS];
+} FORMAT_REC;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __MISC_H
+#define __MISC_H
+
+/* return full path for ~/.irssi */
+char *convert_home(const char *path);
+
+/* Return the time difference in milliseconds. */
+long get_timeval_diff(const GTimeVal *tv1, const GTimeVal *tv2);
+
+/* Case-insensitive string hash functions */
+int g_istr_equal(gconstpointer v, gconstpointer v2);
+unsigned int g_istr_hash(gconstpointer v);
+
+/* child processes are reaped by the core */
+void pidwait_add(int pid);
+
+#endif
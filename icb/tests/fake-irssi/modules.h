@@ -0,0 +1,15 @@
+#ifndef __MODULES_H
+#define __MODULES_H
+
+#define MODULE_CHECK_CAST(object, cast, type_field, id) \
+	((cast *) module_check_cast(object, offsetof(cast, type_field), id))
+
+void *module_check_cast(void *object, int type_pos, const char *id);
+
+/* "SERVER", "CHANNEL", signal names etc. mapped to small unique ids */
+int module_get_uniq_id(const char *module, int id);
+int module_get_uniq_id_str(const char *module, const char *id);
+
+void module_register(const char *name, const char *submodule);
+
+#endif
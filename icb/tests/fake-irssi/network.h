@@ -0,0 +1,7 @@
+#ifndef __NETWORK_H
+#define __NETWORK_H
+
+/* Read data from socket, return number of bytes read, -1 = error */
+int net_receive(GIOChannel *handle, char *buf, int len);
+
+#endif
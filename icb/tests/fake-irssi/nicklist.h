@@ -0,0 +1,48 @@
+#ifndef __NICKLIST_H
+#define __NICKLIST_H
+
+/* Returns NICK_REC if it's nick, NULL if it isn't. */
+#define NICK(server) \
+	MODULE_CHECK_CAST(server, NICK_REC, type, "NICK")
+
+#define IS_NICK(server) \
+	(NICK(server) ? TRUE : FALSE)
+
+struct _NICK_REC {
+	int type; /* module_get_uniq_id("NICK", 0) */
+	int chat_type; /* chat_protocol_lookup() */
+
+	time_t last_check; /* last time gone was checked */
+
+	char *nick;
+	char *host;
+	char *realname;
+	int hops;
+
+	unsigned int gone:1;
+	unsigned int serverop:1;
+
+	unsigned int send_massjoin:1; /* Waiting to be sent in massjoin signal */
+	unsigned int op:1;
+	unsigned int halfop:1;
+	unsigned int voice:1;
+};
+
+/* Add new nick to list */
+void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick);
+/* Set host address for nick */
+void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick,
+		       const char *host);
+/* Remove nick from list */
+void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick);
+/* Change nick */
+void nicklist_rename(SERVER_REC *server, const char *old_nick,
+		     const char *new_nick);
+/* Find nick */
+NICK_REC *nicklist_find(CHANNEL_REC *channel, const char *nick);
+/* Get list of nicks */
+GSList *nicklist_getnicks(CHANNEL_REC *channel);
+/* Set own nick */
+void nicklist_set_own(CHANNEL_REC *channel, NICK_REC *nick);
+
+#endif
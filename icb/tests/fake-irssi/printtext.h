@@ -0,0 +1,15 @@
+#ifndef __PRINTTEXT_H
+#define __PRINTTEXT_H
+
+/* tests only: number of lines printed so far */
+extern unsigned long printtext_lines;
+
+void printformat_module(const char *module, void *server, const char *target,
+			int level, int formatnum, ...);
+#define printformat(server, target, level, formatnum...) \
+	printformat_module(MODULE_NAME, server, target, level, ##formatnum)
+
+void printtext(void *server, const char *target, int level,
+	       const char *text, ...);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __QUERIES_H
+#define __QUERIES_H
+
+/* Returns QUERY_REC if it's query, NULL if it isn't. */
+#define QUERY(query) \
+	MODULE_CHECK_CAST(query, QUERY_REC, type, "QUERY")
+
+#define IS_QUERY(query) \
+	(QUERY(query) ? TRUE : FALSE)
+
+struct _QUERY_REC {
+	int type; /* module_get_uniq_id("QUERY", 0) */
+	int chat_type;
+
+	SERVER_REC *server;
+	char *name;
+	char *server_tag;
+};
+
+void query_init(QUERY_REC *query, int automatic);
+void query_destroy(QUERY_REC *query);
+
+QUERY_REC *query_find(SERVER_REC *server, const char *nick);
+
+#endif
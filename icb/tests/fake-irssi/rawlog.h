@@ -0,0 +1,7 @@
+#ifndef __RAWLOG_H
+#define __RAWLOG_H
+
+void rawlog_input(RAWLOG_REC *rawlog, const char *str);
+void rawlog_output(RAWLOG_REC *rawlog, const char *str);
+
+#endif
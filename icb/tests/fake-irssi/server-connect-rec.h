@@ -0,0 +1,23 @@
+/* SERVER_CONNECT_REC definition, used for inheritance */
+
+int type;
+int chat_type;
+
+int refcount;
+
+char *address;
+int port;
+char *chatnet;
+
+char *password;
+char *nick;
+char *username;
+char *realname;
+
+/* when reconnecting, the old server status */
+char *channels;
+char *away_reason;
+
+unsigned int reconnection:1; /* we're trying to reconnect */
+unsigned int reconnecting:1; /* waiting in the reconnect queue */
+unsigned int no_autojoin_channels:1;
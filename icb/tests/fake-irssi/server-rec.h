@@ -0,0 +1,42 @@
+/* SERVER_REC definition, used for inheritance */
+
+int type; /* module_get_uniq_id("SERVER", 0) */
+int chat_type; /* chat_protocol_lookup(xx) */
+
+int refcount;
+
+STRUCT_SERVER_CONNECT_REC *connrec;
+time_t connect_time; /* connection time */
+time_t real_connect_time; /* time when server replied that we're connected */
+
+char *tag; /* tag name for addressing server */
+char *nick; /* current nick */
+
+unsigned int connected:1; /* connected to server */
+unsigned int disconnected:1; /* disconnected, waiting for refcount to drop zero */
+unsigned int connection_lost:1; /* Connection lost unintentionally */
+unsigned int session_reconnect:1; /* Connected to this server with /UPGRADE */
+
+int connect_tag; /* pending connect, -1 if none */
+
+NET_SENDBUF_REC *handle;
+int readtag; /* input tag */
+
+RAWLOG_REC *rawlog;
+
+GTimeVal lag_sent; /* 0 if we're not waiting for lag reply */
+time_t lag_last_check; /* last time we checked lag */
+int lag; /* server lag in milliseconds */
+
+GSList *channels;
+GSList *queries;
+
+/* -- support for protocol-specific functions -- */
+void (*channels_join)(SERVER_REC *server, const char *data, int automatic);
+int (*isnickflag)(char flag);
+int (*ischannel)(SERVER_REC *server, const char *data);
+const char *(*get_nick_flags)(void);
+void (*send_message)(SERVER_REC *server, const char *target,
+		     const char *msg, int target_type);
+
+#undef STRUCT_SERVER_CONNECT_REC
@@ -0,0 +1,16 @@
+#ifndef __SERVERS_SETUP_H
+#define __SERVERS_SETUP_H
+
+struct _SERVER_SETUP_REC {
+	int type;
+	int chat_type;
+
+	char *chatnet;
+	char *address;
+	int port;
+	char *password;
+	char *own_host;
+	unsigned int autoconnect:1;
+};
+
+#endif
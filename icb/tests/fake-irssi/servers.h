@@ -0,0 +1,52 @@
+#ifndef __SERVERS_H
+#define __SERVERS_H
+
+/* Returns SERVER_REC if it's server, NULL if it isn't. */
+#define SERVER(server) \
+	MODULE_CHECK_CAST(server, SERVER_REC, type, "SERVER")
+
+/* Returns SERVER_CONNECT_REC if it's server connection, NULL if it isn't. */
+#define SERVER_CONNECT(conn) \
+	MODULE_CHECK_CAST(conn, SERVER_CONNECT_REC, type, "SERVER CONNECT")
+
+#define IS_SERVER(server) \
+	(SERVER(server) ? TRUE : FALSE)
+
+#define IS_SERVER_CONNECT(conn) \
+	(SERVER_CONNECT(conn) ? TRUE : FALSE)
+
+/* all strings should be either NULL or dynamically allocated */
+/* address and nick are mandatory, rest are optional */
+struct _SERVER_CONNECT_REC {
+#include "server-connect-rec.h"
+};
+
+#define STRUCT_SERVER_CONNECT_REC SERVER_CONNECT_REC
+struct _SERVER_REC {
+#include "server-rec.h"
+};
+
+enum {
+	SEND_TARGET_CHANNEL,
+	SEND_TARGET_NICK
+};
+
+extern GSList *servers, *lookup_servers;
+
+/* Connect to server */
+void server_connect_init(SERVER_REC *server);
+int server_start_connect(SERVER_REC *server);
+void server_disconnect(SERVER_REC *server);
+
+void server_ref(SERVER_REC *server);
+int server_unref(SERVER_REC *server);
+
+void server_connect_ref(SERVER_CONNECT_REC *conn);
+void server_connect_unref(SERVER_CONNECT_REC *conn);
+
+SERVER_REC *server_find_tag(const char *tag);
+
+/* Change your nick */
+void server_change_nick(SERVER_REC *server, const char *nick);
+
+#endif
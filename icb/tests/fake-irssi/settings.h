@@ -0,0 +1,14 @@
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+void settings_add_int(const char *section, const char *key, int def);
+void settings_add_bool(const char *section, const char *key, int def);
+
+int settings_get_int(const char *key);
+int settings_get_bool(const char *key);
+
+/* tests only: change a setting, "setup changed" must be sent by caller */
+void settings_set_int(const char *key, int value);
+#define settings_set_bool settings_set_int
+
+#endif
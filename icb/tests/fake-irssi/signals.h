@@ -0,0 +1,31 @@
+#ifndef __SIGNAL_H
+#define __SIGNAL_H
+
+typedef void (*SIGNAL_FUNC) (gconstpointer, gconstpointer,
+			     gconstpointer, gconstpointer,
+			     gconstpointer, gconstpointer,
+			     gconstpointer);
+
+#define signal_get_uniq_id(signal) \
+        module_get_uniq_id_str("signals", signal)
+
+/* pos: 0 = first, 1 = default, 2 = last */
+void signal_add_to(const char *module, int pos,
+		   const char *signal, SIGNAL_FUNC func);
+#define signal_add(signal, func) \
+	signal_add_to(MODULE_NAME, 1, (signal), (SIGNAL_FUNC) (func))
+#define signal_add_first(signal, func) \
+	signal_add_to(MODULE_NAME, 0, (signal), (SIGNAL_FUNC) (func))
+#define signal_add_last(signal, func) \
+	signal_add_to(MODULE_NAME, 2, (signal), (SIGNAL_FUNC) (func))
+
+void signal_remove(const char *signal, SIGNAL_FUNC func);
+
+/* Returns TRUE if anyone was listening */
+int signal_emit(const char *signal, int params, ...);
+int signal_emit_id(int signal_id, int params, ...);
+
+/* stop the current ongoing signal emission */
+void signal_stop(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __THEMES_H
+#define __THEMES_H
+
+#include "formats.h"
+
+#define theme_register(formats) theme_register_module(MODULE_NAME, formats)
+void theme_register_module(const char *module, FORMAT_REC *formats);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __WINDOW_ITEMS_H
+#define __WINDOW_ITEMS_H
+
+#include "fe-windows.h"
+
+/* Find a window for `item', NULL if it isn't in any */
+WINDOW_REC *window_item_window(WI_ITEM_REC *item);
+void window_item_set_active(WINDOW_REC *window, WI_ITEM_REC *item);
+
+#endif
@@ -0,0 +1,1701 @@
+/*
+ test-protocol.c : ICB protocol handling tests and benchmarks
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The server used here is connected to one end of a socketpair, and the
+   packets are given to it with icb_protocol_feed() */
+
+#define MODULE_NAME "test-protocol"
+
+#include "common.h"
+#include "signals.h"
+#include "settings.h"
+#include "servers.h"
+#include "servers-reconnect.h"
+#include "channels.h"
+#include "commands.h"
+#include "printtext.h"
+
+#include "icb.h"
+#include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-protocol.h"
+#include "icb-buffers.h"
+#include "icb-pool.h"
+#include "icb-capture.h"
+
+#include "fake-irssi.h"
+
+#include <sys/socket.h>
+#include <fcntl.h>
+/* AddressSanitizer has its own malloc() */
+#if defined (__GLIBC__) && !defined (__SANITIZE_ADDRESS__)
+#  define COUNT_ALLOCS
+#  include <malloc.h>
+#endif
+
+void icb_core_init(void);
+void icb_core_deinit(void);
+void fe_icb_init(void);
+void fe_icb_deinit(void);
+
+static int failures;
+
+#define test_assert(cond) \
+	G_STMT_START { \
+	  if (!(cond)) { \
+		  fprintf(stderr, "%s:%d: assert failed: %s\n", \
+			  __FILE__, __LINE__, #cond); \
+		  failures++; \
+	  } \
+	} G_STMT_END
+
+/* Append ICB frames of a packet to str */
+static void packet_append(GString *str, int type, const char *data)
+{
+	int len, pos, size;
+
+	/* payload is the type, data and \0 */
+	len = strlen(data) + 2;
+	pos = 0;
+	while (pos < len) {
+		size = len-pos > 255 ? 255 : len-pos;
+		g_string_append_c(str, len-pos > 255 ? 0 : size);
+		for (; size > 0; size--, pos++) {
+			g_string_append_c(str, pos == 0 ? type :
+					  pos == len-1 ? '\0' : data[pos-1]);
+		}
+	}
+}
+
+/* what the module sends is kept here when it's set */
+static GString *peer_data;
+
+static int peer_input(GIOChannel *source, GIOCondition condition,
+		      void *data)
+{
+	char buf[4096];
+	int i, ret;
+
+	ret = read(g_io_channel_unix_get_fd(source), buf, sizeof(buf));
+	if (ret > 0) {
+		for (i = 0; peer_data != NULL && i < ret; i++)
+			g_string_append_c(peer_data, buf[i]);
+		return TRUE;
+	}
+
+	close(g_io_channel_unix_get_fd(source));
+	g_io_channel_unref(source);
+	return FALSE;
+}
+
+/* the other end of the last test server's socket */
+static int peer_fd;
+
+/* Create a server that has logged in to group "1" */
+static ICB_SERVER_REC *test_server_new(void)
+{
+	SERVER_CONNECT_REC *conn;
+	ICB_SERVER_REC *server;
+	GIOChannel *peer;
+	GString *str;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair()");
+		exit(1);
+	}
+	fake_connect_use_fd(fds[0]);
+	peer_fd = fds[1];
+
+	peer = g_io_channel_unix_new(fds[1]);
+	g_io_add_watch(peer, G_IO_IN | G_IO_HUP | G_IO_ERR,
+		       (GIOFunc) peer_input, NULL);
+
+	conn = fake_connect_rec("ICB", "127.0.0.1", 7326, "tester", "1");
+	server = ICB_SERVER(fake_server_connect(conn));
+	server_connect_unref(conn);
+
+	/* connect */
+	while (server->handle == NULL)
+		g_main_iteration(TRUE);
+
+	str = g_string_new(NULL);
+	packet_append(str, 'j', "1\001localhost\001fake");
+	packet_append(str, 'a', "");
+	packet_append(str, 'd', "Status\001You are now in group 1");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+
+	test_assert(server->connected && server->group != NULL);
+	return server;
+}
+
+static void test_server_destroy(ICB_SERVER_REC *server)
+{
+	if (g_slist_find(servers, server) != NULL)
+		server_disconnect(SERVER(server));
+}
+
+/* ---- read path ---- */
+
+#define BURST_PACKETS 100000
+
+/* icb_read_packet() as it was before it started returning the packets
+   in place: every packet is moved to the beginning of recvbuf */
+typedef struct {
+	const unsigned char *data;
+	int pos, len;
+
+	unsigned char *recvbuf;
+	int recvbuf_size, recvbuf_pos, recvbuf_next_packet;
+} OLD_READER_REC;
+
+static int old_read_packet(OLD_READER_REC *rec, int read_socket)
+{
+	char tmpbuf[512];
+	int ret, pos, wpos, size;
+
+	if (rec->recvbuf_next_packet > 0) {
+		g_memmove(rec->recvbuf,
+			  rec->recvbuf+rec->recvbuf_next_packet,
+			  rec->recvbuf_pos - rec->recvbuf_next_packet);
+		rec->recvbuf_pos -= rec->recvbuf_next_packet;
+		rec->recvbuf_next_packet = 0;
+	}
+
+	ret = 0;
+	if (read_socket) {
+		ret = rec->len - rec->pos;
+		if (ret > (int) sizeof(tmpbuf)) ret = sizeof(tmpbuf);
+		memcpy(tmpbuf, rec->data + rec->pos, ret);
+		rec->pos += ret;
+	}
+	if (ret > 0) {
+		if (rec->recvbuf_pos + ret > rec->recvbuf_size) {
+			rec->recvbuf_size += ret + 256;
+			rec->recvbuf = g_realloc(rec->recvbuf,
+						 rec->recvbuf_size);
+		}
+		memcpy(rec->recvbuf+rec->recvbuf_pos, tmpbuf, ret);
+		rec->recvbuf_pos += ret;
+	}
+
+	pos = 0;
+	while (pos < rec->recvbuf_pos) {
+		if (rec->recvbuf[pos] != 0) {
+			pos += rec->recvbuf[pos];
+			break;
+		}
+		pos += 256;
+	}
+
+	if (pos >= rec->recvbuf_pos)
+		return 0;
+
+	pos = wpos = 0;
+	while (pos < rec->recvbuf_pos) {
+		if (rec->recvbuf[pos] != 0) {
+			size = rec->recvbuf[pos];
+			g_memmove(rec->recvbuf+wpos, rec->recvbuf+pos+1, size);
+			pos += size+1;
+			wpos += size;
+			break;
+		}
+
+		g_memmove(rec->recvbuf+wpos, rec->recvbuf+pos+1, 255);
+		pos += 256;
+		wpos += 255;
+	}
+
+	rec->recvbuf[wpos] = '\0';
+	rec->recvbuf_next_packet = pos;
+	return 1;
+}
+
+static int read_packets;
+
+static void event_count(ICB_SERVER_REC *server, char **args)
+{
+	read_packets++;
+}
+
+/* A burst of open messages, every long_every'th of them over 255 bytes
+   so that it needs several frames. 0 = no long messages */
+static GString *burst_create(int count, int long_every)
+{
+	GString *str;
+	char *text;
+	int i, len;
+
+	str = g_string_new(NULL);
+	text = g_malloc(800);
+	for (i = 0; i < count; i++) {
+		len = long_every != 0 && i % long_every == 0 ?
+			300 + i % 400 : 20 + i % 180;
+		len += sprintf(text, "nick%d\001", i % 50);
+		memset(text + strlen(text), 'x', len - strlen(text));
+		text[len] = '\0';
+		packet_append(str, 'b', text);
+	}
+	g_free(text);
+	return str;
+}
+
+static void bench_read(const char *name, GString *burst)
+{
+	ICB_SERVER_REC *server;
+	OLD_READER_REC old;
+	double start, old_usecs, new_usecs;
+	int count, id;
+
+	id = signal_get_uniq_id("icb fields open");
+
+	/* before: the old reader, MAX_SOCKET_READS reads per wakeup */
+	memset(&old, 0, sizeof(old));
+	old.data = (unsigned char *) burst->str;
+	old.len = burst->len;
+	read_packets = 0;
+	start = fake_time_usecs();
+	while (old.pos < old.len) {
+		count = 0;
+		while (old_read_packet(&old, count < 5) > 0) {
+			signal_emit_id(id, 2, NULL, old.recvbuf+1);
+			count++;
+		}
+	}
+	old_usecs = fake_time_usecs() - start;
+	test_assert(read_packets == BURST_PACKETS);
+	g_free(old.recvbuf);
+
+	/* after */
+	server = test_server_new();
+	read_packets = 0;
+	start = fake_time_usecs();
+	icb_protocol_feed(server, (unsigned char *) burst->str, burst->len);
+	new_usecs = fake_time_usecs() - start;
+	test_assert(read_packets == BURST_PACKETS);
+	test_server_destroy(server);
+
+	printf("read %s: %d packets, before %.0f packets/sec, "
+	       "after %.0f packets/sec\n", name, BURST_PACKETS,
+	       BURST_PACKETS / (old_usecs / 1000000.0),
+	       BURST_PACKETS / (new_usecs / 1000000.0));
+}
+
+static void test_read(void)
+{
+	GString *burst;
+
+	signal_add("icb fields open", (SIGNAL_FUNC) event_count);
+
+	burst = burst_create(BURST_PACKETS, 0);
+	bench_read("single frames", burst);
+	g_string_free(burst, TRUE);
+
+	burst = burst_create(BURST_PACKETS, 20);
+	bench_read("with long packets", burst);
+	g_string_free(burst, TRUE);
+
+	signal_remove("icb fields open", (SIGNAL_FUNC) event_count);
+}
+
+#define BUDGET_PACKETS 150
+
+/* Write BUDGET_PACKETS packets to the server's socket at once and
+   return the number of wakeups used for handling them */
+static int budget_wakeups(int max_time, int max_bytes)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char text[201];
+	unsigned long wakeups, latency;
+	int i;
+
+	settings_set_int("icb_read_max_time", max_time);
+	settings_set_int("icb_read_max_bytes", max_bytes);
+	signal_emit("setup changed", 0);
+
+	server = test_server_new();
+	memset(text, 'x', 200); text[200] = '\0';
+	memcpy(text, "nick\001", 5);
+	str = g_string_new(NULL);
+	for (i = 0; i < BUDGET_PACKETS; i++)
+		packet_append(str, 'b', text);
+
+	latency = 0;
+	for (i = 0; i < ICB_LATENCY_BUCKETS; i++)
+		latency += server->read_latency[i];
+	wakeups = server->wakeups;
+	read_packets = 0;
+
+	test_assert(write(peer_fd, str->str, str->len) == (int) str->len);
+	for (i = 0; i < 10000 && read_packets < BUDGET_PACKETS; i++)
+		g_main_iteration(FALSE);
+	test_assert(read_packets == BUDGET_PACKETS);
+	g_string_free(str, TRUE);
+
+	/* every packet got its latency counted */
+	for (i = 0; i < ICB_LATENCY_BUCKETS; i++)
+		latency -= server->read_latency[i];
+	test_assert(latency + BUDGET_PACKETS == 0);
+
+	wakeups = server->wakeups - wakeups;
+	test_assert(server->recvbuf_next_packet == server->recvbuf_pos);
+	test_server_destroy(server);
+	return wakeups;
+}
+
+static void test_read_budget(void)
+{
+	signal_add("icb fields open", (SIGNAL_FUNC) event_count);
+
+	/* with a large budget the socket is drained in one wakeup */
+	test_assert(budget_wakeups(1000000, 1024*1024) == 1);
+	/* the byte and time limits each leave the rest for later */
+	test_assert(budget_wakeups(1000000, 1024) > 1);
+	test_assert(budget_wakeups(0, 1024*1024) > 1);
+
+	settings_set_int("icb_read_max_time", 20000);
+	settings_set_int("icb_read_max_bytes", 16384);
+	signal_emit("setup changed", 0);
+	signal_remove("icb fields open", (SIGNAL_FUNC) event_count);
+}
+
+/* ---- dispatching ---- */
+
+#define DISPATCH_PACKETS 100000
+
+static const char *packet_names[] = {
+	"login", "open", "personal", "status", "error", "important", "exit",
+	"command", "cmdout", "protocol", "beep", "ping", "pong"
+};
+
+#define PACKET_NAMES_COUNT (sizeof(packet_names)/sizeof(packet_names[0]))
+
+static int dispatched[PACKET_NAMES_COUNT];
+
+/* the first handler of every event, so that nothing else is run */
+#define EVENT_STOP_FUNC(n) \
+	static void event_stop_##n(void *server, char **args) \
+	{ dispatched[n]++; signal_stop(); }
+
+EVENT_STOP_FUNC(0) EVENT_STOP_FUNC(1) EVENT_STOP_FUNC(2)
+EVENT_STOP_FUNC(3) EVENT_STOP_FUNC(4) EVENT_STOP_FUNC(5)
+EVENT_STOP_FUNC(6) EVENT_STOP_FUNC(7) EVENT_STOP_FUNC(8)
+EVENT_STOP_FUNC(9) EVENT_STOP_FUNC(10) EVENT_STOP_FUNC(11)
+EVENT_STOP_FUNC(12)
+
+static SIGNAL_FUNC event_stop_funcs[PACKET_NAMES_COUNT] = {
+	(SIGNAL_FUNC) event_stop_0, (SIGNAL_FUNC) event_stop_1,
+	(SIGNAL_FUNC) event_stop_2, (SIGNAL_FUNC) event_stop_3,
+	(SIGNAL_FUNC) event_stop_4, (SIGNAL_FUNC) event_stop_5,
+	(SIGNAL_FUNC) event_stop_6, (SIGNAL_FUNC) event_stop_7,
+	(SIGNAL_FUNC) event_stop_8, (SIGNAL_FUNC) event_stop_9,
+	(SIGNAL_FUNC) event_stop_10, (SIGNAL_FUNC) event_stop_11,
+	(SIGNAL_FUNC) event_stop_12
+};
+
+static void test_dispatch(void)
+{
+	ICB_SERVER_REC *server;
+	GString *burst;
+	char name[100], *data;
+	double start, old_usecs, new_usecs, feed_usecs;
+	unsigned int type;
+	int i, id;
+
+	server = test_server_new();
+	for (type = 0; type < PACKET_NAMES_COUNT; type++) {
+		sprintf(name, "icb fields %s", packet_names[type]);
+		signal_add_first(name, event_stop_funcs[type]);
+	}
+
+	data = "nick\001some text that looks like a message\001x";
+	for (type = 0; type < PACKET_NAMES_COUNT; type++) {
+		/* before: the signal name was built for every packet */
+		dispatched[type] = 0;
+		start = fake_time_usecs();
+		for (i = 0; i < DISPATCH_PACKETS; i++) {
+			strcpy(name, "icb fields ");
+			strcat(name, packet_names[type]);
+			signal_emit(name, 2, server, data);
+		}
+		old_usecs = fake_time_usecs() - start;
+
+		/* after: precomputed signal id */
+		sprintf(name, "icb fields %s", packet_names[type]);
+		id = signal_get_uniq_id(name);
+		start = fake_time_usecs();
+		for (i = 0; i < DISPATCH_PACKETS; i++)
+			signal_emit_id(id, 2, server, data);
+		new_usecs = fake_time_usecs() - start;
+		test_assert(dispatched[type] == DISPATCH_PACKETS*2);
+
+		/* the whole receive path: framing, validating, dispatching */
+		burst = g_string_new(NULL);
+		for (i = 0; i < DISPATCH_PACKETS; i++)
+			packet_append(burst, 'a'+type, data);
+		start = fake_time_usecs();
+		icb_protocol_feed(server, (unsigned char *) burst->str,
+				  burst->len);
+		feed_usecs = fake_time_usecs() - start;
+		test_assert(dispatched[type] == DISPATCH_PACKETS*3);
+		g_string_free(burst, TRUE);
+
+		printf("dispatch %-9s: before %.0f ns/packet, "
+		       "after %.0f ns/packet, whole read path %.0f ns/packet\n",
+		       packet_names[type],
+		       old_usecs * 1000.0 / DISPATCH_PACKETS,
+		       new_usecs * 1000.0 / DISPATCH_PACKETS,
+		       feed_usecs * 1000.0 / DISPATCH_PACKETS);
+	}
+	test_server_destroy(server);
+
+	for (type = 0; type < PACKET_NAMES_COUNT; type++) {
+		sprintf(name, "icb fields %s", packet_names[type]);
+		signal_remove(name, event_stop_funcs[type]);
+	}
+}
+
+/* ---- decoding ---- */
+
+#define DECODE_PACKETS 1000000
+#define DECODE_HANDLERS 3
+
+static char *decoded_nick, *decoded_text;
+static char checked_nick[64], checked_text[64];
+
+static void decode_old_handler(ICB_SERVER_REC *server, const char *data)
+{
+	char *args[2];
+	int found;
+
+	found = icb_split_inplace((char *) data, args, 2);
+	decoded_nick = args[0]; decoded_text = args[1];
+	icb_split_restore(args, found);
+}
+
+static void decode_new_handler(ICB_SERVER_REC *server, char **args)
+{
+	decoded_nick = args[0]; decoded_text = args[1];
+}
+
+static void decode_check_handler(ICB_SERVER_REC *server, char **args)
+{
+	g_snprintf(checked_nick, sizeof(checked_nick), "%s", args[0]);
+	g_snprintf(checked_text, sizeof(checked_text), "%s", args[1]);
+}
+
+static void decode_string_handler(ICB_SERVER_REC *server, const char *data)
+{
+	g_snprintf(checked_text, sizeof(checked_text), "%s", data);
+}
+
+static void test_decode(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char data[] = "nick\001some text that looks like a message";
+	char *args[3];
+	const char *p;
+	double start, old_usecs, new_usecs;
+	unsigned long malformed;
+	int i, n, fields, found, old_id, new_id;
+
+	/* extra ^As stay in the last field */
+	server = test_server_new();
+	signal_add_first("icb fields open", (SIGNAL_FUNC) decode_check_handler);
+	str = g_string_new(NULL);
+	packet_append(str, 'b', "nick\001text\001with\001separators");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	test_assert(strcmp(checked_nick, "nick") == 0);
+	test_assert(strcmp(checked_text, "text\001with\001separators") == 0);
+	signal_remove("icb fields open", (SIGNAL_FUNC) decode_check_handler);
+
+	/* "icb event" still gets the whole data, after the split fields */
+	signal_add("icb event open", (SIGNAL_FUNC) decode_string_handler);
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	test_assert(strcmp(checked_text,
+			   "nick\001text\001with\001separators") == 0);
+	signal_remove("icb event open", (SIGNAL_FUNC) decode_string_handler);
+
+	/* a packet without the \0 at the end keeps its last character,
+	   and the packet after it isn't touched */
+	g_string_truncate(str, 0);
+	g_string_append_c(str, 8);
+	g_string_append(str, "bnick\001hi");
+	packet_append(str, 'b', "next\001packet");
+	signal_add_first("icb fields open", (SIGNAL_FUNC) decode_check_handler);
+	icb_protocol_feed(server, (unsigned char *) str->str, 9);
+	test_assert(strcmp(checked_nick, "nick") == 0);
+	test_assert(strcmp(checked_text, "hi") == 0);
+	icb_protocol_feed(server, (unsigned char *) str->str+9, str->len-9);
+	test_assert(strcmp(checked_nick, "next") == 0);
+	test_assert(strcmp(checked_text, "packet") == 0);
+	g_string_truncate(str, 0);
+	g_string_append_c(str, 8);
+	g_string_append(str, "bnick\001hi");
+	packet_append(str, 'b', "next\001packet");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	test_assert(strcmp(checked_nick, "next") == 0);
+	test_assert(strcmp(checked_text, "packet") == 0);
+	signal_remove("icb fields open", (SIGNAL_FUNC) decode_check_handler);
+
+	/* too few fields */
+	malformed = server->recv_malformed;
+	g_string_truncate(str, 0);
+	packet_append(str, 'd', "Status only");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	test_assert(server->recv_malformed == malformed+1);
+	g_string_free(str, TRUE);
+	test_server_destroy(server);
+
+	/* before: the fields were counted, and then split again by every
+	   handler. after: split once and the fields given to handlers. */
+	for (i = 0; i < DECODE_HANDLERS; i++) {
+		signal_add("test decode old", (SIGNAL_FUNC) decode_old_handler);
+		signal_add("test decode new", (SIGNAL_FUNC) decode_new_handler);
+	}
+	old_id = signal_get_uniq_id("test decode old");
+	new_id = signal_get_uniq_id("test decode new");
+
+	start = fake_time_usecs();
+	for (n = 0; n < DECODE_PACKETS; n++) {
+		fields = 1;
+		for (p = data; fields < 2; p++) {
+			p = strchr(p, '\001');
+			if (p == NULL) break;
+			fields++;
+		}
+		signal_emit_id(old_id, 2, NULL, data);
+	}
+	old_usecs = fake_time_usecs() - start;
+
+	start = fake_time_usecs();
+	for (n = 0; n < DECODE_PACKETS; n++) {
+		found = icb_split_inplace(data, args, 2);
+		args[found] = NULL;
+		signal_emit_id(new_id, 2, NULL, args);
+		icb_split_restore(args, found);
+	}
+	new_usecs = fake_time_usecs() - start;
+	test_assert(strcmp(decoded_text, "some text that looks like a message") == 0);
+
+	for (i = 0; i < DECODE_HANDLERS; i++) {
+		signal_remove("test decode old", (SIGNAL_FUNC) decode_old_handler);
+		signal_remove("test decode new", (SIGNAL_FUNC) decode_new_handler);
+	}
+
+	printf("decode: %d handlers, before %.0f ns/packet, "
+	       "after %.0f ns/packet\n", DECODE_HANDLERS,
+	       old_usecs * 1000.0 / DECODE_PACKETS,
+	       new_usecs * 1000.0 / DECODE_PACKETS);
+}
+
+/* ---- allocations ---- */
+
+#ifdef COUNT_ALLOCS
+/* glibc lets malloc() be replaced, so every allocation glib and the
+   module do can be counted */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+#define QUARANTINE_SIZE 64
+
+static unsigned long alloc_count;
+static int quarantine_enabled, quarantine_count;
+static void *quarantine[QUARANTINE_SIZE];
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (ptr != NULL && quarantine_enabled &&
+	    quarantine_count < QUARANTINE_SIZE) {
+		/* keep the memory, so writes to it can be noticed */
+		memset(ptr, 0xdd, malloc_usable_size(ptr));
+		quarantine[quarantine_count++] = ptr;
+		return;
+	}
+	__libc_free(ptr);
+}
+
+/* Stop keeping freed memory. Returns FALSE if any of it was written to
+   after it was freed. */
+static int quarantine_release(void)
+{
+	unsigned char *p;
+	size_t i, size;
+	int ok;
+
+	quarantine_enabled = FALSE;
+
+	ok = TRUE;
+	while (quarantine_count > 0) {
+		p = quarantine[--quarantine_count];
+		size = malloc_usable_size(p);
+		for (i = 0; i < size; i++) {
+			if (p[i] != 0xdd) {
+				ok = FALSE;
+				break;
+			}
+		}
+		__libc_free(p);
+	}
+	return ok;
+}
+#endif
+
+/* ---- splitting fields ---- */
+
+#define SPLIT_PACKETS 10000
+
+static int public_count;
+
+static void sig_message_public(void *server, const char *msg,
+			       const char *nick, const char *address,
+			       const char *target)
+{
+	test_assert(strcmp(nick, "nick") == 0);
+	test_assert(strncmp(msg, "hello", 5) == 0);
+	public_count++;
+}
+
+static void sig_disconnect(ICB_SERVER_REC *server)
+{
+	/* the rest of the handlers would see freed data */
+	server_disconnect(SERVER(server));
+	signal_stop();
+}
+
+static void sig_disconnect_channel(CHANNEL_REC *channel)
+{
+	sig_disconnect(ICB_SERVER(channel->server));
+}
+
+/* Handler disconnecting the server in the middle of a packet must not
+   make the module write to the freed recvbuf */
+static void test_split_disconnect(const char *signal, SIGNAL_FUNC func,
+				  int type, const char *data)
+{
+#ifdef COUNT_ALLOCS
+	ICB_SERVER_REC *server;
+	GString *burst;
+
+	server = test_server_new();
+	burst = g_string_new(NULL);
+	packet_append(burst, type, data);
+	packet_append(burst, 'b', "nick\001hello after disconnect");
+
+	signal_add_first(signal, func);
+	quarantine_enabled = TRUE;
+	public_count = 0;
+
+	icb_protocol_feed(server, (unsigned char *) burst->str, burst->len);
+
+	test_assert(quarantine_release());
+	test_assert(public_count == 0);
+	signal_remove(signal, func);
+	g_string_free(burst, TRUE);
+#endif
+}
+
+static void test_split(void)
+{
+	ICB_SERVER_REC *server;
+	GString *burst;
+	int i;
+
+	fe_icb_init();
+	signal_add("message public", (SIGNAL_FUNC) sig_message_public);
+
+	server = test_server_new();
+	burst = g_string_new(NULL);
+	for (i = 0; i < SPLIT_PACKETS; i++)
+		packet_append(burst, 'b', "nick\001hello there, everyone");
+
+	/* once to get the buffers to their final size */
+	icb_protocol_feed(server, (unsigned char *) burst->str, burst->len);
+	test_assert(public_count == SPLIT_PACKETS);
+
+#ifdef COUNT_ALLOCS
+	alloc_count = 0;
+#endif
+	icb_protocol_feed(server, (unsigned char *) burst->str, burst->len);
+#ifdef COUNT_ALLOCS
+	printf("split: %lu allocations for %d open messages\n",
+	       alloc_count, SPLIT_PACKETS);
+	test_assert(alloc_count == 0);
+#else
+	printf("split: allocations can't be counted here\n");
+#endif
+	test_assert(public_count == SPLIT_PACKETS*2);
+	g_string_free(burst, TRUE);
+	test_server_destroy(server);
+
+	test_split_disconnect("message public", (SIGNAL_FUNC) sig_disconnect,
+			      'b', "nick\001hello");
+	test_split_disconnect("message private", (SIGNAL_FUNC) sig_disconnect,
+			      'c', "nick\001hello");
+	test_split_disconnect("nicklist new",
+			      (SIGNAL_FUNC) sig_disconnect_channel, 'd',
+			      "Arrive\001newnick (user@host) entered group");
+	test_split_disconnect("channel name changed",
+			      (SIGNAL_FUNC) sig_disconnect_channel, 'd',
+			      "Status\001You are now in group 2");
+	test_split_disconnect("default icb cmdout",
+			      (SIGNAL_FUNC) sig_disconnect, 'i',
+			      "co\001Group: 1 (rvl)");
+
+	signal_remove("message public", (SIGNAL_FUNC) sig_message_public);
+	fe_icb_deinit();
+}
+
+/* ---- cmdout ---- */
+
+#define WHO_USERS 10000
+
+static int inner_count;
+
+static void sig_cmdout_inner(ICB_SERVER_REC *server, char **args)
+{
+	test_assert(strcmp(args[0], "inner") == 0);
+	inner_count++;
+}
+
+static void sig_cmdout_outer(ICB_SERVER_REC *server, char **args)
+{
+	char *inner[] = { "tu", "inner", "line", "with", "more", NULL };
+
+	/* another cmdout handled while this one is still running */
+	signal_emit("icb fields cmdout", 2, server, inner);
+
+	test_assert(strcmp(args[0], "a") == 0);
+	test_assert(args[1] != NULL && strcmp(args[1], "b") == 0);
+	test_assert(args[2] == NULL);
+}
+
+static GString *who_create(int users)
+{
+	GString *str;
+	char line[256];
+	int i;
+
+	str = g_string_new(NULL);
+	packet_append(str, 'i', "co\001Group: 1  (rvl) Mod: nobody");
+	for (i = 0; i < users; i++) {
+		sprintf(line, "wl\001 \001user%d\0010\0010\001900000000"
+			"\001login%d\001host%d.example.org\001(nr)", i, i, i);
+		packet_append(str, 'i', line);
+	}
+	packet_append(str, 'i', "co\001Total: 1 group");
+	return str;
+}
+
+/* event_cmdout() as it was before the signal ids were cached */
+static void old_event_cmdout(ICB_SERVER_REC *server, char **fields)
+{
+	char **args, *event;
+	int i;
+
+	/* it got the packet unsplit */
+	for (i = 1; fields[i] != NULL; i++)
+		fields[i][-1] = '\001';
+
+	args = g_strsplit(fields[0], "\001", -1);
+	if (args[0] != NULL) {
+		event = g_strdup_printf("icb cmdout %s", args[0]);
+		if (!signal_emit(event, 2, server, args+1))
+			signal_emit("default icb cmdout", 2, server, args);
+		g_free(event);
+	}
+	g_strfreev(args);
+
+	for (i = 1; fields[i] != NULL; i++)
+		fields[i][-1] = '\0';
+}
+
+static void test_cmdout(void)
+{
+	ICB_SERVER_REC *server;
+	GString *who;
+	double start, old_usecs, new_usecs;
+	unsigned long old_allocs, new_allocs;
+
+	/* nested cmdouts */
+	signal_add("icb cmdout tt", (SIGNAL_FUNC) sig_cmdout_outer);
+	signal_add("icb cmdout tu", (SIGNAL_FUNC) sig_cmdout_inner);
+
+	server = test_server_new();
+	who = g_string_new(NULL);
+	packet_append(who, 'i', "tt\001a\001b");
+	icb_protocol_feed(server, (unsigned char *) who->str, who->len);
+	test_assert(inner_count == 1);
+	g_string_free(who, TRUE);
+	test_server_destroy(server);
+
+	signal_remove("icb cmdout tt", (SIGNAL_FUNC) sig_cmdout_outer);
+	signal_remove("icb cmdout tu", (SIGNAL_FUNC) sig_cmdout_inner);
+
+	/* /who of a large group, before */
+	who = who_create(WHO_USERS);
+	server = test_server_new();
+	signal_add_first("icb fields cmdout", (SIGNAL_FUNC) old_event_cmdout);
+	signal_add_first("icb fields cmdout", (SIGNAL_FUNC) signal_stop);
+#ifdef COUNT_ALLOCS
+	alloc_count = 0;
+#endif
+	start = fake_time_usecs();
+	icb_protocol_feed(server, (unsigned char *) who->str, who->len);
+	old_usecs = fake_time_usecs() - start;
+#ifdef COUNT_ALLOCS
+	old_allocs = alloc_count;
+#else
+	old_allocs = 0;
+#endif
+	signal_remove("icb fields cmdout", (SIGNAL_FUNC) signal_stop);
+	signal_remove("icb fields cmdout", (SIGNAL_FUNC) old_event_cmdout);
+	test_assert(g_hash_table_size(CHANNEL(server->group)->nicks) ==
+		    WHO_USERS+1);
+	test_server_destroy(server);
+
+	/* after */
+	server = test_server_new();
+#ifdef COUNT_ALLOCS
+	alloc_count = 0;
+#endif
+	start = fake_time_usecs();
+	icb_protocol_feed(server, (unsigned char *) who->str, who->len);
+	new_usecs = fake_time_usecs() - start;
+#ifdef COUNT_ALLOCS
+	new_allocs = alloc_count;
+#else
+	new_allocs = 0;
+#endif
+	test_assert(g_hash_table_size(CHANNEL(server->group)->nicks) ==
+		    WHO_USERS+1);
+	test_server_destroy(server);
+	g_string_free(who, TRUE);
+
+	printf("who: %d users, before %.0f msecs and %lu allocations, "
+	       "after %.0f msecs and %lu allocations\n", WHO_USERS,
+	       old_usecs / 1000.0, old_allocs,
+	       new_usecs / 1000.0, new_allocs);
+}
+
+/* ---- send queue ---- */
+
+static void sendqueue_fill(int typed_first, int *interactive, int *bulk)
+{
+	ICB_SERVER_REC *server;
+	int i;
+
+	server = test_server_new();
+
+	/* one packet at once, and nothing drains during the test */
+	settings_set_int("icb_cmds_max_at_once", 1);
+	settings_set_int("icb_cmd_queue_speed", 60000);
+	settings_set_bool("icb_sendq_typed_first", typed_first);
+	signal_emit("setup changed", 0);
+
+	for (i = 0; i < 4; i++)
+		icb_send_open_msg(server, "pasted line");
+
+	*interactive = g_slist_length(server->sendq[ICB_SENDQ_INTERACTIVE]);
+	*bulk = g_slist_length(server->sendq[ICB_SENDQ_BULK]);
+	test_server_destroy(server);
+
+	settings_set_int("icb_cmds_max_at_once", 5);
+	settings_set_int("icb_cmd_queue_speed", 1000);
+	settings_set_bool("icb_sendq_typed_first", TRUE);
+	signal_emit("setup changed", 0);
+}
+
+static void test_sendqueue(void)
+{
+	int interactive, bulk;
+
+	/* the first queued message is guessed to be typed */
+	sendqueue_fill(TRUE, &interactive, &bulk);
+	test_assert(interactive == 1 && bulk == 2);
+
+	/* and isn't when the guessing is disabled */
+	sendqueue_fill(FALSE, &interactive, &bulk);
+	test_assert(interactive == 0 && bulk == 3);
+}
+
+/* ---- buffer shrinking ---- */
+
+static void test_shrink(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char *data;
+	unsigned long reallocs;
+	int big_size, i;
+
+	server = test_server_new();
+
+	/* grow recvbuf with one long packet */
+	data = g_malloc(5001);
+	memset(data, 'x', 5000); data[5000] = '\0';
+	memcpy(data, "nick\001", 5);
+	str = g_string_new(NULL);
+	packet_append(str, 'b', data);
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	g_free(data);
+	big_size = server->recvbuf_size;
+	test_assert(big_size > 5000);
+
+	settings_set_int("icb_buffer_shrink_time", 1);
+	signal_emit("setup changed", 0);
+
+	/* the first period still sees the peak, the second shrinks */
+	for (i = 0; i < 40 && server->recvbuf_size == big_size; i++)
+		fake_run_for(100);
+	test_assert(server->recvbuf_size < big_size);
+	test_assert(server->recvbuf_size >= ICB_READ_SIZE);
+
+	/* reading doesn't grow it back, and staying idle doesn't shrink
+	   it again */
+	reallocs = server->reallocs;
+	str = g_string_new(NULL);
+	packet_append(str, 'b', "nick\001short");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	fake_run_for(1100);
+	test_assert(server->reallocs == reallocs);
+
+	settings_set_int("icb_buffer_shrink_time", 300);
+	signal_emit("setup changed", 0);
+	test_server_destroy(server);
+}
+
+/* ---- lag ---- */
+
+static void lag_settings(int check_time, int max_lag)
+{
+	settings_set_int("icb_lag_check_time", check_time);
+	settings_set_int("icb_lag_max_before_disconnect", max_lag);
+	signal_emit("setup changed", 0);
+}
+
+static void wait_ping(ICB_SERVER_REC *server)
+{
+	int i;
+
+	for (i = 0; i < 50 && server->lag_sent.tv_sec == 0; i++)
+		fake_run_for(100);
+	test_assert(server->lag_sent.tv_sec != 0);
+}
+
+static void test_lag(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char id[64];
+
+	lag_settings(1, 2);
+
+	/* a server that never answers pings isn't disconnected */
+	server = test_server_new();
+	wait_ping(server);
+	fake_run_for(3500);
+	test_assert(g_slist_find(servers, server) != NULL);
+	test_assert(server->lag_no_pongs);
+	test_server_destroy(server);
+
+	/* but once it has answered, a missing pong is lag */
+	server = test_server_new();
+	wait_ping(server);
+	g_snprintf(id, sizeof(id), "irssi-lag %ld.%06ld",
+		   (long) server->lag_sent.tv_sec,
+		   (long) server->lag_sent.tv_usec);
+	str = g_string_new(NULL);
+	packet_append(str, 'm', id);
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	test_assert(server->lag_pong_seen);
+
+	wait_ping(server);
+	fake_run_for(3500);
+	test_assert(g_slist_find(servers, server) == NULL);
+
+	/* don't let it reconnect */
+	while (reconnects != NULL)
+		server_reconnect_destroy(reconnects->data);
+	lag_settings(60, 300);
+}
+
+/* ---- connection pool ---- */
+
+static int pool_reuses;
+
+static void sig_pool_reuse(ICB_SERVER_REC *server, ICB_CHANNEL_REC *group)
+{
+	test_assert(group != NULL);
+	pool_reuses++;
+}
+
+static void test_pool(void)
+{
+	ICB_SERVER_REC *server;
+
+	settings_set_int("icb_pool_size", 3);
+	signal_add("icb pool reuse", (SIGNAL_FUNC) sig_pool_reuse);
+	server = test_server_new();
+
+	/* connections that are still logging in fill the pool */
+	icb_pool_join(server, "2", FALSE);
+	icb_pool_join(server, "3", FALSE);
+	icb_pool_join(server, "2", FALSE);
+	test_assert(g_slist_length(lookup_servers) == 2);
+	icb_pool_join(server, "4", FALSE);
+	test_assert(g_slist_length(lookup_servers) == 2);
+
+	/* a connection moving to the group is reused silently */
+	test_assert(server->group_pending != NULL &&
+		    strcmp(server->group_pending, "4") == 0);
+	icb_pool_join(server, "4", FALSE);
+	test_assert(g_slist_length(lookup_servers) == 2);
+	test_assert(pool_reuses == 0);
+
+	/* and one parked there is shown */
+	icb_pool_join(server, "1", FALSE);
+	test_assert(pool_reuses == 1);
+
+	while (lookup_servers != NULL)
+		server_disconnect(lookup_servers->data);
+	test_server_destroy(server);
+
+	signal_remove("icb pool reuse", (SIGNAL_FUNC) sig_pool_reuse);
+	settings_set_int("icb_pool_size", 1);
+}
+
+/* ---- reconnect backoff ---- */
+
+static void test_reconnect(void)
+{
+	SERVER_CONNECT_REC *conn;
+	ICB_SERVER_REC *server, *pooled;
+	RECONNECT_REC *rec;
+
+	/* a queued reconnect waits for the backoff, not the 300s of
+	   server_reconnect_time */
+	server = test_server_new();
+	server->connection_lost = TRUE;
+	server_disconnect(SERVER(server));
+	test_assert(g_slist_length(reconnects) == 1);
+	rec = reconnects->data;
+	test_assert(rec->next_connect <= time(NULL) + 5);
+	test_assert(ICB_SERVER_CONNECT(rec->conn)->reconnect_attempts == 1);
+	server_reconnect_destroy(rec);
+
+	/* an immediate one waits in lookup_servers, where /DISCONNECT
+	   cancels it */
+	conn = fake_connect_rec("ICB", "127.0.0.1", 7326, "tester", "1");
+	conn->reconnection = TRUE;
+	server = ICB_SERVER(fake_server_connect(conn));
+	server_connect_unref(conn);
+	test_assert(g_slist_find(lookup_servers, server) != NULL);
+	test_assert(server->connect_tag != -1 && server->handle == NULL);
+	server_disconnect(SERVER(server));
+	test_assert(lookup_servers == NULL && reconnects == NULL);
+
+	/* pooled connects of a reconnected server don't wait */
+	settings_set_int("icb_pool_size", 2);
+	server = test_server_new();
+	server->connrec->reconnection = TRUE;
+	server->connrec->reconnect_attempts = 3;
+	icb_pool_join(server, "2", FALSE);
+	test_assert(g_slist_length(lookup_servers) == 1);
+	pooled = lookup_servers->data;
+	test_assert(!pooled->connrec->reconnection &&
+		    pooled->connrec->reconnect_attempts == 0);
+
+	while (lookup_servers != NULL)
+		server_disconnect(lookup_servers->data);
+	test_server_destroy(server);
+	settings_set_int("icb_pool_size", 1);
+}
+
+/* ---- group changes ---- */
+
+static void test_group_change(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+
+	server = test_server_new();
+
+	/* already there */
+	icb_change_channel(server, "1", FALSE);
+	test_assert(server->group_pending == NULL);
+
+	/* an error may be for some other command, the /G is still
+	   pending and can be tried again */
+	icb_change_channel(server, "deny", FALSE);
+	test_assert(server->group_pending != NULL);
+	str = g_string_new(NULL);
+	packet_append(str, 'e', "No such user");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	test_assert(server->group_pending != NULL &&
+		    strcmp(server->group_pending, "deny") == 0);
+	test_assert(server->group_pending_tag != -1);
+	icb_change_channel(server, "deny", FALSE);
+	test_assert(server->group_pending != NULL &&
+		    strcmp(server->group_pending, "deny") == 0);
+
+	/* confirmed one */
+	g_string_truncate(str, 0);
+	packet_append(str, 'd', "Status\001You are now in group deny");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	test_assert(server->group_pending == NULL);
+	test_assert(server->group_pending_tag == -1);
+	test_assert(strcmp(server->group->name, "deny") == 0);
+
+	/* back to the old group while the /G is pending */
+	icb_change_channel(server, "2", FALSE);
+	icb_change_channel(server, "deny", FALSE);
+	test_assert(server->group_pending != NULL &&
+		    strcmp(server->group_pending, "deny") == 0);
+
+	test_server_destroy(server);
+}
+
+/* Closing the group window leaves us in the group without a record */
+static void test_group_closed(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char *channels;
+
+	fe_icb_init();
+	signal_add("message public", (SIGNAL_FUNC) sig_message_public);
+	server = test_server_new();
+
+	channel_destroy(CHANNEL(server->group));
+	test_assert(server->group == NULL);
+	test_assert(!server->ischannel(SERVER(server), "1"));
+	channels = icb_server_get_channels(server);
+	test_assert(channels != NULL && strcmp(channels, "1") == 0);
+	g_free(channels);
+
+	public_count = 0;
+	str = g_string_new(NULL);
+	packet_append(str, 'd', "Status\001Someone did something");
+	packet_append(str, 'd', "Arrive\001newnick (user@host) entered group");
+	packet_append(str, 'd', "Topic\001nick changed the topic to \"x\"");
+	packet_append(str, 'b', "nick\001hello without a window");
+	packet_append(str, 'i', "co\001Group: 1 (rvl)");
+	packet_append(str, 'i', "wl\001 \001nick\0010\0010\0010\001u\001h");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+
+	test_assert(g_slist_find(servers, server) != NULL);
+	test_assert(public_count == 1);
+
+	/* /G opens the group window again */
+	icb_change_channel(server, "2", FALSE);
+	str = g_string_new(NULL);
+	packet_append(str, 'd', "Status\001You are now in group 2");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	test_assert(server->group != NULL &&
+		    strcmp(server->group->name, "2") == 0);
+	test_assert(server->group_pending == NULL);
+	test_assert(server->ischannel(SERVER(server), "2"));
+
+	test_server_destroy(server);
+	signal_remove("message public", (SIGNAL_FUNC) sig_message_public);
+	fe_icb_deinit();
+}
+
+/* ---- sending ---- */
+
+static GString *event_data;
+
+static void event_string(ICB_SERVER_REC *server, const char *data)
+{
+	g_string_truncate(event_data, 0);
+	g_string_append(event_data, data);
+}
+
+/* Check that the packet sent last is exactly expected, and that it reads
+   back as data */
+static void check_sent(ICB_SERVER_REC *server, int type,
+		       const char *data, GString *expected)
+{
+	char name[100];
+
+	g_string_truncate(peer_data, 0);
+	g_string_truncate(expected, 0);
+	packet_append(expected, type, data);
+	fake_run_for(50);
+
+	test_assert(peer_data->len == expected->len &&
+		    memcmp(peer_data->str, expected->str, expected->len) == 0);
+
+	sprintf(name, "icb event %s", packet_names[type-'a']);
+	signal_add(name, (SIGNAL_FUNC) event_string);
+	g_string_truncate(event_data, 0);
+	icb_protocol_feed(server, (unsigned char *) peer_data->str,
+			  peer_data->len);
+	test_assert(strcmp(event_data->str, data) == 0);
+	signal_remove(name, (SIGNAL_FUNC) event_string);
+}
+
+static ICB_SERVER_REC *send_test_start(void)
+{
+	ICB_SERVER_REC *server;
+
+	/* nothing but the packets, no lag pings */
+	settings_set_int("icb_cmds_max_at_once", 1000);
+	lag_settings(0, 300);
+
+	server = test_server_new();
+	fake_run_for(50);
+	peer_data = g_string_new(NULL);
+	event_data = g_string_new(NULL);
+	return server;
+}
+
+static void send_test_end(ICB_SERVER_REC *server)
+{
+	g_string_free(event_data, TRUE);
+	g_string_free(peer_data, TRUE);
+	peer_data = NULL;
+	test_server_destroy(server);
+
+	settings_set_int("icb_cmds_max_at_once", 5);
+	lag_settings(60, 300);
+}
+
+/* Packets longer than a frame are sent as full frames with 0 as their
+   length byte, and the last one with its real length */
+static void test_send_frames(void)
+{
+	static const int sizes[] = { 10, 253, 254, 300, 508, 509, 600, 4000 };
+	ICB_SERVER_REC *server;
+	GString *text, *expected;
+	unsigned int i;
+
+	server = send_test_start();
+	expected = g_string_new(NULL);
+	text = g_string_new(NULL);
+
+	for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+		/* open messages from server begin with the nick */
+		g_string_truncate(text, 0);
+		g_string_append(text, "nick\001");
+		while ((int) text->len < sizes[i])
+			g_string_append_c(text, 'a' + text->len % 26);
+
+		icb_send_open_msg(server, text->str);
+		check_sent(server, 'b', text->str, expected);
+	}
+
+	/* 4000 bytes and the type and \0 are 15 full frames and 177 bytes */
+	test_assert(expected->len == 4000+2 + 16);
+	test_assert(expected->str[0] == 0 && expected->str[256] == 0 &&
+		    (unsigned char) expected->str[15*256] == 177);
+
+	g_string_free(text, TRUE);
+	g_string_free(expected, TRUE);
+	send_test_end(server);
+}
+
+/* The fields are encoded into the frames piece by piece, so the frame
+   boundaries fall inside and between the pieces */
+static void test_send_iov(void)
+{
+	struct iovec iov[400];
+	ICB_SERVER_REC *server;
+	GString *text, *expected;
+	char big[600];
+	int i, count;
+
+	server = send_test_start();
+	expected = g_string_new(NULL);
+	text = g_string_new(NULL);
+
+	/* fields over several frames */
+	for (i = 0; i < (int) sizeof(big)-1; i++)
+		big[i] = 'a' + i % 26;
+	big[i] = '\0';
+	icb_command(server, "m", big, NULL);
+	g_string_append(text, "m\001");
+	g_string_append(text, big);
+	check_sent(server, 'h', text->str, expected);
+
+	icb_command(server, big, big, "id");
+	g_string_truncate(text, 0);
+	g_string_sprintfa(text, "%s\001%s\001id", big, big);
+	check_sent(server, 'h', text->str, expected);
+
+	/* single bytes over the first frame boundary, an empty piece,
+	   and a piece over the next two boundaries */
+	count = 0;
+	g_string_truncate(text, 0);
+	for (i = 0; i < 300; i++) {
+		iov[count].iov_base = big + i;
+		iov[count++].iov_len = 1;
+		g_string_append_c(text, big[i]);
+	}
+	iov[count].iov_base = big;
+	iov[count++].iov_len = 0;
+	iov[count].iov_base = big;
+	iov[count++].iov_len = sizeof(big)-1;
+	g_string_append(text, big);
+	icb_send_iov(server, 'h', iov, count);
+	check_sent(server, 'h', text->str, expected);
+
+	g_string_free(text, TRUE);
+	g_string_free(expected, TRUE);
+	send_test_end(server);
+}
+
+/* ---- capture and replay ---- */
+
+static ICB_SERVER_REC *capture_server, *replay_server;
+static GString *replayed;
+static int live_opens, replay_done;
+static unsigned long replay_bytes;
+
+static void capture_event_open(ICB_SERVER_REC *server, char **args)
+{
+	if (server == capture_server)
+		live_opens++;
+	else {
+		replay_server = server;
+		g_string_sprintfa(replayed, "%s;", args[1]);
+	}
+}
+
+static void sig_replay_finished(ICB_SERVER_REC *server, void *bytes)
+{
+	test_assert(server != capture_server);
+	test_assert(strstr(server->tag, "-replay") != NULL);
+	replay_bytes = GPOINTER_TO_INT(bytes);
+	replay_done = TRUE;
+}
+
+static void peer_send(const char *data, int len)
+{
+	test_assert(write(peer_fd, data, len) == len);
+	fake_run_for(50);
+}
+
+static void test_capture(void)
+{
+	GString *str;
+	char path[] = "/tmp/icb-capture-XXXXXX";
+	unsigned char header[ICB_CAPTURE_HEADER_LEN];
+	SERVER_REC *replay;
+	unsigned long sent;
+	char *tag;
+	int fd, half;
+
+	fd = mkstemp(path);
+	test_assert(fd != -1);
+	close(fd);
+
+	replayed = g_string_new(NULL);
+	signal_add("icb fields open", (SIGNAL_FUNC) capture_event_open);
+	signal_add("icb replay finished", (SIGNAL_FUNC) sig_replay_finished);
+	capture_server = test_server_new();
+
+	str = g_string_new(NULL);
+	packet_append(str, 'b', "nick\001first");
+	half = str->len;
+	packet_append(str, 'b', "nick\001second");
+	half += (str->len - half) / 2;
+	packet_append(str, 'l', "ping");
+	packet_append(str, 'b', "nick\001third");
+
+	/* start in the middle of the second packet */
+	peer_send(str->str, half);
+	test_assert(live_opens == 1);
+	test_assert(icb_capture_start(capture_server, path));
+	peer_send(str->str + half, str->len - half);
+	test_assert(live_opens == 3);
+	icb_capture_stop(capture_server);
+	g_string_free(str, TRUE);
+
+	/* the replay starts from the second packet, and its pong isn't
+	   sent to the real server */
+	sent = capture_server->send_packets;
+	test_assert(icb_replay_start(capture_server, path, TRUE));
+	test_assert(fake_run_until(&replay_done, 5000));
+	test_assert(strcmp(replayed->str, "second;third;") == 0);
+	test_assert(capture_server->send_packets == sent);
+	test_assert(live_opens == 3);
+	test_assert(replay_server != NULL &&
+		    g_slist_find(servers, replay_server) == NULL);
+
+	/* the replay server is in the servers list while it's running */
+	replay_done = FALSE;
+	test_assert(icb_replay_start(capture_server, path, FALSE));
+	tag = g_strconcat(capture_server->tag, "-replay", NULL);
+	replay = server_find_tag(tag);
+	g_free(tag);
+	test_assert(replay != NULL && replay->handle == NULL);
+	if (replay != NULL)
+		server_disconnect(replay);
+	test_assert(replay_done);
+
+	/* a record larger than any read is corrupted */
+	fd = open(path, O_WRONLY | O_TRUNC);
+	memset(header, 0xff, sizeof(header));
+	header[0] = ICB_CAPTURE_READ;
+	test_assert(write(fd, ICB_CAPTURE_MAGIC, ICB_CAPTURE_MAGIC_LEN) ==
+		    ICB_CAPTURE_MAGIC_LEN);
+	test_assert(write(fd, header, sizeof(header)) == sizeof(header));
+	close(fd);
+	replay_done = FALSE;
+	test_assert(icb_replay_start(capture_server, path, TRUE));
+	test_assert(fake_run_until(&replay_done, 5000));
+	test_assert(replay_bytes == 0);
+
+	test_server_destroy(capture_server);
+	signal_remove("icb fields open", (SIGNAL_FUNC) capture_event_open);
+	signal_remove("icb replay finished", (SIGNAL_FUNC) sig_replay_finished);
+	g_string_free(replayed, TRUE);
+	unlink(path);
+}
+
+/* ---- statistics ---- */
+
+static ICB_SERVER_REC *stats_server;
+static int stats_signals;
+
+static void sig_icb_stats(ICB_SERVER_REC *server)
+{
+	if (server == stats_server)
+		stats_signals++;
+}
+
+static unsigned long histogram_sum(unsigned long *buckets)
+{
+	unsigned long sum;
+	int i;
+
+	sum = 0;
+	for (i = 0; i < ICB_LATENCY_BUCKETS; i++)
+		sum += buckets[i];
+	return sum;
+}
+
+static void test_stats(void)
+{
+	ICB_SERVER_REC *server;
+	GString *str;
+	char *data;
+	unsigned long in_packets, in_bytes, out_packets, out_bytes;
+	unsigned long unknown, reallocs, memmoves, wakeups, parse_time;
+	unsigned long lines;
+	int open, count, i;
+
+	server = stats_server = test_server_new();
+	open = 'b' - 'a';
+
+	/* start from an empty recvbuf, so feeding doesn't compact it */
+	test_assert(server->recvbuf_next_packet == server->recvbuf_pos);
+	server->recvbuf_pos = server->recvbuf_next_packet = 0;
+
+	in_packets = server->type_packets[ICB_STATS_IN][open];
+	in_bytes = server->type_bytes[ICB_STATS_IN][open];
+	unknown = server->type_packets[ICB_STATS_IN][ICB_STATS_TYPES-1];
+	reallocs = server->reallocs;
+	memmoves = server->memmoves;
+
+	/* the length without the \0 is counted for each type, unknown
+	   types have their own slot */
+	str = g_string_new(NULL);
+	packet_append(str, 'b', "nick\001hello");
+	packet_append(str, 'z', "junk");
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	test_assert(server->type_packets[ICB_STATS_IN][open] == in_packets+1);
+	test_assert(server->type_bytes[ICB_STATS_IN][open] == in_bytes+11);
+	test_assert(server->type_packets[ICB_STATS_IN][ICB_STATS_TYPES-1] ==
+		    unknown+1);
+	test_assert(server->memmoves == memmoves);
+
+	/* a packet without the \0 and a multi-frame one are moved, and
+	   the long one makes recvbuf grow */
+	server->recvbuf_pos = server->recvbuf_next_packet = 0;
+	icb_protocol_feed(server, (unsigned char *) "\007bnick\001x", 8);
+	server->recvbuf_pos = server->recvbuf_next_packet = 0;
+	data = g_malloc(5001);
+	memset(data, 'x', 5000); data[5000] = '\0';
+	memcpy(data, "nick\001", 5);
+	str = g_string_new(NULL);
+	packet_append(str, 'b', data);
+	icb_protocol_feed(server, (unsigned char *) str->str, str->len);
+	g_string_free(str, TRUE);
+	g_free(data);
+	test_assert(server->type_packets[ICB_STATS_IN][open] == in_packets+3);
+	test_assert(server->type_bytes[ICB_STATS_IN][open] ==
+		    in_bytes+11+7+5001);
+	test_assert(server->memmoves == memmoves+2);
+	test_assert(server->reallocs > reallocs);
+
+	/* sent packets */
+	out_packets = server->type_packets[ICB_STATS_OUT][open];
+	out_bytes = server->type_bytes[ICB_STATS_OUT][open];
+	icb_send_open_msg(server, "hi");
+	test_assert(server->type_packets[ICB_STATS_OUT][open] ==
+		    out_packets+1);
+	test_assert(server->type_bytes[ICB_STATS_OUT][open] == out_bytes+3);
+
+	/* each wakeup is counted and timed */
+	wakeups = server->wakeups;
+	parse_time = histogram_sum(server->parse_time);
+	str = g_string_new(NULL);
+	packet_append(str, 'b', "nick\001wake up");
+	peer_send(str->str, str->len);
+	g_string_free(str, TRUE);
+	test_assert(server->wakeups > wakeups);
+	test_assert(histogram_sum(server->parse_time) - parse_time ==
+		    server->wakeups - wakeups);
+
+	/* "icb stats" is sent every icb_stats_interval seconds */
+	signal_add("icb stats", (SIGNAL_FUNC) sig_icb_stats);
+	stats_signals = 0;
+	settings_set_int("icb_stats_interval", 1);
+	signal_emit("setup changed", 0);
+	fake_run_for(2500);
+	test_assert(stats_signals >= 2);
+
+	settings_set_int("icb_stats_interval", 0);
+	signal_emit("setup changed", 0);
+	count = stats_signals;
+	fake_run_for(1500);
+	test_assert(stats_signals == count);
+
+	settings_set_int("icb_stats_interval", 10);
+	signal_emit("setup changed", 0);
+	signal_remove("icb stats", (SIGNAL_FUNC) sig_icb_stats);
+
+	/* /ICB STATS prints 6 lines and one for each type seen */
+	count = 6;
+	for (i = 0; i < ICB_STATS_TYPES; i++) {
+		if (server->type_packets[ICB_STATS_IN][i] != 0 ||
+		    server->type_packets[ICB_STATS_OUT][i] != 0)
+			count++;
+	}
+	fe_icb_init();
+	lines = printtext_lines;
+	test_assert(command_run("icb stats", "", server, NULL));
+	test_assert(printtext_lines - lines == (unsigned long) count);
+	fe_icb_deinit();
+
+	test_server_destroy(server);
+	stats_server = NULL;
+}
+
+/* ---- unloading ---- */
+
+static char unload_path[] = "/tmp/icb-capture-XXXXXX";
+
+/* Leave a server with all its timeouts running for icb_core_deinit() */
+static void unload_setup(void)
+{
+	ICB_SERVER_REC *server;
+	int fd, i;
+
+	server = test_server_new();
+
+	settings_set_int("icb_cmds_max_at_once", 1);
+	settings_set_int("icb_cmd_queue_speed", 100);
+	signal_emit("setup changed", 0);
+	for (i = 0; i < 4; i++)
+		icb_send_open_msg(server, "pasted line");
+	test_assert(server->sendq_tag != -1 && server->outbuf_tag != -1);
+
+	icb_change_channel(server, "2", FALSE);
+	test_assert(server->group_pending_tag != -1);
+
+	fd = mkstemp(unload_path);
+	test_assert(fd != -1);
+	close(fd);
+	test_assert(icb_capture_start(server, unload_path));
+	icb_send_open_msg(server, "captured");
+}
+
+int main(int argc, char *argv[])
+{
+	fake_irssi_init();
+	icb_core_init();
+
+	test_read();
+	test_read_budget();
+	test_dispatch();
+	test_decode();
+	test_split();
+	test_cmdout();
+	test_sendqueue();
+	test_shrink();
+	test_lag();
+	test_pool();
+	test_reconnect();
+	test_group_change();
+	test_group_closed();
+	test_send_frames();
+	test_send_iov();
+	test_capture();
+	test_stats();
+	unload_setup();
+
+	icb_core_deinit();
+	test_assert(servers == NULL);
+
+	/* nothing of the module may be left to run */
+	fake_run_for(300);
+	unlink(unload_path);
+	fake_irssi_deinit();
+
+	if (failures > 0) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	return 0;
+}
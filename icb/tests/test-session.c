@@ -0,0 +1,311 @@
+/*
+ test-session.c : run the ICB module against fake-icbd and report
+                  throughput, latency and memory usage
+
+    Copyright (C) 2001 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#define MODULE_NAME "test-session"
+
+#include "common.h"
+#include "signals.h"
+#include "settings.h"
+#include "servers.h"
+#include "channels.h"
+#include "nicklist.h"
+
+#include "icb.h"
+#include "icb-servers.h"
+#include "icb-channels.h"
+#include "icb-protocol.h"
+
+#include "fake-irssi.h"
+
+#include <sys/wait.h>
+
+#define RECV_COUNT 100000
+#define SEND_COUNT 20000
+#define ECHO_COUNT 1000
+#define WHO_COUNT 10000
+#define FUZZ_COUNT 5000
+
+void icb_core_init(void);
+void icb_core_deinit(void);
+
+static char done_step[64];
+static int opens, echoes;
+static double first_open, echo_sent, latencies[ECHO_COUNT];
+
+static void event_status(ICB_SERVER_REC *server, char **args)
+{
+	if (strcmp(args[0], "Done") == 0) {
+		strncpy(done_step, args[1], sizeof(done_step)-1);
+		done_step[sizeof(done_step)-1] = '\0';
+	}
+}
+
+static void event_open(ICB_SERVER_REC *server, char **args)
+{
+	if (strcmp(args[0], "echo") == 0) {
+		latencies[echoes++] = fake_time_usecs() - echo_sent;
+		return;
+	}
+
+	if (opens++ == 0)
+		first_open = fake_time_usecs();
+}
+
+static int wait_step(const char *step, int msecs)
+{
+	double start;
+
+	start = fake_time_usecs();
+	while (strcmp(done_step, step) != 0) {
+		if (fake_time_usecs() - start > msecs * 1000.0) {
+			fprintf(stderr, "timeout waiting for step %s\n", step);
+			return FALSE;
+		}
+		g_main_iteration(TRUE);
+	}
+	done_step[0] = '\0';
+	return TRUE;
+}
+
+static int double_cmp(const void *p1, const void *p2)
+{
+	double d1 = *(const double *) p1, d2 = *(const double *) p2;
+
+	return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static double percentile(double *values, int count, int percent)
+{
+	int pos;
+
+	pos = (count * percent + 99) / 100 - 1;
+	return values[pos < 0 ? 0 : pos];
+}
+
+static int check_nick(ICB_SERVER_REC *server, const char *nick,
+		      const char *host, int op)
+{
+	NICK_REC *rec;
+
+	rec = nicklist_find(CHANNEL(server->group), nick);
+	if (rec == NULL) {
+		fprintf(stderr, "%s isn't in the nicklist\n", nick);
+		return FALSE;
+	}
+	if ((host == NULL) != (rec->host == NULL) ||
+	    (host != NULL && strcmp(host, rec->host) != 0) || op != rec->op) {
+		fprintf(stderr, "%s has host %s and op %d, expected %s and %d\n",
+			nick, rec->host == NULL ? "(null)" : rec->host, rec->op,
+			host == NULL ? "(null)" : host, op);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* See do_members() in fake-icbd.c */
+static int check_members(ICB_SERVER_REC *server)
+{
+	static const char *gone[] = {
+		"alice", "bob", "dave", "erin", "stranger", NULL
+	};
+	int i;
+
+	for (i = 0; gone[i] != NULL; i++) {
+		if (nicklist_find(CHANNEL(server->group), gone[i]) != NULL) {
+			fprintf(stderr, "%s is in the nicklist\n", gone[i]);
+			return FALSE;
+		}
+	}
+
+	if (!check_nick(server, "carol", "alice@a.example.org", FALSE) ||
+	    !check_nick(server, "mod1", "login@m.example.org", TRUE) ||
+	    !check_nick(server, "short", NULL, FALSE) ||
+	    !check_nick(server, server->nick, NULL, FALSE))
+		return FALSE;
+
+	/* the /who users, the own nick, carol, mod1 and short */
+	if (g_hash_table_size(CHANNEL(server->group)->nicks) != WHO_COUNT+4) {
+		fprintf(stderr, "nicklist has %d nicks, expected %d\n",
+			g_hash_table_size(CHANNEL(server->group)->nicks),
+			WHO_COUNT+4);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+	SERVER_CONNECT_REC *conn;
+	ICB_SERVER_REC *server;
+	GHashTable *nicks;
+	const char *icbd;
+	char *argv_icbd[32], *port, num[5][MAX_INT_STRLEN];
+	double start, usecs;
+	int i, pid, status, ret;
+
+	fake_irssi_init();
+	icb_core_init();
+
+	/* no flood protection, we want to measure the raw speed */
+	settings_set_int("icb_cmd_queue_speed", 1);
+	settings_set_int("icb_cmds_max_at_once", 1000000);
+	signal_emit("setup changed", 0);
+
+	signal_add("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_add("icb fields open", (SIGNAL_FUNC) event_open);
+
+	icbd = getenv("FAKE_ICBD");
+	if (icbd == NULL) icbd = "./fake-icbd";
+
+	sprintf(num[0], "%d", RECV_COUNT);
+	sprintf(num[1], "%d", SEND_COUNT);
+	sprintf(num[2], "%d", ECHO_COUNT);
+	sprintf(num[3], "%d", WHO_COUNT);
+	sprintf(num[4], "%d", FUZZ_COUNT);
+
+	i = 0;
+	argv_icbd[i++] = (char *) icbd;
+	argv_icbd[i++] = "login"; argv_icbd[i++] = "1";
+	argv_icbd[i++] = "open"; argv_icbd[i++] = num[0];
+	argv_icbd[i++] = "recv"; argv_icbd[i++] = num[1];
+	argv_icbd[i++] = "echo"; argv_icbd[i++] = num[2];
+	argv_icbd[i++] = "who"; argv_icbd[i++] = num[3];
+	argv_icbd[i++] = "recv"; argv_icbd[i++] = "1";
+	argv_icbd[i++] = "members";
+	argv_icbd[i++] = "recv"; argv_icbd[i++] = "1";
+	argv_icbd[i++] = "fuzz"; argv_icbd[i++] = num[4];
+	argv_icbd[i++] = "1";
+	argv_icbd[i++] = NULL;
+
+	port = fake_spawn(argv_icbd, &pid);
+	if (port == NULL) {
+		fprintf(stderr, "couldn't start %s\n", icbd);
+		return 1;
+	}
+
+	conn = fake_connect_rec("ICB", "127.0.0.1", atoi(port), "tester", "1");
+	server = ICB_SERVER(fake_server_connect(conn));
+	server_connect_unref(conn);
+	g_free(port);
+
+	ret = 1;
+
+	/* receiving */
+	if (!wait_step("open", 60000))
+		goto out;
+	usecs = fake_time_usecs() - first_open;
+	if (opens != RECV_COUNT) {
+		fprintf(stderr, "received %d open messages, expected %d\n",
+			opens, RECV_COUNT);
+		goto out;
+	}
+	printf("receive: %d messages, %.0f msgs/sec\n",
+	       opens, opens / (usecs / 1000000.0));
+
+	/* sending */
+	start = fake_time_usecs();
+	for (i = 0; i < SEND_COUNT; i++)
+		icb_send_open_msg(server, "hello there, this is a test line");
+	if (!wait_step("recv", 60000))
+		goto out;
+	usecs = fake_time_usecs() - start;
+	printf("send: %d messages, %.0f msgs/sec\n",
+	       SEND_COUNT, SEND_COUNT / (usecs / 1000000.0));
+
+	/* round trip latency, one message at a time */
+	for (i = 0; i < ECHO_COUNT; i++) {
+		echo_sent = fake_time_usecs();
+		icb_send_open_msg(server, "ping");
+		while (echoes == i) {
+			if (fake_time_usecs() - echo_sent > 10000000.0) {
+				fprintf(stderr, "echo %d timed out\n", i);
+				goto out;
+			}
+			g_main_iteration(TRUE);
+		}
+	}
+	if (!wait_step("echo", 10000))
+		goto out;
+	qsort(latencies, ECHO_COUNT, sizeof(double), double_cmp);
+	printf("echo latency: p50 %.0f usecs, p90 %.0f usecs, "
+	       "p99 %.0f usecs, max %.0f usecs\n",
+	       percentile(latencies, ECHO_COUNT, 50),
+	       percentile(latencies, ECHO_COUNT, 90),
+	       percentile(latencies, ECHO_COUNT, 99),
+	       latencies[ECHO_COUNT-1]);
+
+	/* /who flood */
+	start = fake_time_usecs();
+	if (!wait_step("who", 60000))
+		goto out;
+	usecs = fake_time_usecs() - start;
+	nicks = CHANNEL(server->group)->nicks;
+	if (g_hash_table_size(nicks) != WHO_COUNT+1) {
+		fprintf(stderr, "nicklist has %d nicks, expected %d\n",
+			g_hash_table_size(nicks), WHO_COUNT+1);
+		goto out;
+	}
+	printf("who: %d users in %.0f msecs\n", WHO_COUNT, usecs / 1000.0);
+
+	/* joins, parts and nick changes are sent only after the /who
+	   listing has been checked. the "recv" step's Done comes in the
+	   same read as them, so only "members" is waited for. */
+	icb_send_open_msg(server, "continue");
+	if (!wait_step("members", 10000))
+		goto out;
+	if (!check_members(server))
+		goto out;
+	printf("members: joins, parts, nick change and /who lines tracked\n");
+
+	/* garbage could change the group, so it's sent only after the
+	   nicklist has been checked */
+	icb_send_open_msg(server, "continue");
+	if (!wait_step("recv", 10000))
+		goto out;
+
+	/* garbage */
+	if (!wait_step("fuzz", 60000))
+		goto out;
+	if (g_slist_find(servers, server) == NULL) {
+		fprintf(stderr, "disconnected by fuzzing\n");
+		goto out;
+	}
+	printf("fuzz: %d random frames, %lu malformed packets\n",
+	       FUZZ_COUNT, server->recv_malformed);
+
+	printf("peak RSS: %ld kB\n", fake_peak_rss());
+	ret = 0;
+
+out:
+	if (g_slist_find(servers, server) != NULL)
+		server_disconnect(SERVER(server));
+
+	signal_remove("icb fields status", (SIGNAL_FUNC) event_status);
+	signal_remove("icb fields open", (SIGNAL_FUNC) event_open);
+
+	icb_core_deinit();
+	fake_irssi_deinit();
+
+	/* fake-icbd exits when we disconnect */
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	return ret;
+}
@@ -10,6 +10,14 @@
  */
 #include "crc32.h"
 
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define CRC32_CLMUL
+#  include <immintrin.h>
+#  include <cpuid.h>
+#endif
+
   /* ============================================================= */
   /*  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or       */
   /*  code or tables extracted from it, as desired without restriction.     */
@@ -105,13 +113,169 @@ static unsigned int crc32_tab[] = {
       0x2d02ef8dL
    };
 
+/* crc32_slice[n][i] is the CRC of byte i followed by n+1 zero bytes,
+   which lets idea_crc32_slice8() handle 8 bytes with 8 lookups. */
+static unsigned int crc32_slice[7][256];
+static int crc32_slice_valid = 0;
+
+static void crc32_build_slice(void)
+{
+    unsigned int i, n, c;
+
+    for (i = 0; i < 256; i++) {
+	c = crc32_tab[i];
+	for (n = 0; n < 7; n++) {
+	    c = crc32_tab[c & 0xff] ^ (c >> 8);
+	    crc32_slice[n][i] = c;
+	}
+    }
+}
+
+static unsigned int idea_crc32_slice8(unsigned int crc32val,
+				      const unsigned char *s, unsigned int len)
+{
+    unsigned int one, two;
+
+    for (; len >= 8; len -= 8, s += 8) {
+	one = crc32val ^ (s[0] | (s[1] << 8) | (s[2] << 16) |
+			  ((unsigned int)s[3] << 24));
+	two = s[4] | (s[5] << 8) | (s[6] << 16) | ((unsigned int)s[7] << 24);
+	crc32val = crc32_slice[6][one & 0xff] ^
+	    crc32_slice[5][(one >> 8) & 0xff] ^
+	    crc32_slice[4][(one >> 16) & 0xff] ^
+	    crc32_slice[3][one >> 24] ^
+	    crc32_slice[2][two & 0xff] ^
+	    crc32_slice[1][(two >> 8) & 0xff] ^
+	    crc32_slice[0][(two >> 16) & 0xff] ^
+	    crc32_tab[two >> 24];
+    }
+    for (; len > 0; len--, s++)
+	crc32val = crc32_tab[(crc32val ^ *s) & 0xff] ^ (crc32val >> 8);
+    return crc32val;
+}
+
+#ifdef CRC32_CLMUL
+
+static int crc32_clmul_supported = -1;
+
+/* Fold 64 bytes at a time with carry-less multiplication and Barrett
+   reduce the rest to 32 bits, as in Intel's "Fast CRC Computation for
+   Generic Polynomials Using PCLMULQDQ Instruction".  The constants are
+   powers of x modulo the (bit reflected) polynomial $edb88320.  len must
+   be a multiple of 16 and at least 64. */
+__attribute__((target("pclmul,sse4.1")))
+static unsigned int idea_crc32_clmul(unsigned int crc32val,
+				     const unsigned char *s, unsigned int len)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(s + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(s + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(s + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(s + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc32val));
+
+    /* x^(4*128+32), x^(4*128-32) */
+    x0 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    for (s += 64, len -= 64; len >= 64; s += 64, len -= 64) {
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+	x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+	x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+	x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+	y5 = _mm_loadu_si128((const __m128i *)(s + 0x00));
+	y6 = _mm_loadu_si128((const __m128i *)(s + 0x10));
+	y7 = _mm_loadu_si128((const __m128i *)(s + 0x20));
+	y8 = _mm_loadu_si128((const __m128i *)(s + 0x30));
+
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+	x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+	x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+	x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    }
+
+    /* fold the four lanes into one: x^(128+32), x^(128-32) */
+    x0 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    for (; len >= 16; s += 16, len -= 16) {
+	x2 = _mm_loadu_si128((const __m128i *)s);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    }
+
+    /* 128 -> 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (unsigned int)_mm_extract_epi32(x1, 1);
+}
+
+static int crc32_check_clmul(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	return 0;
+    return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+
+#endif /* CRC32_CLMUL */
+
 /* Return a 32-bit CRC of the contents of the buffer. */
 unsigned int idea_crc32(const unsigned char *s, unsigned int len)
 {
-    unsigned int i;
     unsigned int crc32val;
+
+    if (!crc32_slice_valid) {
+	crc32_build_slice();
+	crc32_slice_valid = 1;
+    }
     crc32val = 0;
-    for(i = 0;  i < len;  i++)
-	crc32val = crc32_tab[(crc32val ^ s[i]) & 0xff] ^ (crc32val >> 8);
-    return crc32val;
+#ifdef CRC32_CLMUL
+    if (crc32_clmul_supported < 0)
+	crc32_clmul_supported = crc32_check_clmul();
+    if (crc32_clmul_supported && len >= 64) {
+	unsigned int n = len & ~15U;
+
+	crc32val = idea_crc32_clmul(crc32val, s, n);
+	s += n;
+	len -= n;
+    }
+#endif
+    return idea_crc32_slice8(crc32val, s, len);
 }
@@ -43,3 +43,13 @@ typedef unsigned char  u_int8;          /* unsigned 8-bit integer             */
 void Idea( data_t(dataIn), data_t(dataOut), key_t(key) );
 void InvertIdeaKey( key_t(key), key_t(invKey) );
 void ExpandUserKey( userkey_t(userKey), key_t(key) );
+
+/* 'blocks' blocks of 8 bytes at once, see idea_simd.c                        */
+void IdeaECB(const u_int8 *in, u_int8 *out, int blocks, key_t(key));
+
+/* Kernel for IdeaECB() to use, returns 0 if this CPU can't run it.           */
+#define IDEA_KERNEL_BEST   -1
+#define IDEA_KERNEL_SCALAR  0
+#define IDEA_KERNEL_SSE2    1
+#define IDEA_KERNEL_AVX2    2
+int IdeaECBKernel(int kernel);
@@ -0,0 +1,291 @@
+/*   -*- c -*-
+ *
+ *  ----------------------------------------------------------------------
+ *  Crypto for IRC.
+ *  ----------------------------------------------------------------------
+ *  IDEA for many independent blocks at a time.  The blocks are
+ *  transposed so that each SIMD register holds the same 16 bit word
+ *  of 8 (SSE2) or 16 (AVX2) blocks, and multiplication modulo 65537
+ *  is done without branches:
+ *
+ *    a * b mod 65537 = lo - hi + (lo < hi)
+ *
+ *  where lo and hi are the low and high halves of the 32 bit product.
+ *  An operand of 0 stands for 65536, then the result is 1 - a - b.
+ *  ----------------------------------------------------------------------
+ */
+#include "idea.h"
+
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define IDEA_SIMD
+#  include <immintrin.h>
+#endif
+
+#define nofRound            8 /* number of rounds                             */
+
+static void idea_ecb_scalar(const u_int8 *in, u_int8 *out, int blocks,
+			    u_int16 *key)
+{
+    u_int16 cb[4];
+    int i, j;
+
+    for (i = 0; i < blocks; i++, in += dataSize, out += dataSize) {
+	for (j = 0; j < dataLen; j++)
+	    cb[j] = ((u_int16)in[j * 2] << 8) | in[j * 2 + 1];
+	Idea(cb, cb, key);
+	for (j = 0; j < dataLen; j++) {
+	    out[j * 2] = (cb[j] >> 8) & 0xff;
+	    out[j * 2 + 1] = cb[j] & 0xff;
+	}
+    }
+}
+
+#ifdef IDEA_SIMD
+
+__attribute__((target("sse2")))
+static inline __m128i mul_sse2(__m128i a, __m128i b)
+{
+    __m128i lo, hi, r, zero, fix;
+
+    lo = _mm_mullo_epi16(a, b);
+    hi = _mm_mulhi_epu16(a, b);
+    /* lo - hi, plus one more when it wrapped */
+    r = _mm_sub_epi16(lo, hi);
+    r = _mm_add_epi16(r, _mm_cmpeq_epi16(_mm_subs_epu16(hi, lo),
+					 _mm_setzero_si128()));
+    r = _mm_add_epi16(r, _mm_set1_epi16(1));
+
+    zero = _mm_or_si128(_mm_cmpeq_epi16(a, _mm_setzero_si128()),
+			_mm_cmpeq_epi16(b, _mm_setzero_si128()));
+    fix = _mm_sub_epi16(_mm_sub_epi16(_mm_set1_epi16(1), a), b);
+    return _mm_or_si128(_mm_and_si128(zero, fix),
+			_mm_andnot_si128(zero, r));
+}
+
+/* big endian 16 bit words to host order and back */
+__attribute__((target("sse2")))
+static inline __m128i bswap16_sse2(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+__attribute__((target("sse2")))
+static void idea_ecb8_sse2(const u_int8 *in, u_int8 *out, u_int16 *key)
+{
+    __m128i a0, a1, a2, a3, t0, t1, t2, t3;
+    __m128i x0, x1, x2, x3;
+    int round;
+
+    a0 = bswap16_sse2(_mm_loadu_si128((const __m128i *)in));
+    a1 = bswap16_sse2(_mm_loadu_si128((const __m128i *)(in + 16)));
+    a2 = bswap16_sse2(_mm_loadu_si128((const __m128i *)(in + 32)));
+    a3 = bswap16_sse2(_mm_loadu_si128((const __m128i *)(in + 48)));
+
+    /* two blocks per register -> one word of eight blocks per register */
+    t0 = _mm_unpacklo_epi16(a0, a1);
+    t1 = _mm_unpackhi_epi16(a0, a1);
+    t2 = _mm_unpacklo_epi16(a2, a3);
+    t3 = _mm_unpackhi_epi16(a2, a3);
+    a0 = _mm_unpacklo_epi16(t0, t1);
+    a1 = _mm_unpackhi_epi16(t0, t1);
+    a2 = _mm_unpacklo_epi16(t2, t3);
+    a3 = _mm_unpackhi_epi16(t2, t3);
+    x0 = _mm_unpacklo_epi64(a0, a2);
+    x1 = _mm_unpackhi_epi64(a0, a2);
+    x2 = _mm_unpacklo_epi64(a1, a3);
+    x3 = _mm_unpackhi_epi64(a1, a3);
+
+    for (round = nofRound; round > 0; round--, key += 6) {
+	x0 = mul_sse2(x0, _mm_set1_epi16(key[0]));
+	x1 = _mm_add_epi16(x1, _mm_set1_epi16(key[1]));
+	x2 = _mm_add_epi16(x2, _mm_set1_epi16(key[2]));
+	x3 = mul_sse2(x3, _mm_set1_epi16(key[3]));
+	t0 = mul_sse2(_mm_set1_epi16(key[4]), _mm_xor_si128(x0, x2));
+	t1 = mul_sse2(_mm_set1_epi16(key[5]),
+		      _mm_add_epi16(t0, _mm_xor_si128(x1, x3)));
+	t0 = _mm_add_epi16(t0, t1);
+	x0 = _mm_xor_si128(x0, t1);
+	x3 = _mm_xor_si128(x3, t0);
+	t0 = _mm_xor_si128(t0, x1);
+	x1 = _mm_xor_si128(x2, t1);
+	x2 = t0;
+    }
+    t0 = mul_sse2(x0, _mm_set1_epi16(key[0]));
+    t1 = _mm_add_epi16(x2, _mm_set1_epi16(key[1]));
+    t2 = _mm_add_epi16(x1, _mm_set1_epi16(key[2]));
+    t3 = mul_sse2(x3, _mm_set1_epi16(key[3]));
+
+    a0 = _mm_unpacklo_epi16(t0, t1);
+    a1 = _mm_unpacklo_epi16(t2, t3);
+    a2 = _mm_unpackhi_epi16(t0, t1);
+    a3 = _mm_unpackhi_epi16(t2, t3);
+    _mm_storeu_si128((__m128i *)out,
+		     bswap16_sse2(_mm_unpacklo_epi32(a0, a1)));
+    _mm_storeu_si128((__m128i *)(out + 16),
+		     bswap16_sse2(_mm_unpackhi_epi32(a0, a1)));
+    _mm_storeu_si128((__m128i *)(out + 32),
+		     bswap16_sse2(_mm_unpacklo_epi32(a2, a3)));
+    _mm_storeu_si128((__m128i *)(out + 48),
+		     bswap16_sse2(_mm_unpackhi_epi32(a2, a3)));
+}
+
+__attribute__((target("sse2")))
+static void idea_ecb_sse2(const u_int8 *in, u_int8 *out, int blocks,
+			  u_int16 *key)
+{
+    for (; blocks >= 8; blocks -= 8, in += 8 * dataSize, out += 8 * dataSize)
+	idea_ecb8_sse2(in, out, key);
+    idea_ecb_scalar(in, out, blocks, key);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mul_avx2(__m256i a, __m256i b)
+{
+    __m256i lo, hi, r, zero, fix;
+
+    lo = _mm256_mullo_epi16(a, b);
+    hi = _mm256_mulhi_epu16(a, b);
+    r = _mm256_sub_epi16(lo, hi);
+    r = _mm256_add_epi16(r, _mm256_cmpeq_epi16(_mm256_subs_epu16(hi, lo),
+					       _mm256_setzero_si256()));
+    r = _mm256_add_epi16(r, _mm256_set1_epi16(1));
+
+    zero = _mm256_or_si256(_mm256_cmpeq_epi16(a, _mm256_setzero_si256()),
+			   _mm256_cmpeq_epi16(b, _mm256_setzero_si256()));
+    fix = _mm256_sub_epi16(_mm256_sub_epi16(_mm256_set1_epi16(1), a), b);
+    return _mm256_blendv_epi8(r, fix, zero);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i bswap16_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+}
+
+/* Same as idea_ecb8_sse2() within each 128 bit lane, so the blocks end
+   up in a different order inside the registers but go back where they
+   came from. */
+__attribute__((target("avx2")))
+static void idea_ecb16_avx2(const u_int8 *in, u_int8 *out, u_int16 *key)
+{
+    __m256i a0, a1, a2, a3, t0, t1, t2, t3;
+    __m256i x0, x1, x2, x3;
+    int round;
+
+    a0 = bswap16_avx2(_mm256_loadu_si256((const __m256i *)in));
+    a1 = bswap16_avx2(_mm256_loadu_si256((const __m256i *)(in + 32)));
+    a2 = bswap16_avx2(_mm256_loadu_si256((const __m256i *)(in + 64)));
+    a3 = bswap16_avx2(_mm256_loadu_si256((const __m256i *)(in + 96)));
+
+    t0 = _mm256_unpacklo_epi16(a0, a1);
+    t1 = _mm256_unpackhi_epi16(a0, a1);
+    t2 = _mm256_unpacklo_epi16(a2, a3);
+    t3 = _mm256_unpackhi_epi16(a2, a3);
+    a0 = _mm256_unpacklo_epi16(t0, t1);
+    a1 = _mm256_unpackhi_epi16(t0, t1);
+    a2 = _mm256_unpacklo_epi16(t2, t3);
+    a3 = _mm256_unpackhi_epi16(t2, t3);
+    x0 = _mm256_unpacklo_epi64(a0, a2);
+    x1 = _mm256_unpackhi_epi64(a0, a2);
+    x2 = _mm256_unpacklo_epi64(a1, a3);
+    x3 = _mm256_unpackhi_epi64(a1, a3);
+
+    for (round = nofRound; round > 0; round--, key += 6) {
+	x0 = mul_avx2(x0, _mm256_set1_epi16(key[0]));
+	x1 = _mm256_add_epi16(x1, _mm256_set1_epi16(key[1]));
+	x2 = _mm256_add_epi16(x2, _mm256_set1_epi16(key[2]));
+	x3 = mul_avx2(x3, _mm256_set1_epi16(key[3]));
+	t0 = mul_avx2(_mm256_set1_epi16(key[4]), _mm256_xor_si256(x0, x2));
+	t1 = mul_avx2(_mm256_set1_epi16(key[5]),
+		      _mm256_add_epi16(t0, _mm256_xor_si256(x1, x3)));
+	t0 = _mm256_add_epi16(t0, t1);
+	x0 = _mm256_xor_si256(x0, t1);
+	x3 = _mm256_xor_si256(x3, t0);
+	t0 = _mm256_xor_si256(t0, x1);
+	x1 = _mm256_xor_si256(x2, t1);
+	x2 = t0;
+    }
+    t0 = mul_avx2(x0, _mm256_set1_epi16(key[0]));
+    t1 = _mm256_add_epi16(x2, _mm256_set1_epi16(key[1]));
+    t2 = _mm256_add_epi16(x1, _mm256_set1_epi16(key[2]));
+    t3 = mul_avx2(x3, _mm256_set1_epi16(key[3]));
+
+    a0 = _mm256_unpacklo_epi16(t0, t1);
+    a1 = _mm256_unpacklo_epi16(t2, t3);
+    a2 = _mm256_unpackhi_epi16(t0, t1);
+    a3 = _mm256_unpackhi_epi16(t2, t3);
+    _mm256_storeu_si256((__m256i *)out,
+			bswap16_avx2(_mm256_unpacklo_epi32(a0, a1)));
+    _mm256_storeu_si256((__m256i *)(out + 32),
+			bswap16_avx2(_mm256_unpackhi_epi32(a0, a1)));
+    _mm256_storeu_si256((__m256i *)(out + 64),
+			bswap16_avx2(_mm256_unpacklo_epi32(a2, a3)));
+    _mm256_storeu_si256((__m256i *)(out + 96),
+			bswap16_avx2(_mm256_unpackhi_epi32(a2, a3)));
+}
+
+__attribute__((target("avx2")))
+static void idea_ecb_avx2(const u_int8 *in, u_int8 *out, int blocks,
+			  u_int16 *key)
+{
+    for (; blocks >= 16;
+	 blocks -= 16, in += 16 * dataSize, out += 16 * dataSize)
+	idea_ecb16_avx2(in, out, key);
+    idea_ecb_sse2(in, out, blocks, key);
+}
+
+#endif /* IDEA_SIMD */
+
+static void (*idea_ecb_func)(const u_int8 *, u_int8 *, int, u_int16 *);
+
+static void idea_ecb_select(void)
+{
+    idea_ecb_func = idea_ecb_scalar;
+#ifdef IDEA_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	idea_ecb_func = idea_ecb_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+	idea_ecb_func = idea_ecb_sse2;
+#endif
+}
+
+/* Make IdeaECB() use the given kernel, for comparing them. */
+int IdeaECBKernel(int kernel)
+{
+    switch (kernel) {
+    case IDEA_KERNEL_BEST:
+	idea_ecb_select();
+	return 1;
+    case IDEA_KERNEL_SCALAR:
+	idea_ecb_func = idea_ecb_scalar;
+	return 1;
+#ifdef IDEA_SIMD
+    case IDEA_KERNEL_SSE2:
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("sse2"))
+	    return 0;
+	idea_ecb_func = idea_ecb_sse2;
+	return 1;
+    case IDEA_KERNEL_AVX2:
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2"))
+	    return 0;
+	idea_ecb_func = idea_ecb_avx2;
+	return 1;
+#endif
+    default:
+	return 0;
+    }
+}
+
+/* Run IDEA over 'blocks' independent 8 byte blocks of big endian words,
+   in and out may be the same buffer. */
+void IdeaECB(const u_int8 *in, u_int8 *out, int blocks, u_int16 *key)
+{
+    if (idea_ecb_func == NULL)
+	idea_ecb_select();
+    idea_ecb_func(in, out, blocks, key);
+}
@@ -20,12 +20,15 @@
  */
 #include "module.h"
 #include "misc.h"
+#include "idea.h"
 
-#define KEY_ALLOC_STEP 4
-
-typedef struct {
+typedef struct _irc_key {
     char *fingerprint;
     char *key;
+    int version;
+    key_t(ek); /* expanded subkeys for encryption */
+    key_t(dk); /* and decryption */
+    struct _irc_key *next; /* same key with other key expand versions */
 } irc_key, *irc_key_t;
 
 typedef struct {
@@ -33,116 +36,174 @@ typedef struct {
     char *key;
 } irc_default_key, *irc_default_key_t;
 
-static irc_key_t known_keys = NULL;
-static int num_known_keys = 0;
-static int spc_known_keys = 0;
-
-static irc_default_key_t default_keys = NULL;
-static int num_default_keys = 0;
-static int spc_default_keys = 0;
+/* fingerprint -> irc_key_t */
+static GHashTable *known_keys = NULL;
+/* key -> irc_key_t list of the key's versions */
+static GHashTable *known_key_names = NULL;
+/* addr -> irc_default_key_t */
+static GHashTable *default_keys = NULL;
 
 static int irc_default_key_expand_version = 3;
 
-static const char *irc_get_known_key(const char *fingerprint);
 static int irc_add_known_key_internal(const char *key, int version);
 
+/* fields of an encrypted message, pointing inside the message */
+typedef struct {
+    const char *type, *fingerprint, *data;
+    int type_len, fingerprint_len, data_len;
+    int ver_maj, ver_min;
+} irc_encrypted_message;
+
 static int irc_parse_encrypted_message(const char *msg,
-				       char **type,
-				       int *ver_maj,
-				       int *ver_min,
-				       char **fingerprint,
-				       char **data)
+				       irc_encrypted_message *em)
 {
-	char **list, *p;
-        int ret;
-
-	/* |*E*|type|ver_maj.ver_min|fingerprint|data|  */
-	list = g_strsplit(msg, "|", -1);
-        ret = 0;
-	if (strarray_length(list) == 6 && strcmp(list[1], "*E*") == 0) {
-		if (type != NULL)
-			*type = g_strdup(list[2]);
-
-		if (ver_maj != NULL) {
-			p = strchr(list[3], '.');
-			if (p != NULL) *p++ = '\0'; else p = "";
-			*ver_maj = atoi(list[3]);
+	const char *field[6], *p, *end;
+	int len[6], n;
+
+	/* |*E*|type|ver_maj.ver_min|fingerprint|data|
+	   split at '|' like g_strsplit() does, which ignores the empty
+	   field after the last '|' */
+	n = 0;
+	for (p = msg; *p != '\0'; p = end + 1) {
+		if (n == 6)
+			return 0;
+
+		end = strchr(p, '|');
+		if (end == NULL)
+			end = p + strlen(p);
+		field[n] = p;
+		len[n++] = (int) (end - p);
+		if (*end == '\0')
+			break;
+	}
 
-			if (ver_min != NULL)
-				*ver_min = atoi(p);
-		}
+	if (n != 6 || len[1] != 3 || strncmp(field[1], "*E*", 3) != 0)
+		return 0;
 
-		if (fingerprint != NULL)
-			*fingerprint = g_strdup(list[4]);
+	if (em != NULL) {
+		em->type = field[2];
+		em->type_len = len[2];
 
-		if (data != NULL)
-			*data = g_strdup(list[5]);
+		/* atoi() stops at the '.' or '|' */
+		em->ver_maj = atoi(field[3]);
+		p = memchr(field[3], '.', len[3]);
+		em->ver_min = p == NULL ? 0 : atoi(p + 1);
 
-                ret = 1;
+		em->fingerprint = field[4];
+		em->fingerprint_len = len[4];
+		em->data = field[5];
+		em->data_len = len[5];
 	}
-
-        g_strfreev(list);
-        return ret;
+	return 1;
 }
 
 const char *irc_get_default_key(const char *addr)
 {
-    int i;
+    irc_default_key_t rec;
 
     if (!default_keys)
 	return NULL;
-    
-    for (i = 0; i < num_default_keys; i++)
-	if (!(g_strcasecmp(default_keys[i].addr, addr))) {
-	    return default_keys[i].key;
-	}
-    return NULL;
+
+    rec = g_hash_table_lookup(default_keys, addr);
+    return rec ? rec->key : NULL;
 }
 
-static const char *irc_get_known_key(const char *fingerprint)
+static void irc_build_key_schedule(const char *key, int version,
+				   unsigned short *ek, unsigned short *dk)
 {
-    int i;
+    unsigned short *tmpkey;
 
-    if (!known_keys)
-	return NULL;
-    
-    for (i = 0; i < num_known_keys; i++)
-	if (!(g_strcasecmp(known_keys[i].fingerprint, fingerprint)))
-	    return known_keys[i].key;
+    tmpkey = irc_build_key(key, version);
+    ExpandUserKey(tmpkey, ek);
+    g_free(tmpkey);
+    InvertIdeaKey(ek, dk);
+}
+
+static irc_key_t irc_find_known_key(const char *key, int version)
+{
+    irc_key_t rec;
+
+    rec = known_key_names ? g_hash_table_lookup(known_key_names, key) : NULL;
+    for (; rec; rec = rec->next)
+	if (rec->version == version)
+	    return rec;
     return NULL;
 }
 
+void irc_get_key_schedule(const char *key, int version,
+			  unsigned short *ek, unsigned short *dk)
+{
+    key_t(tmp_ek);
+    key_t(tmp_dk);
+    irc_key_t rec;
+
+    rec = irc_find_known_key(key, version);
+    if (rec) {
+	if (ek)
+	    memcpy(ek, rec->ek, sizeof (rec->ek));
+	if (dk)
+	    memcpy(dk, rec->dk, sizeof (rec->dk));
+	return;
+    }
+
+    /* not a known key, expand it just this once */
+    irc_build_key_schedule(key, version, tmp_ek, tmp_dk);
+    if (ek)
+	memcpy(ek, tmp_ek, sizeof (tmp_ek));
+    if (dk)
+	memcpy(dk, tmp_dk, sizeof (tmp_dk));
+}
+
 static int irc_add_known_key_internal(const char *key, int version)
 {
-    int i;
+    irc_key_t rec;
     char *fp;
 
     if (!known_keys) {
-	known_keys = g_new0(irc_key, KEY_ALLOC_STEP);
-	num_known_keys = 0;
-	spc_known_keys = KEY_ALLOC_STEP;
-    }
-    if (num_known_keys == spc_known_keys) {
-	irc_key_t n_keys;
-
-	n_keys = g_new0(irc_key, KEY_ALLOC_STEP + spc_known_keys);
-	memcpy(n_keys, known_keys, num_known_keys * sizeof (irc_key));
-	g_free(known_keys);
-	known_keys = n_keys;
-	spc_known_keys += KEY_ALLOC_STEP;
+	known_keys = g_hash_table_new((GHashFunc) g_istr_hash,
+				      (GCompareFunc) g_istr_equal);
+	known_key_names = g_hash_table_new((GHashFunc) g_str_hash,
+					   (GCompareFunc) g_str_equal);
     }
     fp = irc_key_fingerprint(key, version);
-    for (i = 0; i < num_known_keys; i++)
-	if (!(strcmp(known_keys[i].fingerprint, fp))) {
-	    g_free(fp);
-	    return 1; /* Already there */
-	}
-    known_keys[num_known_keys].key = g_strdup(key);
-    known_keys[num_known_keys].fingerprint = fp;
-    num_known_keys++;
+    if (g_hash_table_lookup(known_keys, fp)) {
+	g_free(fp);
+	return 1; /* Already there */
+    }
+    rec = g_new0(irc_key, 1);
+    rec->key = g_strdup(key);
+    rec->fingerprint = fp;
+    rec->version = version;
+    irc_build_key_schedule(key, version, rec->ek, rec->dk);
+
+    /* the first version's key string stays as the hash key */
+    rec->next = g_hash_table_lookup(known_key_names, key);
+    g_hash_table_insert(known_key_names,
+			rec->next ? rec->next->key : rec->key, rec);
+    g_hash_table_insert(known_keys, rec->fingerprint, rec);
     return 1;
 }
 
+static void irc_known_key_free(irc_key_t rec)
+{
+    irc_key_t next;
+
+    for (; rec; rec = next) {
+	next = rec->next;
+	g_hash_table_remove(known_keys, rec->fingerprint);
+	g_free(rec->key);
+	g_free(rec->fingerprint);
+	g_free(rec);
+    }
+}
+
+static void irc_default_key_free(irc_default_key_t rec)
+{
+    g_free(rec->key);
+    g_free(rec->addr);
+    g_free(rec);
+}
+
 int irc_set_key_expand_version(int n)
 {
 	int x;
@@ -172,29 +233,40 @@ int irc_add_known_key(const char *key)
 	return r;
 }
 
+static int known_key_names_free(void *key, irc_key_t rec)
+{
+	irc_known_key_free(rec);
+	return TRUE;
+}
+
 int irc_delete_all_known_keys(void)
 {
-	int i;
+	if (!known_keys)
+		return 1;
 
-	for (i = 0; i < num_known_keys; i++) {
-		g_free(known_keys[i].key);
-		g_free(known_keys[i].fingerprint);
-	}
-        g_free_and_null(known_keys);
-	num_known_keys = 0;
+	g_hash_table_foreach_remove(known_key_names,
+				    (GHRFunc) known_key_names_free, NULL);
+	g_hash_table_destroy(known_key_names);
+	g_hash_table_destroy(known_keys);
+	known_key_names = known_keys = NULL;
 	return 1;
 }
 
+static int default_keys_free(void *key, irc_default_key_t rec)
+{
+	irc_default_key_free(rec);
+	return TRUE;
+}
+
 int irc_delete_all_default_keys(void)
 {
-	int i;
+	if (!default_keys)
+		return 1;
 
-	for (i = 0; i < num_default_keys; i++) {
-		g_free(default_keys[i].key);
-		g_free(default_keys[i].addr);
-	}
-        g_free_and_null(default_keys);
-	num_default_keys = 0;
+	g_hash_table_foreach_remove(default_keys,
+				    (GHRFunc) default_keys_free, NULL);
+	g_hash_table_destroy(default_keys);
+	default_keys = NULL;
 	return 1;
 }
 
@@ -207,78 +279,55 @@ int irc_delete_all_keys(void)
 
 int irc_delete_known_key(const char *key)
 {
-	int i;
+	irc_key_t rec;
 
 	if (!known_keys)
 		return 0;
 
-	for (i = 0; i < num_known_keys; i++)
-		if (!(strcmp(known_keys[i].key, key))) {
-			g_free(known_keys[i].key);
-			g_free(known_keys[i].fingerprint);
-			num_known_keys--;
-			if (i < num_known_keys)
-				memcpy(&(known_keys[i]),
-				       &(known_keys[i + 1]),
-				       (num_known_keys - i) * sizeof (irc_key));
-			return 1;
-		}
+	/* the key is there once for each key expand version */
+	rec = g_hash_table_lookup(known_key_names, key);
+	if (!rec)
+		return 0;
 
-	return 0;
+	g_hash_table_remove(known_key_names, key);
+	irc_known_key_free(rec);
+	return 1;
 }
 
 int irc_add_default_key(const char *addr, const char *key)
 {
+	irc_default_key_t rec;
+
 	if (!default_keys) {
-		default_keys = g_new0(irc_default_key, KEY_ALLOC_STEP);
-		num_default_keys = 0;
-		spc_default_keys = KEY_ALLOC_STEP;
+		default_keys = g_hash_table_new((GHashFunc) g_istr_hash,
+						(GCompareFunc) g_istr_equal);
 	}
 	irc_delete_default_key(addr);
 	if (!key)
 		return 1;
 
-	if (num_default_keys == spc_default_keys) {
-		irc_default_key_t n_keys;
-
-		n_keys = g_new0(irc_default_key,
-				KEY_ALLOC_STEP + spc_default_keys);
-		memcpy(n_keys, default_keys,
-		       num_default_keys * sizeof (irc_default_key));
-		g_free(default_keys);
-		default_keys = n_keys;
-		spc_default_keys += KEY_ALLOC_STEP;
-	}
-	default_keys[num_default_keys].key = g_strdup(key);
-	default_keys[num_default_keys].addr = g_strdup(addr);
-	num_default_keys++;
+	rec = g_new0(irc_default_key, 1);
+	rec->key = g_strdup(key);
+	rec->addr = g_strdup(addr);
+	g_hash_table_insert(default_keys, rec->addr, rec);
 	irc_add_known_key(key);
 	return 1;
 }
 
 int irc_delete_default_key(const char *addr)
 {
-	int i;
+	irc_default_key_t rec;
 
 	if (!default_keys)
 		return 0;
 
-	for (i = 0; i < num_default_keys; i++) {
-		if (g_strcasecmp(default_keys[i].addr, addr) == 0) {
-			g_free(default_keys[i].key);
-			g_free(default_keys[i].addr);
-			num_default_keys--;
-			if (i < num_default_keys) {
-				memcpy(&(default_keys[i]),
-				       &(default_keys[i + 1]),
-				       (num_default_keys - i) *
-				       sizeof (irc_default_key));
-			}
-			return 1;
-		}
-	}
+	rec = g_hash_table_lookup(default_keys, addr);
+	if (!rec)
+		return 0;
 
-	return 0;
+	g_hash_table_remove(default_keys, addr);
+	irc_default_key_free(rec);
+	return 1;
 }
 
 char *irc_encrypt_message_to_address(const char *addr, const char *nick,
@@ -297,6 +346,7 @@ char *irc_encrypt_message_to_address(const char *addr, const char *nick,
 char *irc_encrypt_message_with_key(const char *key, const char *nick,
 				   const char *message)
 {
+	irc_key_t rec;
 	char *tmp, *fingerprint, *data, *ret;
         int len;
 
@@ -304,15 +354,24 @@ char *irc_encrypt_message_with_key(const char *key, const char *nick,
 	tmp = g_strdup_printf("%s\001%08lx\001%s", nick,
 			      (long) time(NULL), message);
 	len = strlen(tmp);
-	data = irc_encrypt_buffer(key, tmp, &len);
-	g_free(tmp);
 
-        fingerprint = irc_key_fingerprint(key, irc_default_key_expand_version);
+	/* known keys have their fingerprint and subkeys ready */
+	rec = irc_find_known_key(key, irc_default_key_expand_version);
+	if (rec) {
+		data = irc_encrypt_buffer_with_schedule(rec->ek, tmp, &len);
+		fingerprint = rec->fingerprint;
+	} else {
+		data = irc_encrypt_buffer(key, tmp, &len);
+		fingerprint = irc_key_fingerprint(key,
+					irc_default_key_expand_version);
+	}
+	g_free(tmp);
 
 	ret = g_strdup_printf("|*E*|IDEA|%d.0|%s|%s|",
 			      irc_default_key_expand_version,
 			      fingerprint, data);
-        g_free(fingerprint);
+	if (!rec)
+		g_free(fingerprint);
 	g_free(data);
 
 	return ret;
@@ -321,84 +380,84 @@ char *irc_encrypt_message_with_key(const char *key, const char *nick,
 int irc_decrypt_message(const char *msg,
 			char **message, char **nick, unsigned int *tdiff)
 {
-        const char *key;
-	char *data, *fingerprint, *type;
-	int vmaj, vmin;
-	char **list, *buf;
-	int version, len, ret;
-
-        ret = 0;
-	if (!(irc_parse_encrypted_message(msg, &type, &vmaj, &vmin,
-					  &fingerprint, &data))) {
+	irc_encrypted_message em;
+	irc_key_t rec;
+	char fingerprint[64];
+	char *buf, *p1, *p2;
+	int version, len;
+
+	if (!(irc_parse_encrypted_message(msg, &em))) {
 		if (message)
 			*message = g_strdup("Invalid message format");
 		return 0;
 	}
 
-	if (strcmp(type, "IDEA")) {
+	if (em.type_len != 4 || strncmp(em.type, "IDEA", 4)) {
 		if (message)
 			*message = g_strdup("Unknown algorithm");
-		goto i_d_m_fail;
+		return 0;
 	}
-	if ((vmaj == 1) && (vmin == 0)) {
+	if ((em.ver_maj == 1) && (em.ver_min == 0)) {
 		version = 1;
-	} else if ((vmaj == 2) && (vmin == 0)) {
+	} else if ((em.ver_maj == 2) && (em.ver_min == 0)) {
 		version = 2;
-	} else if ((vmaj == 3) && (vmin == 0)) {
+	} else if ((em.ver_maj == 3) && (em.ver_min == 0)) {
 		version = 3;
 	} else {
 		if (message)
 			*message = g_strdup("Unknown version");
-		goto i_d_m_fail;
+		return 0;
 	}
 
-	key = irc_get_known_key(fingerprint);
-	if (!key) {
+	/* fingerprints of all versions were computed when the key was
+	   added, so this is a single lookup */
+	rec = NULL;
+	if (known_keys && em.fingerprint_len < (int) sizeof (fingerprint)) {
+		memcpy(fingerprint, em.fingerprint, em.fingerprint_len);
+		fingerprint[em.fingerprint_len] = '\0';
+		rec = g_hash_table_lookup(known_keys, fingerprint);
+	}
+	if (!rec) {
 		if (message)
 			*message = g_strdup("Unknown key");
-		goto i_d_m_fail;
+		return 0;
 	}
 
-	len = strlen(data);
-	buf = irc_decrypt_buffer(key, data, &len, version);
+	len = em.data_len;
+	if (rec->version == version)
+		buf = irc_decrypt_buffer_with_schedule(rec->dk, em.data, &len);
+	else
+		buf = irc_decrypt_buffer(rec->key, em.data, &len, version);
 	if (!buf) {
-		g_free(buf);
 		if (message)
 			*message = g_strdup("Decryption failed");
-		goto i_d_m_fail;
+		return 0;
 	}
 
 	// nick + \001 + %08lx(time) + \001 + message
-	list = g_strsplit(buf, "\001", -1);
-	if (strarray_length(list) != 3) {
-		g_strfreev(list);
-
+	p1 = strchr(buf, '\001');
+	p2 = p1 == NULL ? NULL : strchr(p1 + 1, '\001');
+	if (p2 == NULL || p2[1] == '\0' || strchr(p2 + 1, '\001') != NULL) {
+		g_free(buf);
 		if (message)
 			*message = g_strdup("Invalid data contents");
-		goto i_d_m_fail;
+		return 0;
 	}
 
 	if (nick != NULL)
-		*nick = g_strdup(list[0]);
+		*nick = g_strndup(buf, (int) (p1 - buf));
 	if (tdiff != NULL) {
-		*tdiff = time(NULL) - strtol(list[1], NULL, 16);
+		*tdiff = time(NULL) - strtol(p1 + 1, NULL, 16);
 		if (*tdiff < 0) *tdiff = -*tdiff;
 	}
 	if (message != NULL)
-                *message = g_strdup(list[2]);
+                *message = g_strdup(p2 + 1);
 
 	g_free(buf);
-	g_strfreev(list);
-        ret = 1;
-
-i_d_m_fail:
-	g_free(data);
-	g_free(fingerprint);
-	g_free(type);
-	return ret;
+        return 1;
 }
 
 int irc_is_encrypted_message_p(const char *msg)
 {
-	return irc_parse_encrypted_message(msg, NULL, NULL, NULL, NULL, NULL);
+	return irc_parse_encrypted_message(msg, NULL);
 }
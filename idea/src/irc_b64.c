@@ -20,22 +20,119 @@
  */
 #include "module.h"
 
-static char *b64_alpha =
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define B64_SIMD
+#  include <immintrin.h>
+#endif
+
+static const char b64_alpha[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static unsigned char b64_dec[256] = { 255 };
-static int b64_dec_valid = 0;
+/* character -> 6 bit value, 254 for '=' and 255 for anything else */
+static const unsigned char b64_dec[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 254, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+#ifdef B64_SIMD
 
-static void b64_build_dec(void)
+static int b64_ssse3 = -1;
+
+/* 12 bytes from in to 16 characters, reads 16 bytes */
+__attribute__((target("ssse3")))
+static void b64_encode_block_ssse3(const unsigned char *in, char *out)
 {
-    int i;
+    __m128i x, t0, t1, res, less;
+
+    /* bytes 0..11 as 32 bit words of bytes 1,0,2,1 so that each word's
+       four 6 bit values can be shifted apart with 16 bit multiplies */
+    x = _mm_loadu_si128((const __m128i *)in);
+    x = _mm_shuffle_epi8(x, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+					 4, 5, 3, 4, 1, 2, 0, 1));
+    t0 = _mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0fc0fc00)),
+			 _mm_set1_epi32(0x04000040));
+    t1 = _mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003f03f0)),
+			 _mm_set1_epi32(0x01000010));
+    x = _mm_or_si128(t0, t1);
+
+    /* 6 bit value -> offset to add: 0..25 'A', 26..51 'a'-26,
+       52..61 '0'-52, 62 '+'-62, 63 '/'-63 */
+    res = _mm_subs_epu8(x, _mm_set1_epi8(51));
+    less = _mm_cmpgt_epi8(_mm_set1_epi8(26), x);
+    res = _mm_or_si128(res, _mm_and_si128(less, _mm_set1_epi8(13)));
+    res = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+					 '0' - 52, '0' - 52, '0' - 52,
+					 '0' - 52, '0' - 52, '0' - 52,
+					 '0' - 52, '0' - 52, '+' - 62,
+					 '/' - 63, 'A', 0, 0), res);
+    _mm_storeu_si128((__m128i *)out, _mm_add_epi8(res, x));
+}
+
+#define B64_RANGE(x, lo, hi) \
+    _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((lo) - 1)), \
+		  _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), x))
+
+/* 16 characters from in to 12 bytes, writes 16 bytes. Returns 0 without
+   writing anything if there's a character outside the alphabet, '='
+   included. */
+__attribute__((target("ssse3")))
+static int b64_decode_block_ssse3(const unsigned char *in, unsigned char *out)
+{
+    __m128i x, upper, lower, digit, plus, slash, shift;
+
+    x = _mm_loadu_si128((const __m128i *)in);
+    /* bytes >= 0x80 are negative and fall outside all the ranges */
+    upper = B64_RANGE(x, 'A', 'Z');
+    lower = B64_RANGE(x, 'a', 'z');
+    digit = B64_RANGE(x, '0', '9');
+    plus = _mm_cmpeq_epi8(x, _mm_set1_epi8('+'));
+    slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('/'));
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower),
+				       _mm_or_si128(_mm_or_si128(digit, plus),
+						    slash))) != 0xffff)
+	return 0;
+
+    shift = _mm_or_si128(
+	_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+		     _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+	_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+		     _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+				  _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+    x = _mm_add_epi8(x, shift);
+
+    /* join four 6 bit values into 24 bits per 32 bit word, then pack
+       the three bytes of each word in big endian order */
+    x = _mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140));
+    x = _mm_madd_epi16(x, _mm_set1_epi32(0x00011000));
+    x = _mm_shuffle_epi8(x, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+					  14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i *)out, x);
+    return 1;
+}
 
-    for(i = 0; i < 64; i++)
-	b64_dec[(int) b64_alpha[i]] = i;
-    b64_dec['='] = 254;
-    return;
+static int b64_check_ssse3(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
 }
 
+#endif /* B64_SIMD */
 
 char *b64_encode_buffer(const char *buf, int *buflen)
 {
@@ -46,9 +143,18 @@ char *b64_encode_buffer(const char *buf, int *buflen)
     len = *buflen;
     hlp = (unsigned char *)buf;
     r = g_malloc(((len * 4) / 3) + 16);
-    j = 0;
+    i = j = 0;
+#ifdef B64_SIMD
+    if (b64_ssse3 < 0)
+	b64_ssse3 = b64_check_ssse3();
+    if (b64_ssse3) {
+	for (; i + 16 <= len; i += 12, j += 16)
+	    b64_encode_block_ssse3(hlp + i, r + j);
+    }
+#endif
+    r[j] = 0;
 #define hlp_lu(x) (((x) < len) ? hlp[x] : 0)
-    for (i = 0; i < len; i += 3) {
+    for (; i < len; i += 3) {
 	r[j++] = b64_alpha[hlp_lu(i) >> 2];
 	r[j++] = b64_alpha[(63 & (hlp_lu(i) << 4)) | (hlp_lu(i + 1) >> 4)];
 	r[j++] = b64_alpha[(63 & (hlp_lu(i + 1) << 2)) | (hlp_lu(i + 2) >> 6)];
@@ -62,16 +168,40 @@ char *b64_encode_buffer(const char *buf, int *buflen)
     *buflen = j;
     return r;
 }
-    
+
+/* Decode the four characters at hlp to r[*j], returns 0 if they're not
+   base64. */
+static int b64_decode_quad(const unsigned char *hlp, unsigned char *r,
+			   int *j, int *len)
+{
+    int e0, e1, e2, e3;
+
+    e0 = b64_dec[hlp[0]];
+    e1 = b64_dec[hlp[1]];
+    e2 = b64_dec[hlp[2]];
+    e3 = b64_dec[hlp[3]];
+    if ((e0 == 255) || (e1 == 255) || (e2 == 255) || (e3 == 255))
+	return 0;
+    r[(*j)++] = (255 & (e0 << 2)) | (e1 >> 4);
+    if (e2 != 254)
+	r[(*j)++] = (255 & (e1 << 4)) | (e2 >> 2);
+    else
+	(*len)--;
+    if (e3 != 254)
+	r[(*j)++] = (255 & (e2 << 6)) | e3;
+    else
+	(*len)--;
+    return 1;
+}
+
 char *b64_decode_buffer(const char *buf, int *len)
 {
-    int l, i, j, e0, e1, e2, e3;
+    int l, i, j;
+#ifdef B64_SIMD
+    int k;
+#endif
     unsigned char *r, *hlp;
 
-    if (!b64_dec_valid) {
-	b64_build_dec();
-	b64_dec_valid = 1;
-    }
     l = *len;
     
     if (l % 4) {
@@ -81,27 +211,32 @@ char *b64_decode_buffer(const char *buf, int *len)
     *len = l * 3 / 4;
     r = g_malloc(*len + 4);
     hlp = (unsigned char *)buf;
-    j = 0;
-    for (i = 0; i < (l / 4); i++) {
-	e0 = b64_dec[hlp[(i * 4) + 0]];
-	e1 = b64_dec[hlp[(i * 4) + 1]];
-	e2 = b64_dec[hlp[(i * 4) + 2]];
-	e3 = b64_dec[hlp[(i * 4) + 3]];
-	if ((e0 == 255) || (e1 == 255) || (e2 == 255) || (e3 == 255)) {
+    i = j = 0;
+#ifdef B64_SIMD
+    if (b64_ssse3 < 0)
+	b64_ssse3 = b64_check_ssse3();
+    if (b64_ssse3) {
+	/* blocks with '=' or garbage in them go through the quad loop */
+	for (; i + 16 <= l; i += 16) {
+	    if (b64_decode_block_ssse3(hlp + i, r + j)) {
+		j += 12;
+		continue;
+	    }
+	    for (k = 0; k < 16; k += 4) {
+		if (!b64_decode_quad(hlp + i + k, r, &j, len)) {
+		    g_free(r);
+		    return NULL;
+		}
+	    }
+	}
+    }
+#endif
+    for (; i < l; i += 4) {
+	if (!b64_decode_quad(hlp + i, r, &j, len)) {
 	    g_free(r);
 	    return NULL;
 	}
-	r[j++] = (255 & (e0 << 2)) | (e1 >> 4);
-	if (e2 != 254)
-	    r[j++] = (255 & (e1 << 4)) | (e2 >> 2);
-	else
-	    (*len)--;
-	if (e3 != 254)
-	    r[j++] = (255 & (e2 << 6)) | e3;
-	else
-	    (*len)--;
-	r[j] = 0;
     }
+    r[j] = 0;
     return (char *)r;
 }
-
@@ -21,6 +21,40 @@
 #include "module.h"
 #include "crc32.h"
 
+/* Write crc as 8 lowercase hex digits, like "%08x" without the \0 */
+void irc_crc_to_hex(unsigned int crc, char *hex)
+{
+	int i, n;
+
+	for (i = 7; i >= 0; i--, crc >>= 4) {
+		n = crc & 15;
+		/* skip from '9'+1 to 'a' when n > 9 */
+		hex[i] = '0' + n + (((9 - n) >> 31) & ('a' - '0' - 10));
+	}
+}
+
+/* Parse 8 lowercase hex digits written by irc_crc_to_hex(). Returns 0
+   if any of them isn't one. All 8 bytes are always read. */
+int irc_crc_from_hex(const char *hex, unsigned int *crc)
+{
+	int i, c, d, a, ok_d, ok_a, bad;
+	unsigned int val;
+
+	val = 0; bad = 0;
+	for (i = 0; i < 8; i++) {
+		c = (unsigned char) hex[i];
+		d = c - '0';
+		a = c - 'a';
+		/* -1 when in range, 0 when not */
+		ok_d = ~((d | (9 - d)) >> 31);
+		ok_a = ~((a | (5 - a)) >> 31);
+		val = (val << 4) | ((d & ok_d) | ((a + 10) & ok_a));
+		bad |= ~(ok_d | ok_a);
+	}
+	*crc = val;
+	return bad == 0;
+}
+
 char *irc_crc_string(const char *str)
 {
 	return g_strdup_printf("%08x", irc_crc_string_numeric(str));
@@ -43,13 +77,11 @@ unsigned int irc_crc_buffer_numeric(const char *buf, int len)
 
 int irc_check_crc_string(const char *str, const char *crc)
 {
-	int r;
-	char *crc2;
+	unsigned int n;
 
-	crc2 = irc_crc_string(str);
-	r = strcmp(crc, crc2) == 0;
-	g_free(crc2);
-	return r;
+	/* irc_crc_from_hex() would read past the end of a shorter string */
+	return strnlen(crc, 9) == 8 && irc_crc_from_hex(crc, &n) &&
+		irc_crc_string_numeric(str) == n;
 }
 
 int irc_check_crc_string_numeric(const char *str, unsigned int crc)
@@ -59,13 +91,10 @@ int irc_check_crc_string_numeric(const char *str, unsigned int crc)
 
 int irc_check_crc_buffer(const char *str, int len, const char *crc)
 {
-	int r;
-	char *crc2;
+	unsigned int n;
 
-	crc2 = irc_crc_buffer(str, len);
-	r = strcmp(crc, crc2) == 0;
-	g_free(crc2);
-	return r;
+	return strnlen(crc, 9) == 8 && irc_crc_from_hex(crc, &n) &&
+		irc_crc_buffer_numeric(str, len) == n;
 }
 
 int irc_check_crc_buffer_numeric(const char *str, int len, unsigned int crc)
@@ -49,13 +49,12 @@ char *irc_key_fingerprint(const char *key, int version)
     }
 }
 
-char *irc_encrypt_buffer(const char *key, const char *str, int *buflen)
+char *irc_encrypt_buffer_with_schedule(unsigned short *wk, const char *str,
+				       int *buflen)
 {
-    unsigned short wk[52];
     unsigned short ctx[4];
     unsigned short cb[4];
 
-    unsigned short *tmpkey;
     int i, padlen, len;
     unsigned char *buf;
     char *hlp;
@@ -73,18 +72,13 @@ char *irc_encrypt_buffer(const char *key, const char *str, int *buflen)
     for (i = 0; i < padlen; i++)
 	buf[i] = random() & 255;
     memcpy(&(buf[i + 8]), str, len);
-    hlp = irc_crc_buffer(str, len);
-    memcpy(&(buf[i]), hlp, 8);
-    g_free(hlp);
+    irc_crc_to_hex(irc_crc_buffer_numeric(str, len), (char *)&(buf[i]));
     buf[0] = ((unsigned char)(buf[0] & 31)) |
 	     ((unsigned char)(((padlen - 1) & 7) << 5));
     len += 8 + padlen;
 
 /*fprintf(stderr, ">>>str=\"%s\", len=%d, pad=%d\n", str, len, padlen);*/
 
-    tmpkey = irc_build_key(key, irc_key_expand_version());
-    ExpandUserKey(tmpkey, wk);
-    g_free(tmpkey);
     ctx[0] = ctx[1] = ctx[2] = ctx[3] = 0;
     for (i = 0; i < (len / 8); i++) {
 	cb[0] = (((unsigned short)(buf[(i * 8) + 0]) << 8) | buf[(i * 8) + 1])
@@ -111,16 +105,20 @@ char *irc_encrypt_buffer(const char *key, const char *str, int *buflen)
     return hlp;
 }
 
-char *irc_decrypt_buffer(const char *key, const char *str,
-			 int *buflen, int version)
+char *irc_encrypt_buffer(const char *key, const char *str, int *buflen)
 {
     unsigned short wk[52];
-    unsigned short ctx[4];
-    unsigned short cb[4];
-    unsigned short tb[4];
-    unsigned short *tmpkey;
+
+    irc_get_key_schedule(key, irc_key_expand_version(), wk, NULL);
+    return irc_encrypt_buffer_with_schedule(wk, str, buflen);
+}
+
+char *irc_decrypt_buffer_with_schedule(unsigned short *wk, const char *str,
+				       int *buflen)
+{
     int i, padlen;
     int len;
+    unsigned int crc;
     unsigned char *buf, *hlp;
 
     buf = (unsigned char *)b64_decode_buffer(str, buflen);
@@ -131,54 +129,38 @@ char *irc_decrypt_buffer(const char *key, const char *str,
 	g_free(buf);
 	return NULL;
     }
-    tmpkey = irc_build_key(key, version);
-    ExpandUserKey(tmpkey, wk);
-    g_free(tmpkey);
-    InvertIdeaKey(wk, wk);
-    ctx[0] = ctx[1] = ctx[2] = ctx[3] = 0;
-    for (i = 0; i < (len / 8); i++) {
-	tb[0] = cb[0] = 
-	    (((unsigned short)(buf[(i * 8) + 0]) << 8) | buf[(i * 8) + 1]);
-	tb[1] = cb[1] =
-	    (((unsigned short)(buf[(i * 8) + 2]) << 8) | buf[(i * 8) + 3]);
-	tb[2] = cb[2] = 
-	    (((unsigned short)(buf[(i * 8) + 4]) << 8) | buf[(i * 8) + 5]);
-	tb[3] = cb[3] = 
-	    (((unsigned short)(buf[(i * 8) + 6]) << 8) | buf[(i * 8) + 7]);
-	Idea(cb, cb, wk);
-	cb[0] = cb[0] ^ ctx[0];
-	cb[1] = cb[1] ^ ctx[1];
-	cb[2] = cb[2] ^ ctx[2];
-	cb[3] = cb[3] ^ ctx[3];
-	ctx[0] = tb[0];
-	ctx[1] = tb[1];
-	ctx[2] = tb[2];
-	ctx[3] = tb[3];
-	buf[(i * 8) + 0] = (cb[0] >> 8) & 0xff;
-	buf[(i * 8) + 1] = cb[0] & 0xff;
-	buf[(i * 8) + 2] = (cb[1] >> 8) & 0xff;
-	buf[(i * 8) + 3] = cb[1] & 0xff;
-	buf[(i * 8) + 4] = (cb[2] >> 8) & 0xff;
-	buf[(i * 8) + 5] = cb[2] & 0xff;
-	buf[(i * 8) + 6] = (cb[3] >> 8) & 0xff;
-	buf[(i * 8) + 7] = cb[3] & 0xff;
-    }
-    buf[i * 8] = 0;
+    /* CBC decryption doesn't chain through the cipher, so decrypt all
+       the blocks at once and xor each with the previous ciphertext
+       block afterwards */
+    hlp = g_malloc(len + 1);
+    IdeaECB(buf, hlp, len / 8, wk);
+    for (i = 8; i < len; i++)
+	hlp[i] ^= buf[i - 8];
+    g_free(buf);
+    buf = hlp;
+    buf[len] = 0;
     padlen = (buf[0] >> 5) + 1;
 /*fprintf(stderr, ">>>str=\"...\", len=%d, pad=%d\n", len, padlen);*/
-    hlp = (unsigned char *)g_strdup((char *)&(buf[padlen]));
-    g_free(buf);
-    buf = (unsigned char *)hlp;
-    hlp = (unsigned char *)g_strdup((char *)&(buf[8]));
-    buf[8] = 0;
-    (*buflen) -= padlen + 8;
-    if (!(irc_check_crc_buffer((char *)hlp, *buflen, (char *)buf))) {
-	g_free(hlp);
+    /* pad, 8 hex digits of CRC, the message */
+    hlp = &(buf[padlen + 8]);
+    len -= padlen + 8;
+    if (!(irc_crc_from_hex((char *)&(buf[padlen]), &crc)) ||
+	irc_crc_buffer_numeric((char *)hlp, len) != crc) {
 	g_free(buf);
 	return NULL;
     }
-    g_free(buf);
-    return (char *)hlp;
+    memmove(buf, hlp, len + 1);
+    *buflen = len;
+    return (char *)buf;
+}
+
+char *irc_decrypt_buffer(const char *key, const char *str,
+			 int *buflen, int version)
+{
+    unsigned short wk[52];
+
+    irc_get_key_schedule(key, version, NULL, wk);
+    return irc_decrypt_buffer_with_schedule(wk, str, buflen);
 }
 
 /*
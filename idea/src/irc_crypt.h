@@ -112,6 +112,14 @@ int irc_key_expand_version(void);
  */
 unsigned short *irc_build_key(const char *str, int version);
 
+/*
+ * Get the expanded IDEA encryption (ek) and decryption (dk) subkeys
+ * for key, either of which may be NULL.  Schedules of known keys are
+ * computed only once when the key is added.
+ */
+void irc_get_key_schedule(const char *key, int version,
+			  unsigned short *ek, unsigned short *dk);
+
 /*
  * Expand a crypto-key-fingerprint from null-terminated string.
  */
@@ -155,7 +155,6 @@ static unsigned short *idea_v3_cleartext_string_to_block_list(const char *str,
     int padlen, i;
     unsigned char *buf;
     unsigned short *ret_buf;
-    char *hlp;
 
     if (len < 0)
 	len = strlen(str);
@@ -166,9 +165,7 @@ static unsigned short *idea_v3_cleartext_string_to_block_list(const char *str,
     for (i = 0; i < padlen; i++)
         buf[i] = 0;
     memcpy(&(buf[i + 8]), str, len);
-    hlp = irc_crc_buffer(str, len);
-    memcpy(&(buf[i]), hlp, 8);
-    g_free(hlp);
+    irc_crc_to_hex(irc_crc_buffer_numeric(str, len), (char *)&(buf[i]));
     buf[0] = ((unsigned char)(buf[0] & 31)) |
 	     ((unsigned char)(((padlen - 1) & 7) << 5));
     len += 8 + padlen;
@@ -17,6 +17,8 @@ int irc_check_crc_string(const char *str, const char *crc);
 int irc_check_crc_buffer(const char *str, int len, const char *crc);
 int irc_check_crc_string_numeric(const char *str, unsigned int crc);
 int irc_check_crc_buffer_numeric(const char *str, int len, unsigned int crc);
+void irc_crc_to_hex(unsigned int crc, char *hex);
+int irc_crc_from_hex(const char *hex, unsigned int *crc);
 
 /* B64 */
 char *b64_encode_buffer(const char *buf, int *len);
@@ -25,6 +27,8 @@ char *b64_decode_buffer(const char *buf, int *len);
 /* CRYPT */
 char *irc_encrypt_buffer(const char *key, const char *str, int *len);
 char *irc_decrypt_buffer(const char *key, const char *str, int *len, int version);
+char *irc_encrypt_buffer_with_schedule(unsigned short *ek, const char *str, int *len);
+char *irc_decrypt_buffer_with_schedule(unsigned short *dk, const char *str, int *len);
 char *irc_key_fingerprint(const char *key, int version);
 
 /* irc_idea_v[123] */
@@ -0,0 +1,23 @@
+#ifndef __COMMON_H
+#define __COMMON_H
+
+/* The parts of irssi's headers the crypto code uses, so the tests can be
+   built and run without an irssi source tree. Everything declared here
+   is implemented by ../fake-irssi.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <glib.h>
+
+typedef struct _SERVER_REC SERVER_REC;
+
+#endif
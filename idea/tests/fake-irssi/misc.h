@@ -0,0 +1,8 @@
+#ifndef __MISC_H
+#define __MISC_H
+
+/* Case-insensitive string hash functions */
+int g_istr_equal(gconstpointer v, gconstpointer v2);
+unsigned int g_istr_hash(gconstpointer v);
+
+#endif
@@ -0,0 +1,906 @@
+/*
+ test-crypt.c : IDEA crypto tests and benchmarks
+
+    Copyright (C) 1999 Timo Sirainen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "module.h"
+#include "idea.h"
+#include "crc32.h"
+
+/* AddressSanitizer has its own malloc() */
+#if defined (__GLIBC__) && !defined (__SANITIZE_ADDRESS__)
+#  define COUNT_ALLOCS
+#endif
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define HAVE_RDTSC
+#  include <x86intrin.h>
+#endif
+
+static int failures;
+
+#define test_assert(cond) \
+	G_STMT_START { \
+	  if (!(cond)) { \
+		  fprintf(stderr, "%s:%d: assert failed: %s\n", \
+			  __FILE__, __LINE__, #cond); \
+		  failures++; \
+	  } \
+	} G_STMT_END
+
+/* usecs since some fixed time */
+static double time_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* CPU cycles since some fixed time, 0 if they can't be read */
+static double time_cycles(void)
+{
+#ifdef HAVE_RDTSC
+	return (double) __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void random_fill(unsigned char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand() & 0xff;
+}
+
+static void random_key(u_int16 *ek)
+{
+	userkey_t(userkey);
+	int i;
+
+	for (i = 0; i < userKeyLen; i++)
+		userkey[i] = rand() & 0xffff;
+	ExpandUserKey(userkey, ek);
+}
+
+/* ---- IDEA kernels ---- */
+
+#define ECB_MAX_BLOCKS 40
+#define ECB_BENCH_BLOCKS 8192 /* 64kB */
+#define ECB_BENCH_ROUNDS 64
+
+static const char *idea_kernels[] = { "scalar", "sse2", "avx2" };
+
+/* IdeaECB() the way the CBC loop used to do it, one Idea() per block */
+static void old_idea_ecb(const u_int8 *in, u_int8 *out, int blocks,
+			 u_int16 *key)
+{
+	u_int16 cb[dataLen];
+	int i, j;
+
+	for (i = 0; i < blocks; i++, in += dataSize, out += dataSize) {
+		for (j = 0; j < dataLen; j++)
+			cb[j] = ((u_int16) in[j*2] << 8) | in[j*2+1];
+		Idea(cb, cb, key);
+		for (j = 0; j < dataLen; j++) {
+			out[j*2] = cb[j] >> 8;
+			out[j*2+1] = cb[j] & 0xff;
+		}
+	}
+}
+
+static void test_idea_kernel(void)
+{
+	unsigned char in[ECB_MAX_BLOCKS*dataSize];
+	unsigned char expected[sizeof(in)], out[sizeof(in)];
+	userkey_t(userkey);
+	key_t(ek);
+	key_t(dk);
+	int blocks;
+
+	for (blocks = 0; blocks <= ECB_MAX_BLOCKS; blocks++) {
+		random_key(ek);
+		random_fill(in, sizeof(in));
+		old_idea_ecb(in, expected, blocks, ek);
+		IdeaECB(in, out, blocks, ek);
+		test_assert(memcmp(expected, out, blocks*dataSize) == 0);
+
+		/* in place, and back with the inverted key */
+		InvertIdeaKey(ek, dk);
+		IdeaECB(out, out, blocks, dk);
+		test_assert(memcmp(in, out, blocks*dataSize) == 0);
+	}
+
+	/* a 0 operand of the multiplication stands for 65536 */
+	memset(userkey, 0, sizeof(userkey));
+	ExpandUserKey(userkey, ek);
+	memset(in, 0, sizeof(in));
+	old_idea_ecb(in, expected, ECB_MAX_BLOCKS, ek);
+	IdeaECB(in, out, ECB_MAX_BLOCKS, ek);
+	test_assert(memcmp(expected, out, sizeof(out)) == 0);
+}
+
+static void bench_idea_kernel(const char *name, int kernel)
+{
+	unsigned char *buf;
+	key_t(ek);
+	double usecs, cycles;
+	int i;
+
+	buf = g_malloc(ECB_BENCH_BLOCKS*dataSize);
+	random_fill(buf, ECB_BENCH_BLOCKS*dataSize);
+	random_key(ek);
+
+	usecs = time_usecs(); cycles = time_cycles();
+	for (i = 0; i < ECB_BENCH_ROUNDS; i++) {
+		if (kernel < 0)
+			old_idea_ecb(buf, buf, ECB_BENCH_BLOCKS, ek);
+		else
+			IdeaECB(buf, buf, ECB_BENCH_BLOCKS, ek);
+	}
+	cycles = time_cycles() - cycles;
+	usecs = time_usecs() - usecs;
+
+	printf("idea %-7s: %.1f MB/s, %.1f cycles/byte\n", name,
+	       (double) ECB_BENCH_BLOCKS*dataSize*ECB_BENCH_ROUNDS /
+	       (usecs < 1 ? 1 : usecs),
+	       cycles / ((double) ECB_BENCH_BLOCKS*dataSize*ECB_BENCH_ROUNDS));
+	g_free(buf);
+}
+
+/* The whole decryption goes through IdeaECB() */
+static void test_idea_buffer(void)
+{
+	char str[100], *enc, *dec;
+	int len, declen;
+
+	random_fill((unsigned char *) str, sizeof(str));
+	for (len = 0; len < (int) sizeof(str); len++) {
+		declen = len;
+		enc = irc_encrypt_buffer("testkey", str, &declen);
+		dec = irc_decrypt_buffer("testkey", enc, &declen,
+					 irc_key_expand_version());
+		test_assert(dec != NULL && declen == len &&
+			    memcmp(dec, str, len) == 0);
+		g_free(enc);
+		g_free(dec);
+	}
+}
+
+static void test_idea(void)
+{
+	int kernel;
+
+	bench_idea_kernel("Idea()", -1);
+	for (kernel = IDEA_KERNEL_SCALAR; kernel <= IDEA_KERNEL_AVX2; kernel++) {
+		if (!IdeaECBKernel(kernel)) {
+			printf("idea %-7s: not supported by this CPU\n",
+			       idea_kernels[kernel]);
+			continue;
+		}
+
+		test_idea_kernel();
+		test_idea_buffer();
+		bench_idea_kernel(idea_kernels[kernel], kernel);
+	}
+	IdeaECBKernel(IDEA_KERNEL_BEST);
+}
+
+/* ---- key schedules ---- */
+
+#define SCHEDULE_MESSAGES 2000
+
+static void test_schedule_equal(const char *key, int version)
+{
+	unsigned short *userkey;
+	key_t(ek);
+	key_t(dk);
+	key_t(cached_ek);
+	key_t(cached_dk);
+
+	userkey = irc_build_key(key, version);
+	ExpandUserKey(userkey, ek);
+	InvertIdeaKey(ek, dk);
+	g_free(userkey);
+
+	irc_get_key_schedule(key, version, cached_ek, cached_dk);
+	test_assert(memcmp(ek, cached_ek, sizeof(ek)) == 0);
+	test_assert(memcmp(dk, cached_dk, sizeof(dk)) == 0);
+}
+
+/* encrypt and decrypt a line of a busy channel, usecs per line */
+static double bench_schedule(const char *key)
+{
+	static const char line[] = "nick\0014c0ffee0\001"
+		"a line of a busy channel, long enough to fill a few blocks";
+	char *enc, *dec;
+	double usecs;
+	int i, len;
+
+	usecs = time_usecs();
+	for (i = 0; i < SCHEDULE_MESSAGES; i++) {
+		len = sizeof(line)-1;
+		enc = irc_encrypt_buffer(key, line, &len);
+		dec = irc_decrypt_buffer(key, enc, &len,
+					 irc_key_expand_version());
+		test_assert(dec != NULL);
+		g_free(enc);
+		g_free(dec);
+	}
+	return (time_usecs() - usecs) / SCHEDULE_MESSAGES;
+}
+
+static void test_schedule(void)
+{
+	char *msg, *text;
+	double before, after;
+	int version;
+
+	/* a key that isn't known is expanded every time */
+	before = bench_schedule("channel key");
+
+	irc_add_known_key("channel key");
+	for (version = 1; version <= 3; version++)
+		test_schedule_equal("channel key", version);
+	after = bench_schedule("channel key");
+	printf("schedule: before %.1f usecs/message, after %.1f usecs/message\n",
+	       before, after);
+
+	/* deleting the key drops its schedules */
+	msg = irc_encrypt_message_with_key("channel key", "nick", "hello");
+	test_assert(irc_delete_known_key("channel key"));
+	test_assert(!irc_decrypt_message(msg, &text, NULL, NULL));
+	test_assert(strcmp(text, "Unknown key") == 0);
+	g_free(text);
+	for (version = 1; version <= 3; version++)
+		test_schedule_equal("channel key", version);
+
+	/* and adding it back makes the message readable again */
+	irc_add_known_key("channel key");
+	test_assert(irc_decrypt_message(msg, &text, NULL, NULL));
+	test_assert(strcmp(text, "hello") == 0);
+	g_free(text);
+	g_free(msg);
+	irc_delete_all_known_keys();
+}
+
+/* ---- key stores ---- */
+
+#define STORE_KEYS 10000
+
+/* irc_get_default_key() as it was before the hash table */
+static const char *old_get_default_key(char **addrs, char **keys,
+				       const char *addr)
+{
+	int i;
+
+	for (i = 0; i < STORE_KEYS; i++) {
+		if (g_strcasecmp(addrs[i], addr) == 0)
+			return keys[i];
+	}
+	return NULL;
+}
+
+static void test_store(void)
+{
+	char *addrs[STORE_KEYS], *keys[STORE_KEYS];
+	char *msg, *text, upper[64];
+	const char *key;
+	double usecs, before, after;
+	int i, found;
+
+	usecs = time_usecs();
+	for (i = 0; i < STORE_KEYS; i++) {
+		addrs[i] = g_strdup_printf("#channel%d", i);
+		keys[i] = g_strdup_printf("key of channel %d", i);
+		irc_add_default_key(addrs[i], keys[i]);
+	}
+	printf("store: %d default keys added in %.0f msecs\n", STORE_KEYS,
+	       (time_usecs() - usecs) / 1000);
+
+	/* lookups ignore case */
+	found = 0;
+	for (i = 0; i < STORE_KEYS; i++) {
+		g_snprintf(upper, sizeof(upper), "#CHANNEL%d", i);
+		key = irc_get_default_key(upper);
+		if (key != NULL && strcmp(key, keys[i]) == 0)
+			found++;
+	}
+	test_assert(found == STORE_KEYS);
+	test_assert(irc_get_default_key("#channel") == NULL);
+
+	usecs = time_usecs();
+	for (i = 0; i < STORE_KEYS; i++)
+		test_assert(old_get_default_key(addrs, keys, addrs[i]) != NULL);
+	before = (time_usecs() - usecs) * 1000 / STORE_KEYS;
+	usecs = time_usecs();
+	for (i = 0; i < STORE_KEYS; i++)
+		test_assert(irc_get_default_key(addrs[i]) != NULL);
+	after = (time_usecs() - usecs) * 1000 / STORE_KEYS;
+	printf("store: %d keys, before %.0f ns/lookup, after %.0f ns/lookup\n",
+	       STORE_KEYS, before, after);
+
+	/* every default key is known, so messages with the last one
+	   decrypt */
+	msg = irc_encrypt_message_to_address(addrs[STORE_KEYS-1], "nick",
+					     "hello");
+	test_assert(msg != NULL);
+	test_assert(irc_decrypt_message(msg, &text, NULL, NULL));
+	test_assert(strcmp(text, "hello") == 0);
+	g_free(text);
+	g_free(msg);
+
+	/* replacing and deleting */
+	irc_add_default_key("#Channel1", "another key");
+	test_assert(strcmp(irc_get_default_key("#channel1"),
+			   "another key") == 0);
+	test_assert(irc_delete_default_key("#CHANNEL1"));
+	test_assert(irc_get_default_key("#channel1") == NULL);
+	test_assert(!irc_delete_default_key("#channel1"));
+	test_assert(irc_encrypt_message_to_address("#channel1", "nick",
+						   "hello") == NULL);
+
+	irc_delete_all_keys();
+	test_assert(irc_get_default_key(addrs[0]) == NULL);
+	for (i = 0; i < STORE_KEYS; i++) {
+		g_free(addrs[i]);
+		g_free(keys[i]);
+	}
+}
+
+/* ---- fingerprint lookups ---- */
+
+#define FINGERPRINT_KEYS 1000
+#define FINGERPRINT_MESSAGES 2000
+
+/* irc_decrypt_message() finding the key and decrypting as it did before
+   the fingerprint index: a scan over all the fingerprints, and a key
+   expansion for every message */
+static char *old_decrypt(char **keys, char **fingerprints,
+			 const char *fingerprint, const char *data,
+			 int version)
+{
+	unsigned short *userkey;
+	key_t(ek);
+	key_t(dk);
+	int i, len;
+
+	for (i = 0; i < FINGERPRINT_KEYS; i++) {
+		if (g_strcasecmp(fingerprints[i], fingerprint) == 0)
+			break;
+	}
+	if (i == FINGERPRINT_KEYS)
+		return NULL;
+
+	userkey = irc_build_key(keys[i], version);
+	ExpandUserKey(userkey, ek);
+	InvertIdeaKey(ek, dk);
+	g_free(userkey);
+
+	len = strlen(data);
+	return irc_decrypt_buffer_with_schedule(dk, data, &len);
+}
+
+static void test_fingerprint(void)
+{
+	char *keys[FINGERPRINT_KEYS], *fingerprints[FINGERPRINT_KEYS];
+	char *msg, *text, *nick, *p, **fields, *buf;
+	double usecs, before, after;
+	int i, version;
+
+	for (i = 0; i < FINGERPRINT_KEYS; i++) {
+		keys[i] = g_strdup_printf("known key %d", i);
+		fingerprints[i] = irc_key_fingerprint(keys[i], 3);
+		irc_add_known_key(keys[i]);
+	}
+
+	/* every version's fingerprint finds the key */
+	for (version = 1; version <= 3; version++) {
+		irc_set_key_expand_version(version);
+		msg = irc_encrypt_message_with_key(keys[FINGERPRINT_KEYS/2],
+						   "nick", "hello");
+		test_assert(irc_decrypt_message(msg, &text, &nick, NULL));
+		test_assert(strcmp(text, "hello") == 0);
+		test_assert(strcmp(nick, "nick") == 0);
+		g_free(text);
+		g_free(nick);
+
+		/* whatever the fingerprint's case is */
+		fields = g_strsplit(msg, "|", -1);
+		for (p = fields[4]; *p != '\0'; p++)
+			*p = toupper((unsigned char) *p);
+		g_free(msg);
+		msg = g_strjoinv("|", fields);
+		g_strfreev(fields);
+		test_assert(irc_decrypt_message(msg, &text, NULL, NULL));
+		test_assert(strcmp(text, "hello") == 0);
+		g_free(text);
+		g_free(msg);
+	}
+	irc_set_key_expand_version(3);
+
+	msg = irc_encrypt_message_with_key("unknown key", "nick", "hello");
+	test_assert(!irc_decrypt_message(msg, &text, NULL, NULL));
+	test_assert(strcmp(text, "Unknown key") == 0);
+	g_free(text);
+	g_free(msg);
+
+	/* longer than any fingerprint */
+	msg = g_strdup_printf("|*E*|IDEA|3.0|%0200d|AAAAAAAAAAAAAAAAAAAAAA==|", 0);
+	test_assert(!irc_decrypt_message(msg, &text, NULL, NULL));
+	test_assert(strcmp(text, "Unknown key") == 0);
+	g_free(text);
+	g_free(msg);
+
+	msg = irc_encrypt_message_with_key(keys[FINGERPRINT_KEYS-1], "nick",
+					   "a line of a busy channel");
+	fields = g_strsplit(msg, "|", -1);
+
+	usecs = time_usecs();
+	for (i = 0; i < FINGERPRINT_MESSAGES; i++) {
+		buf = old_decrypt(keys, fingerprints, fields[4], fields[5], 3);
+		test_assert(buf != NULL);
+		g_free(buf);
+	}
+	before = (time_usecs() - usecs) / FINGERPRINT_MESSAGES;
+
+	usecs = time_usecs();
+	for (i = 0; i < FINGERPRINT_MESSAGES; i++) {
+		test_assert(irc_decrypt_message(msg, &text, NULL, NULL));
+		g_free(text);
+	}
+	after = (time_usecs() - usecs) / FINGERPRINT_MESSAGES;
+	printf("fingerprint: %d keys, before %.1f usecs/message, "
+	       "after %.1f usecs/message\n", FINGERPRINT_KEYS, before, after);
+
+	g_strfreev(fields);
+	g_free(msg);
+	irc_delete_all_known_keys();
+	for (i = 0; i < FINGERPRINT_KEYS; i++) {
+		g_free(keys[i]);
+		g_free(fingerprints[i]);
+	}
+}
+
+/* ---- CRC ---- */
+
+#define CRC_MAX_LEN 1100
+#define CRC_BENCH_SIZE 65536
+#define CRC_BENCH_ROUNDS 64
+#define CRC_LINE_SIZE 100
+#define CRC_LINE_ROUNDS 200000
+
+/* polynomial $edb88320, starting from 0 and not inverted at the end */
+static const struct {
+	const char *data;
+	unsigned int crc;
+} crc_vectors[] = {
+	{ "", 0x00000000 },
+	{ "a", 0x3ab551ce },
+	{ "abc", 0xca6598d0 },
+	{ "123456789", 0x2dfd2d88 },
+	{ "message digest", 0xf1aee4b8 },
+	{ "The quick brown fox jumps over the lazy dog", 0xb9c60808 }
+};
+
+/* one bit at a time, straight from the polynomial */
+static unsigned int crc32_bitwise(const unsigned char *s, unsigned int len)
+{
+	unsigned int crc;
+	int i;
+
+	crc = 0;
+	for (; len > 0; len--, s++) {
+		crc ^= *s;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return crc;
+}
+
+/* idea_crc32() as it was, a table lookup per byte */
+static unsigned int crc32_table[256];
+
+static unsigned int old_idea_crc32(const unsigned char *s, unsigned int len)
+{
+	unsigned int crc;
+
+	crc = 0;
+	for (; len > 0; len--, s++)
+		crc = crc32_table[(crc ^ *s) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void bench_crc(const char *name, unsigned char *buf, int size,
+		      int rounds)
+{
+	double usecs, before, after;
+	unsigned int crc;
+	int i;
+
+	crc = 0;
+	usecs = time_usecs();
+	for (i = 0; i < rounds; i++)
+		crc += old_idea_crc32(buf, size);
+	before = time_usecs() - usecs;
+
+	usecs = time_usecs();
+	for (i = 0; i < rounds; i++)
+		crc -= idea_crc32(buf, size);
+	after = time_usecs() - usecs;
+	test_assert(crc == 0);
+
+	printf("crc32 %s: before %.0f MB/s, after %.0f MB/s\n", name,
+	       (double) size*rounds / (before < 1 ? 1 : before),
+	       (double) size*rounds / (after < 1 ? 1 : after));
+}
+
+static void test_crc(void)
+{
+	unsigned char *buf, ff[100];
+	unsigned int i;
+	int len, offset, bad;
+
+	for (i = 0; i < 256; i++) {
+		ff[0] = i;
+		crc32_table[i] = crc32_bitwise(ff, 1);
+	}
+
+	for (i = 0; i < sizeof(crc_vectors)/sizeof(crc_vectors[0]); i++) {
+		len = strlen(crc_vectors[i].data);
+		test_assert(idea_crc32((const unsigned char *)
+				       crc_vectors[i].data, len) ==
+			    crc_vectors[i].crc);
+	}
+	memset(ff, 0xff, sizeof(ff));
+	test_assert(idea_crc32(ff, sizeof(ff)) == 0x9a5a404b);
+
+	/* every length, at every alignment */
+	buf = g_malloc(CRC_BENCH_SIZE);
+	random_fill(buf, CRC_BENCH_SIZE);
+	bad = 0;
+	for (offset = 0; offset < 16; offset++) {
+		for (len = 0; len <= CRC_MAX_LEN; len++) {
+			if (idea_crc32(buf + offset, len) !=
+			    crc32_bitwise(buf + offset, len))
+				bad++;
+		}
+	}
+	test_assert(bad == 0);
+	test_assert(idea_crc32(buf, CRC_BENCH_SIZE) ==
+		    crc32_bitwise(buf, CRC_BENCH_SIZE));
+
+	bench_crc("64kB", buf, CRC_BENCH_SIZE, CRC_BENCH_ROUNDS);
+	bench_crc("line", buf, CRC_LINE_SIZE, CRC_LINE_ROUNDS);
+	g_free(buf);
+}
+
+/* ---- CRC checks and allocations ---- */
+
+#ifdef COUNT_ALLOCS
+/* glibc lets malloc() be replaced, so every allocation glib and the
+   crypto code do can be counted */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long alloc_count;
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+/* 4 for encrypting and 4 for decrypting with the strings returned, and
+   a couple more where g_strdup_printf() needs them */
+#define ROUND_TRIP_MAX_ALLOCS 12
+
+static void test_crc_check(void)
+{
+	char hex[9], *str, *msg, *text, *nick;
+	unsigned int crc;
+
+	crc = irc_crc_string_numeric("hello");
+	irc_crc_to_hex(crc, hex);
+	hex[8] = '\0';
+	test_assert(irc_check_crc_string("hello", hex));
+	test_assert(irc_check_crc_buffer("hello", 5, hex));
+	test_assert(!irc_check_crc_string("hellO", hex));
+
+	str = irc_crc_string("hello");
+	test_assert(strcmp(str, hex) == 0);
+	g_free(str);
+
+	/* exactly 8 lowercase hex digits, and nothing is read past a
+	   shorter string's end */
+	str = g_strndup(hex, 3);
+	test_assert(!irc_check_crc_string("hello", str));
+	test_assert(!irc_check_crc_buffer("hello", 5, str));
+	g_free(str);
+
+	str = g_strconcat(hex, "0", NULL);
+	test_assert(!irc_check_crc_string("hello", str));
+	g_free(str);
+
+	str = g_strdup(hex);
+	str[0] = 'g';
+	test_assert(!irc_check_crc_string("hello", str));
+	str[0] = 'A';
+	test_assert(!irc_check_crc_string("hello", str));
+	g_free(str);
+
+	/* encrypting and decrypting a line allocates only what it
+	   returns and a few buffers */
+	irc_add_known_key("channel key");
+	msg = irc_encrypt_message_with_key("channel key", "nick", "warm up");
+	g_free(msg);
+#ifdef COUNT_ALLOCS
+	alloc_count = 0;
+#endif
+	msg = irc_encrypt_message_with_key("channel key", "nick", "hello");
+	test_assert(irc_decrypt_message(msg, &text, &nick, NULL));
+#ifdef COUNT_ALLOCS
+	printf("crc: %lu allocations for an encrypt-decrypt round trip\n",
+	       alloc_count);
+	test_assert(alloc_count <= ROUND_TRIP_MAX_ALLOCS);
+#else
+	printf("crc: allocations can't be counted here\n");
+#endif
+	test_assert(strcmp(text, "hello") == 0);
+	g_free(text);
+	g_free(nick);
+	g_free(msg);
+	irc_delete_all_known_keys();
+}
+
+/* ---- base64 ---- */
+
+#define B64_MAX_LEN 300
+#define B64_BENCH_SIZE 65536
+#define B64_BENCH_ROUNDS 64
+
+static const char old_b64_alpha[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static unsigned char old_b64_dec[256];
+
+/* b64_encode_buffer() and b64_decode_buffer() as they were, except that
+   the decode table now rejects all the characters outside the alphabet
+   and not just \0 */
+static void old_b64_build_dec(void)
+{
+	int i;
+
+	memset(old_b64_dec, 255, sizeof(old_b64_dec));
+	for (i = 0; i < 64; i++)
+		old_b64_dec[(int) old_b64_alpha[i]] = i;
+	old_b64_dec['='] = 254;
+}
+
+static char *old_b64_encode_buffer(const char *buf, int *buflen)
+{
+	char *r;
+	int i, j, len;
+	unsigned char *hlp;
+
+	len = *buflen;
+	hlp = (unsigned char *) buf;
+	r = g_malloc(((len * 4) / 3) + 16);
+	j = 0;
+#define hlp_lu(x) (((x) < len) ? hlp[x] : 0)
+	for (i = 0; i < len; i += 3) {
+		r[j++] = old_b64_alpha[hlp_lu(i) >> 2];
+		r[j++] = old_b64_alpha[(63 & (hlp_lu(i) << 4)) |
+				       (hlp_lu(i + 1) >> 4)];
+		r[j++] = old_b64_alpha[(63 & (hlp_lu(i + 1) << 2)) |
+				       (hlp_lu(i + 2) >> 6)];
+		r[j++] = old_b64_alpha[hlp_lu(i + 2) & 63];
+		r[j] = 0;
+		if ((i + 1) == len)
+			r[j - 1] = r[j - 2] = '=';
+		if ((i + 2) == len)
+			r[j - 1] = '=';
+	}
+#undef hlp_lu
+	r[j] = 0;
+	*buflen = j;
+	return r;
+}
+
+static char *old_b64_decode_buffer(const char *buf, int *len)
+{
+	int l, i, j, e0, e1, e2, e3;
+	unsigned char *r, *hlp;
+
+	l = *len;
+	l -= (l % 4);
+	*len = l * 3 / 4;
+	r = g_malloc(*len + 4);
+	hlp = (unsigned char *) buf;
+	j = 0;
+	for (i = 0; i < (l / 4); i++) {
+		e0 = old_b64_dec[hlp[(i * 4) + 0]];
+		e1 = old_b64_dec[hlp[(i * 4) + 1]];
+		e2 = old_b64_dec[hlp[(i * 4) + 2]];
+		e3 = old_b64_dec[hlp[(i * 4) + 3]];
+		if ((e0 == 255) || (e1 == 255) || (e2 == 255) || (e3 == 255)) {
+			g_free(r);
+			return NULL;
+		}
+		r[j++] = (255 & (e0 << 2)) | (e1 >> 4);
+		if (e2 != 254)
+			r[j++] = (255 & (e1 << 4)) | (e2 >> 2);
+		else
+			(*len)--;
+		if (e3 != 254)
+			r[j++] = (255 & (e2 << 6)) | e3;
+		else
+			(*len)--;
+	}
+	r[j] = 0;
+	return (char *) r;
+}
+
+/* both decoders agree on str */
+static int b64_decode_same(const char *str, int len)
+{
+	char *old, *new;
+	int old_len, new_len, same;
+
+	old_len = new_len = len;
+	old = old_b64_decode_buffer(str, &old_len);
+	new = b64_decode_buffer(str, &new_len);
+	if (old == NULL || new == NULL)
+		same = old == new;
+	else {
+		same = old_len == new_len &&
+			memcmp(old, new, old_len + 1) == 0;
+	}
+	g_free(old);
+	g_free(new);
+	return same;
+}
+
+static void bench_b64(unsigned char *buf)
+{
+	char *enc, *dec;
+	double usecs, enc_before, enc_after, dec_before, dec_after;
+	int i, len;
+
+	enc = NULL;
+	usecs = time_usecs();
+	for (i = 0; i < B64_BENCH_ROUNDS; i++) {
+		g_free(enc);
+		len = B64_BENCH_SIZE;
+		enc = old_b64_encode_buffer((char *) buf, &len);
+	}
+	enc_before = time_usecs() - usecs;
+
+	usecs = time_usecs();
+	for (i = 0; i < B64_BENCH_ROUNDS; i++) {
+		len = B64_BENCH_SIZE;
+		g_free(b64_encode_buffer((char *) buf, &len));
+	}
+	enc_after = time_usecs() - usecs;
+
+	usecs = time_usecs();
+	for (i = 0; i < B64_BENCH_ROUNDS; i++) {
+		len = strlen(enc);
+		g_free(old_b64_decode_buffer(enc, &len));
+	}
+	dec_before = time_usecs() - usecs;
+
+	usecs = time_usecs();
+	for (i = 0; i < B64_BENCH_ROUNDS; i++) {
+		len = strlen(enc);
+		dec = b64_decode_buffer(enc, &len);
+		test_assert(dec != NULL && len == B64_BENCH_SIZE);
+		g_free(dec);
+	}
+	dec_after = time_usecs() - usecs;
+	g_free(enc);
+
+#define MBS(usecs) \
+	((double) B64_BENCH_SIZE*B64_BENCH_ROUNDS / ((usecs) < 1 ? 1 : (usecs)))
+	printf("b64 encode: before %.0f MB/s, after %.0f MB/s\n",
+	       MBS(enc_before), MBS(enc_after));
+	printf("b64 decode: before %.0f MB/s, after %.0f MB/s\n",
+	       MBS(dec_before), MBS(dec_after));
+#undef MBS
+}
+
+static void test_b64(void)
+{
+	unsigned char *buf;
+	char *old, *new, *dec, *garbage;
+	int len, old_len, new_len, dec_len, pos, bad;
+
+	old_b64_build_dec();
+	buf = g_malloc(B64_BENCH_SIZE);
+
+	bad = 0;
+	for (len = 0; len <= B64_MAX_LEN; len++) {
+		random_fill(buf, len);
+		old_len = new_len = len;
+		old = old_b64_encode_buffer((char *) buf, &old_len);
+		new = b64_encode_buffer((char *) buf, &new_len);
+		if (old_len != new_len || strcmp(old, new) != 0)
+			bad++;
+
+		dec_len = new_len;
+		dec = b64_decode_buffer(new, &dec_len);
+		if (dec == NULL || dec_len != len || memcmp(dec, buf, len) != 0)
+			bad++;
+		g_free(dec);
+
+		/* a character outside the alphabet anywhere, padding in
+		   the middle and garbage after the last full quad */
+		if (old_len > 0) {
+			pos = rand() % old_len;
+			old[pos] = "=!\xff\n"[rand() % 4];
+			if (!b64_decode_same(old, old_len))
+				bad++;
+		}
+		garbage = g_strconcat(new, "Q!\n", NULL);
+		if (!b64_decode_same(garbage, new_len + rand() % 4))
+			bad++;
+		g_free(garbage);
+		g_free(old);
+		g_free(new);
+	}
+	test_assert(bad == 0);
+
+	random_fill(buf, B64_BENCH_SIZE);
+	bench_b64(buf);
+	g_free(buf);
+}
+
+int main(void)
+{
+	srand(1);
+
+	test_idea();
+	test_schedule();
+	test_store();
+	test_fingerprint();
+	test_crc();
+	test_crc_check();
+	test_b64();
+
+	irc_delete_all_keys();
+	if (failures > 0) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	return 0;
+}